@@ -0,0 +1,539 @@
+// lsmkv_bench: db_bench-style throughput and latency benchmarks.
+//
+//   lsmkv_bench --benchmarks=fillrandom,readrandom --num=1000000 --threads=4
+//   lsmkv_bench --benchmarks=fillseq,ycsba,ycsbd --distribution=zipfian --duration=30 --json=out.json
+//
+// Run with --help for every flag. The YCSB workloads read keys written by an
+// earlier fill in the same run (or an existing DB with --use_existing_db=1).
+#include "../include/lsm_kv.h"
+#include "histogram.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace lsmkv;
+
+namespace {
+
+struct Flags {
+    std::string benchmarks = "fillseq,fillrandom,overwrite,readrandom,readseq,seekrandom";
+    std::string db = "./lsmkv_bench_db";
+    uint64_t num = 1000000;       // keys in the key space; ops per fill
+    uint64_t reads = 0;           // ops per read benchmark (0 = num)
+    int threads = 1;
+    int key_size = 16;
+    int value_size = 100;
+    bool sync = false;
+    double duration = 0;          // seconds; > 0 runs each benchmark for this long instead of a fixed op count
+    std::string distribution = "uniform"; // uniform | zipfian | latest, for random reads and YCSB
+    double zipf_theta = 0.99;
+    int scan_length = 100;        // ycsbe: scans are uniform in [1, scan_length]
+    int seek_nexts = 10;          // seekrandom: Next() calls after each Seek
+    uint64_t seed = 301;
+    bool histogram = true;
+    std::string json;             // write results as JSON to this path ("-" for stdout)
+    bool use_existing_db = false;
+    bool statistics = false;      // print DB statistics after each benchmark
+
+    // DB options.
+    size_t write_buffer_size = Options().write_buffer_size;
+    size_t cache_size = Options().block_cache_capacity;
+    unsigned bloom_bits = Options().bloom_bits_per_key;
+    int max_background_compactions = Options().max_background_compactions;
+    uint32_t max_subcompactions = Options().max_subcompactions;
+    std::string compaction_style = "level"; // level | universal | fifo
+    std::string comparator = "bytewise";    // bytewise | fixed64 | fixed128 (the latter need key_size 8 / 16)
+    bool use_direct_reads = false;
+    bool use_direct_io_for_flush_and_compaction = false;
+    int64_t rate_limit = 0;       // background I/O bytes/sec, 0 = unlimited
+    bool enable_blob_files = false;
+    uint64_t min_blob_size = Options().min_blob_size;
+};
+
+Flags FLAGS;
+
+bool ParseBool(const std::string& v) { return v == "1" || v == "true"; }
+
+// Returns false on an unknown flag or a malformed argument.
+bool ParseFlags(int argc, char** argv) {
+    std::map<std::string, std::function<void(const std::string&)>> f = {
+        {"benchmarks", [](const std::string& v){ FLAGS.benchmarks = v; }},
+        {"db", [](const std::string& v){ FLAGS.db = v; }},
+        {"num", [](const std::string& v){ FLAGS.num = std::stoull(v); }},
+        {"reads", [](const std::string& v){ FLAGS.reads = std::stoull(v); }},
+        {"threads", [](const std::string& v){ FLAGS.threads = std::max(1, std::stoi(v)); }},
+        {"key_size", [](const std::string& v){ FLAGS.key_size = std::max(8, std::stoi(v)); }},
+        {"value_size", [](const std::string& v){ FLAGS.value_size = std::max(0, std::stoi(v)); }},
+        {"sync", [](const std::string& v){ FLAGS.sync = ParseBool(v); }},
+        {"duration", [](const std::string& v){ FLAGS.duration = std::stod(v); }},
+        {"distribution", [](const std::string& v){ FLAGS.distribution = v; }},
+        {"zipf_theta", [](const std::string& v){ FLAGS.zipf_theta = std::stod(v); }},
+        {"scan_length", [](const std::string& v){ FLAGS.scan_length = std::max(1, std::stoi(v)); }},
+        {"seek_nexts", [](const std::string& v){ FLAGS.seek_nexts = std::max(0, std::stoi(v)); }},
+        {"seed", [](const std::string& v){ FLAGS.seed = std::stoull(v); }},
+        {"histogram", [](const std::string& v){ FLAGS.histogram = ParseBool(v); }},
+        {"json", [](const std::string& v){ FLAGS.json = v; }},
+        {"use_existing_db", [](const std::string& v){ FLAGS.use_existing_db = ParseBool(v); }},
+        {"statistics", [](const std::string& v){ FLAGS.statistics = ParseBool(v); }},
+        {"write_buffer_size", [](const std::string& v){ FLAGS.write_buffer_size = std::stoull(v); }},
+        {"cache_size", [](const std::string& v){ FLAGS.cache_size = std::stoull(v); }},
+        {"bloom_bits", [](const std::string& v){ FLAGS.bloom_bits = (unsigned)std::stoul(v); }},
+        {"max_background_compactions", [](const std::string& v){ FLAGS.max_background_compactions = std::stoi(v); }},
+        {"max_subcompactions", [](const std::string& v){ FLAGS.max_subcompactions = (uint32_t)std::stoul(v); }},
+        {"compaction_style", [](const std::string& v){ FLAGS.compaction_style = v; }},
+        {"comparator", [](const std::string& v){ FLAGS.comparator = v; }},
+        {"use_direct_reads", [](const std::string& v){ FLAGS.use_direct_reads = ParseBool(v); }},
+        {"use_direct_io_for_flush_and_compaction", [](const std::string& v){ FLAGS.use_direct_io_for_flush_and_compaction = ParseBool(v); }},
+        {"rate_limit", [](const std::string& v){ FLAGS.rate_limit = std::stoll(v); }},
+        {"enable_blob_files", [](const std::string& v){ FLAGS.enable_blob_files = ParseBool(v); }},
+        {"min_blob_size", [](const std::string& v){ FLAGS.min_blob_size = std::stoull(v); }},
+    };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            std::cout << "usage: lsmkv_bench [--flag=value ...]\nflags:";
+            for (const auto& kv : f) std::cout << " --" << kv.first;
+            std::cout << "\nbenchmarks: fillseq fillrandom overwrite readrandom readseq seekrandom readwhilewriting\n"
+                         "            deleterandom ycsba ycsbb ycsbc ycsbd ycsbe ycsbf\n";
+            std::exit(0);
+        }
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) { std::cerr << "bad argument: " << arg << std::endl; return false; }
+        auto it = f.find(arg.substr(2, eq - 2));
+        if (it == f.end()) { std::cerr << "unknown flag: " << arg << std::endl; return false; }
+        try { it->second(arg.substr(eq + 1)); }
+        catch (const std::exception&) { std::cerr << "bad value: " << arg << std::endl; return false; }
+    }
+    if (FLAGS.reads == 0) FLAGS.reads = FLAGS.num;
+    return true;
+}
+
+uint64_t NowMicros() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Zero-padded decimal keys of exactly key_size bytes, so they sort numerically.
+std::string MakeKey(uint64_t k) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%020llu", (unsigned long long)k);
+    std::string key(buf);
+    if ((int)key.size() >= FLAGS.key_size) return key.substr(key.size() - FLAGS.key_size);
+    return std::string(FLAGS.key_size - key.size(), '0') + key;
+}
+
+// Values are slices of a pregenerated random buffer, so producing one costs nothing.
+class ValueGenerator {
+public:
+    explicit ValueGenerator(uint64_t seed) {
+        std::mt19937_64 rng(seed);
+        data_.resize(1 << 20);
+        for (auto& c : data_) c = (char)(' ' + rng() % 95);
+    }
+    Slice Next() {
+        size_t len = (size_t)FLAGS.value_size;
+        if (pos_ + len > data_.size()) pos_ = 0;
+        Slice s(data_.data() + pos_, len);
+        pos_ += len;
+        return s;
+    }
+private:
+    std::string data_;
+    size_t pos_ = 0;
+};
+
+// YCSB's Zipfian generator (Gray et al., "Quickly Generating Billion-Record
+// Synthetic Databases"): rank 0 is the most popular item.
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(uint64_t items, double theta) : n_(std::max<uint64_t>(items, 2)), theta_(theta) {
+        for (uint64_t i = 1; i <= n_; ++i) zetan_ += 1.0 / std::pow((double)i, theta_);
+        double zeta2 = 1.0 + 1.0 / std::pow(2.0, theta_);
+        alpha_ = 1.0 / (1.0 - theta_);
+        eta_ = (1.0 - std::pow(2.0 / n_, 1.0 - theta_)) / (1.0 - zeta2 / zetan_);
+        half_pow_theta_ = 1.0 + std::pow(0.5, theta_);
+    }
+    // u uniform in [0, 1)
+    uint64_t Next(double u) const {
+        double uz = u * zetan_;
+        if (uz < 1.0) return 0;
+        if (uz < half_pow_theta_) return 1;
+        return std::min(n_ - 1, (uint64_t)(n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_)));
+    }
+private:
+    uint64_t n_;
+    double theta_, zetan_ = 0, alpha_, eta_, half_pow_theta_;
+};
+
+uint64_t FNVHash64(uint64_t v) {
+    uint64_t h = 14695981039346656037ull;
+    for (int i = 0; i < 8; ++i) { h ^= v & 0xff; h *= 1099511628211ull; v >>= 8; }
+    return h;
+}
+
+// State shared by the threads of one benchmark run.
+struct SharedState {
+    std::unique_ptr<ZipfianGenerator> zipf; // over FLAGS.num ranks
+    std::atomic<uint64_t> next_insert{0};   // keys >= num inserted by ycsbd/ycsbe
+    std::atomic<bool> stop{false};          // set when background work (readwhilewriting) should end
+};
+
+struct Stats {
+    Histogram hist;
+    uint64_t ops = 0;
+    uint64_t bytes = 0;
+    uint64_t found = 0;
+    uint64_t reads = 0;
+    uint64_t start = 0, finish = 0;
+
+    void Merge(const Stats& o) {
+        hist.Merge(o.hist);
+        ops += o.ops; bytes += o.bytes; found += o.found; reads += o.reads;
+        start = std::min(start, o.start);
+        finish = std::max(finish, o.finish);
+    }
+};
+
+struct ThreadState {
+    int tid;
+    std::mt19937_64 rng;
+    ValueGenerator values;
+    Stats stats;
+    SharedState* shared;
+    uint64_t budget;     // ops for this thread when not running by duration
+    uint64_t deadline;   // micros, 0 if running by op count
+
+    ThreadState(int t, SharedState* s, uint64_t ops)
+        : tid(t), rng(FLAGS.seed + t * 1000003ull), values(FLAGS.seed + t), shared(s), budget(ops),
+          deadline(FLAGS.duration > 0 ? NowMicros() + (uint64_t)(FLAGS.duration * 1e6) : 0) {}
+
+    bool Done() const { return deadline ? NowMicros() >= deadline : stats.ops >= budget; }
+    double Uniform01() { return (rng() >> 11) * (1.0 / 9007199254740992.0); }
+    uint64_t UniformKey(uint64_t n) { return n ? rng() % n : 0; }
+
+    // A key from FLAGS.distribution over [0, num + inserted).
+    uint64_t NextKey() {
+        uint64_t n = FLAGS.num + shared->next_insert.load(std::memory_order_relaxed);
+        if (FLAGS.distribution == "zipfian") return FNVHash64(shared->zipf->Next(Uniform01())) % n;
+        if (FLAGS.distribution == "latest") return NextLatestKey();
+        return UniformKey(n);
+    }
+    // Newest keys are the most popular.
+    uint64_t NextLatestKey() {
+        uint64_t n = FLAGS.num + shared->next_insert.load(std::memory_order_relaxed);
+        uint64_t back = shared->zipf->Next(Uniform01());
+        return back < n ? n - 1 - back : 0;
+    }
+
+    void FinishedOp(uint64_t op_start, uint64_t bytes = 0) {
+        uint64_t now = NowMicros();
+        if (FLAGS.histogram) stats.hist.Add((double)(now - op_start));
+        ++stats.ops;
+        stats.bytes += bytes;
+    }
+};
+
+class Benchmark {
+public:
+    Benchmark() { Open(!FLAGS.use_existing_db); }
+
+    int Run() {
+        std::stringstream ss(FLAGS.benchmarks);
+        std::string name;
+        PrintHeader();
+        while (std::getline(ss, name, ',')) {
+            if (name.empty()) continue;
+            std::function<void(ThreadState*)> fn;
+            uint64_t ops = FLAGS.reads;
+            bool fresh = false;
+            bool background_writer = false;
+            if (name == "fillseq") { fn = [this](ThreadState* t){ Fill(t, false); }; ops = FLAGS.num; fresh = true; }
+            else if (name == "fillrandom") { fn = [this](ThreadState* t){ Fill(t, true); }; ops = FLAGS.num; fresh = true; }
+            else if (name == "overwrite") { fn = [this](ThreadState* t){ Fill(t, true); }; ops = FLAGS.num; }
+            else if (name == "readrandom") fn = [this](ThreadState* t){ ReadRandom(t); };
+            else if (name == "readseq") fn = [this](ThreadState* t){ ReadSeq(t); };
+            else if (name == "seekrandom") fn = [this](ThreadState* t){ SeekRandom(t); };
+            else if (name == "readwhilewriting") { fn = [this](ThreadState* t){ ReadRandom(t); }; background_writer = true; }
+            else if (name == "deleterandom") { fn = [this](ThreadState* t){ DeleteRandom(t); }; ops = FLAGS.num; }
+            else if (name.size() == 5 && name.compare(0, 4, "ycsb") == 0 && name[4] >= 'a' && name[4] <= 'f') {
+                char w = name[4];
+                fn = [this, w](ThreadState* t){ Ycsb(t, w); };
+            } else {
+                std::cerr << "unknown benchmark: " << name << std::endl;
+                return 1;
+            }
+            if (fresh && !FLAGS.use_existing_db) Open(true);
+            Stats st = RunThreads(fn, ops, background_writer);
+            Report(name, st);
+            if (stats_) {
+                std::printf("%s", stats_->ToString().c_str());
+                stats_->Reset();
+            }
+        }
+        WriteJson();
+        return 0;
+    }
+
+private:
+    void Open(bool fresh) {
+        db_.reset();
+        if (fresh) std::filesystem::remove_all(FLAGS.db);
+        Options opt;
+        opt.db_path = FLAGS.db;
+        opt.write_buffer_size = FLAGS.write_buffer_size;
+        opt.block_cache_capacity = FLAGS.cache_size;
+        opt.bloom_bits_per_key = FLAGS.bloom_bits;
+        opt.max_background_compactions = FLAGS.max_background_compactions;
+        opt.max_subcompactions = FLAGS.max_subcompactions;
+        if (FLAGS.compaction_style == "universal") opt.compaction_style = kCompactionStyleUniversal;
+        else if (FLAGS.compaction_style == "fifo") opt.compaction_style = kCompactionStyleFIFO;
+        if (FLAGS.comparator == "fixed64") opt.comparator = FixedBigEndian64Comparator();
+        else if (FLAGS.comparator == "fixed128") opt.comparator = FixedBigEndian128Comparator();
+        opt.use_direct_reads = FLAGS.use_direct_reads;
+        opt.use_direct_io_for_flush_and_compaction = FLAGS.use_direct_io_for_flush_and_compaction;
+        if (FLAGS.rate_limit > 0) opt.rate_limiter = NewGenericRateLimiter(FLAGS.rate_limit);
+        opt.enable_blob_files = FLAGS.enable_blob_files;
+        opt.min_blob_size = FLAGS.min_blob_size;
+        if (FLAGS.statistics) {
+            if (!stats_) stats_ = CreateDBStatistics();
+            opt.statistics = stats_;
+        }
+        Status s = DB::Open(opt, FLAGS.db, &db_);
+        if (!s.ok()) { std::cerr << "open " << FLAGS.db << ": " << s.ToString() << std::endl; std::exit(1); }
+        shared_.next_insert = 0;
+    }
+
+    Stats RunThreads(const std::function<void(ThreadState*)>& fn, uint64_t ops, bool background_writer) {
+        if (!shared_.zipf) shared_.zipf.reset(new ZipfianGenerator(FLAGS.num, FLAGS.zipf_theta));
+        shared_.stop = false;
+        std::vector<std::unique_ptr<ThreadState>> states;
+        for (int i = 0; i < FLAGS.threads; ++i) {
+            uint64_t share = ops / FLAGS.threads + (i < (int)(ops % FLAGS.threads) ? 1 : 0);
+            states.emplace_back(new ThreadState(i, &shared_, share));
+        }
+        std::thread writer;
+        if (background_writer) {
+            writer = std::thread([this]{
+                ThreadState w(FLAGS.threads, &shared_, 0);
+                WriteOptions wo; wo.sync = FLAGS.sync;
+                while (!shared_.stop.load(std::memory_order_relaxed)) {
+                    db_->Put(wo, Slice(MakeKey(w.UniformKey(FLAGS.num))), w.values.Next());
+                }
+            });
+        }
+        std::vector<std::thread> threads;
+        for (auto& st : states) {
+            threads.emplace_back([&fn, &st]{
+                st->stats.start = NowMicros();
+                fn(st.get());
+                st->stats.finish = NowMicros();
+            });
+        }
+        for (auto& t : threads) t.join();
+        shared_.stop = true;
+        if (writer.joinable()) writer.join();
+        Stats merged = states[0]->stats;
+        for (size_t i = 1; i < states.size(); ++i) merged.Merge(states[i]->stats);
+        return merged;
+    }
+
+    void Fill(ThreadState* t, bool random) {
+        WriteOptions wo; wo.sync = FLAGS.sync;
+        // Sequential fills split the key space into one contiguous range per thread.
+        uint64_t base = FLAGS.num / FLAGS.threads * t->tid;
+        for (uint64_t i = 0; !t->Done(); ++i) {
+            uint64_t k = random ? t->UniformKey(FLAGS.num) : (base + i) % std::max<uint64_t>(FLAGS.num, 1);
+            std::string key = MakeKey(k);
+            Slice v = t->values.Next();
+            uint64_t start = NowMicros();
+            Status s = db_->Put(wo, Slice(key), v);
+            if (!s.ok()) { std::cerr << "put: " << s.ToString() << std::endl; std::exit(1); }
+            t->FinishedOp(start, key.size() + v.size());
+        }
+    }
+
+    void DeleteRandom(ThreadState* t) {
+        WriteOptions wo; wo.sync = FLAGS.sync;
+        while (!t->Done()) {
+            std::string key = MakeKey(t->UniformKey(FLAGS.num));
+            uint64_t start = NowMicros();
+            db_->Delete(wo, Slice(key));
+            t->FinishedOp(start, key.size());
+        }
+    }
+
+    bool Read(ThreadState* t, uint64_t k, std::string* value) {
+        std::string key = MakeKey(k);
+        bool found = db_->Get(ReadOptions(), Slice(key), value).ok();
+        ++t->stats.reads;
+        if (found) ++t->stats.found;
+        return found;
+    }
+
+    void ReadRandom(ThreadState* t) {
+        std::string value;
+        while (!t->Done()) {
+            uint64_t k = t->NextKey();
+            uint64_t start = NowMicros();
+            Read(t, k, &value);
+            t->FinishedOp(start, FLAGS.key_size + value.size());
+        }
+    }
+
+    void ReadSeq(ThreadState* t) {
+        auto it = db_->NewIterator(ReadOptions());
+        it->SeekToFirst();
+        while (!t->Done()) {
+            uint64_t start = NowMicros();
+            if (!it->Valid()) it->SeekToFirst();
+            if (!it->Valid()) break;
+            uint64_t bytes = it->key().size() + it->value().size();
+            it->Next();
+            t->FinishedOp(start, bytes);
+        }
+    }
+
+    void SeekRandom(ThreadState* t) {
+        auto it = db_->NewIterator(ReadOptions());
+        while (!t->Done()) {
+            std::string key = MakeKey(t->NextKey());
+            uint64_t start = NowMicros();
+            it->Seek(Slice(key));
+            ++t->stats.reads;
+            if (it->Valid() && it->key().compare(Slice(key)) == 0) ++t->stats.found;
+            for (int i = 0; i < FLAGS.seek_nexts && it->Valid(); ++i) it->Next();
+            t->FinishedOp(start);
+        }
+    }
+
+    // Core YCSB workloads; the request distribution comes from --distribution
+    // except for D, which always reads the latest keys.
+    //   A 50% read / 50% update      B 95% read / 5% update     C 100% read
+    //   D 95% read / 5% insert       E 95% scan / 5% insert     F 50% read / 50% read-modify-write
+    void Ycsb(ThreadState* t, char workload) {
+        WriteOptions wo; wo.sync = FLAGS.sync;
+        std::string value;
+        while (!t->Done()) {
+            double r = t->Uniform01();
+            uint64_t start = NowMicros();
+            switch (workload) {
+            case 'a': case 'b': case 'c': {
+                double read_fraction = workload == 'a' ? 0.5 : workload == 'b' ? 0.95 : 1.0;
+                uint64_t k = t->NextKey();
+                if (r < read_fraction) Read(t, k, &value);
+                else db_->Put(wo, Slice(MakeKey(k)), t->values.Next());
+                break;
+            }
+            case 'd':
+                if (r < 0.95) Read(t, t->NextLatestKey(), &value);
+                else Insert(t, wo);
+                break;
+            case 'e':
+                if (r < 0.95) {
+                    auto it = db_->NewIterator(ReadOptions());
+                    int len = 1 + (int)t->UniformKey(FLAGS.scan_length);
+                    it->Seek(Slice(MakeKey(t->NextKey())));
+                    for (int i = 0; i < len && it->Valid(); ++i) it->Next();
+                } else {
+                    Insert(t, wo);
+                }
+                break;
+            case 'f': {
+                uint64_t k = t->NextKey();
+                Read(t, k, &value);
+                if (r >= 0.5) db_->Put(wo, Slice(MakeKey(k)), t->values.Next());
+                break;
+            }
+            }
+            t->FinishedOp(start);
+        }
+    }
+
+    void Insert(ThreadState* t, const WriteOptions& wo) {
+        uint64_t k = FLAGS.num + shared_.next_insert.fetch_add(1);
+        db_->Put(wo, Slice(MakeKey(k)), t->values.Next());
+    }
+
+    void PrintHeader() const {
+        std::printf("Keys:       %d bytes each\n", FLAGS.key_size);
+        std::printf("Comparator: %s\n", FLAGS.comparator.c_str());
+        std::printf("Values:     %d bytes each\n", FLAGS.value_size);
+        std::printf("Entries:    %llu\n", (unsigned long long)FLAGS.num);
+        std::printf("Threads:    %d\n", FLAGS.threads);
+        std::printf("Sync:       %s\n", FLAGS.sync ? "yes" : "no");
+        std::printf("Distribution: %s\n", FLAGS.distribution.c_str());
+        std::printf("------------------------------------------------\n");
+    }
+
+    void Report(const std::string& name, const Stats& st) {
+        double secs = (st.finish - st.start) / 1e6;
+        if (secs <= 0) secs = 1e-6;
+        double ops_sec = st.ops / secs;
+        double mb_sec = st.bytes / 1048576.0 / secs;
+        std::string extra;
+        if (st.reads) extra = " (" + std::to_string(st.found) + " of " + std::to_string(st.reads) + " found)";
+        std::printf("%-16s : %11.3f micros/op %10.0f ops/sec", name.c_str(), st.ops ? secs * 1e6 / st.ops * FLAGS.threads : 0.0, ops_sec);
+        if (st.bytes) std::printf(" %8.1f MB/s", mb_sec);
+        std::printf("%s\n", extra.c_str());
+        if (FLAGS.histogram) std::printf("Microseconds per op:\n%s\n", st.hist.ToString().c_str());
+        std::fflush(stdout);
+
+        char buf[512];
+        std::snprintf(buf, sizeof(buf),
+                      "{\"name\": \"%s\", \"ops\": %llu, \"seconds\": %.6f, \"ops_per_sec\": %.1f, \"mb_per_sec\": %.3f, "
+                      "\"found\": %llu, \"reads\": %llu, \"latency_micros\": {\"avg\": %.2f, \"p50\": %.2f, \"p99\": %.2f, "
+                      "\"p99.9\": %.2f, \"max\": %.2f}}",
+                      name.c_str(), (unsigned long long)st.ops, secs, ops_sec, mb_sec, (unsigned long long)st.found,
+                      (unsigned long long)st.reads, st.hist.Average(), st.hist.Percentile(50), st.hist.Percentile(99),
+                      st.hist.Percentile(99.9), st.hist.Max());
+        results_.push_back(buf);
+    }
+
+    void WriteJson() const {
+        if (FLAGS.json.empty()) return;
+        std::ostringstream out;
+        out << "{\"config\": {\"num\": " << FLAGS.num << ", \"reads\": " << FLAGS.reads << ", \"threads\": " << FLAGS.threads
+            << ", \"key_size\": " << FLAGS.key_size << ", \"value_size\": " << FLAGS.value_size
+            << ", \"sync\": " << (FLAGS.sync ? "true" : "false") << ", \"duration\": " << FLAGS.duration
+            << ", \"distribution\": \"" << FLAGS.distribution << "\", \"compaction_style\": \"" << FLAGS.compaction_style << "\"},\n"
+            << " \"benchmarks\": [\n";
+        for (size_t i = 0; i < results_.size(); ++i) out << "  " << results_[i] << (i + 1 < results_.size() ? ",\n" : "\n");
+        out << "]}\n";
+        if (FLAGS.json == "-") { std::cout << out.str(); return; }
+        std::ofstream f(FLAGS.json);
+        f << out.str();
+        if (!f) std::cerr << "cannot write " << FLAGS.json << std::endl;
+    }
+
+    std::unique_ptr<DB> db_;
+    std::shared_ptr<Statistics> stats_;
+    SharedState shared_;
+    std::vector<std::string> results_;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (!ParseFlags(argc, argv)) return 1;
+    if (FLAGS.distribution != "uniform" && FLAGS.distribution != "zipfian" && FLAGS.distribution != "latest") {
+        std::cerr << "unknown distribution: " << FLAGS.distribution << std::endl;
+        return 1;
+    }
+    Benchmark bench;
+    return bench.Run();
+}
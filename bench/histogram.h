@@ -0,0 +1,100 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace lsmkv {
+
+// Latency histogram in microseconds with roughly 10% wide buckets, so
+// percentiles are exact to within a bucket. Merge combines per-thread copies.
+class Histogram {
+public:
+    Histogram() {
+        // 1, 2, ..., 10, 12, 14, ... growing by ~10% up to ~10^10 micros.
+        double b = 1;
+        while (b < 1e10) {
+            limits_.push_back(b);
+            double next = std::floor(b * 1.1);
+            b = next > b ? next : b + 1;
+        }
+        limits_.push_back(std::numeric_limits<double>::max());
+        counts_.assign(limits_.size(), 0);
+    }
+
+    void Add(double micros) {
+        size_t i = std::upper_bound(limits_.begin(), limits_.end() - 1, micros) - limits_.begin();
+        ++counts_[i];
+        ++n_;
+        sum_ += micros;
+        min_ = std::min(min_, micros);
+        max_ = std::max(max_, micros);
+    }
+
+    void Merge(const Histogram& o) {
+        for (size_t i = 0; i < counts_.size(); ++i) counts_[i] += o.counts_[i];
+        n_ += o.n_;
+        sum_ += o.sum_;
+        min_ = std::min(min_, o.min_);
+        max_ = std::max(max_, o.max_);
+    }
+
+    uint64_t Count() const { return n_; }
+    double Average() const { return n_ ? sum_ / n_ : 0; }
+    double Min() const { return n_ ? min_ : 0; }
+    double Max() const { return n_ ? max_ : 0; }
+
+    // Interpolates linearly inside the bucket holding the p-th percentile.
+    double Percentile(double p) const {
+        if (n_ == 0) return 0;
+        double threshold = n_ * (p / 100.0);
+        uint64_t cum = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            if (counts_[i] == 0) continue;
+            if (cum + counts_[i] >= threshold) {
+                double lo = i == 0 ? 0 : limits_[i - 1];
+                double hi = i + 1 == limits_.size() ? max_ : limits_[i];
+                double r = lo + (hi - lo) * (threshold - cum) / counts_[i];
+                return std::max(min_, std::min(max_, r));
+            }
+            cum += counts_[i];
+        }
+        return max_;
+    }
+
+    std::string ToString() const {
+        char buf[256];
+        std::snprintf(buf, sizeof(buf),
+                      "Count: %llu  Average: %.2f  Min: %.2f  Max: %.2f\n"
+                      "Percentiles (micros): P50: %.2f  P99: %.2f  P99.9: %.2f\n",
+                      (unsigned long long)n_, Average(), Min(), Max(), Percentile(50), Percentile(99), Percentile(99.9));
+        std::string out = buf;
+        out += "------------------------------------------------------\n";
+        uint64_t cum = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            if (counts_[i] == 0) continue;
+            cum += counts_[i];
+            double lo = i == 0 ? 0 : limits_[i - 1];
+            double pct = 100.0 * counts_[i] / n_;
+            std::snprintf(buf, sizeof(buf), "[ %10.0f, %10.0f ) %10llu %7.3f%% %7.3f%% ",
+                          lo, i + 1 == limits_.size() ? max_ : limits_[i], (unsigned long long)counts_[i], pct, 100.0 * cum / n_);
+            out += buf;
+            out += std::string((size_t)(pct / 5 + 0.5), '#');
+            out += "\n";
+        }
+        return out;
+    }
+
+private:
+    std::vector<double> limits_;
+    std::vector<uint64_t> counts_;
+    uint64_t n_ = 0;
+    double sum_ = 0;
+    double min_ = std::numeric_limits<double>::max();
+    double max_ = 0;
+};
+
+} // namespace lsmkv
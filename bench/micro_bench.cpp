@@ -0,0 +1,493 @@
+// lsmkv_microbench: per-component benchmarks for the hot kernels.
+//
+//   lsmkv_microbench                                  # all benchmarks, pinned to one CPU
+//   lsmkv_microbench --filter=bloom --repetitions=9
+//   lsmkv_microbench --json=baseline.json             # record a baseline
+//   lsmkv_microbench --baseline=baseline.json --max_regression=0.10
+//
+// Each benchmark is calibrated until one repetition takes --min_time seconds,
+// then repeated; the median ns per item is the reported figure and the one
+// compared against a baseline. With --baseline the exit status is 2 when any
+// benchmark is slower than the baseline by more than --max_regression, so CI
+// can fail on it. Inputs come from fixed seeds so runs are comparable.
+// Build with -DCMAKE_BUILD_TYPE=Release; numbers from unoptimized builds are
+// flagged in the output.
+#include "../src/compaction/merger.h"
+#include "../src/memtable/skiplist.h"
+#include "../src/sstable/block.h"
+#include "../src/sstable/index_block.h"
+#include "../src/table_cache/block_cache.h"
+#include "../src/util/bloom_filter.h"
+#include "../src/util/coding.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+using namespace lsmkv;
+
+namespace {
+
+struct Flags {
+    std::string filter;           // run benchmarks whose name contains this
+    double min_time = 0.2;        // seconds per repetition
+    int repetitions = 5;
+    int cpu = -2;                 // CPU to pin to; -2 = first allowed CPU, -1 = no pinning
+    std::string json;             // write results as JSON to this path ("-" for stdout)
+    std::string baseline;         // JSON written by an earlier --json run
+    double max_regression = 0.10; // allowed slowdown of the median against the baseline
+};
+
+Flags FLAGS;
+
+bool ParseFlags(int argc, char** argv) {
+    std::map<std::string, std::function<void(const std::string&)>> f = {
+        {"filter", [](const std::string& v){ FLAGS.filter = v; }},
+        {"min_time", [](const std::string& v){ FLAGS.min_time = std::stod(v); }},
+        {"repetitions", [](const std::string& v){ FLAGS.repetitions = std::max(1, std::stoi(v)); }},
+        {"cpu", [](const std::string& v){ FLAGS.cpu = std::stoi(v); }},
+        {"json", [](const std::string& v){ FLAGS.json = v; }},
+        {"baseline", [](const std::string& v){ FLAGS.baseline = v; }},
+        {"max_regression", [](const std::string& v){ FLAGS.max_regression = std::stod(v); }},
+    };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            std::cout << "usage: lsmkv_microbench [--flag=value ...]\nflags:";
+            for (const auto& kv : f) std::cout << " --" << kv.first;
+            std::cout << "\n";
+            std::exit(0);
+        }
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) { std::cerr << "bad argument: " << arg << std::endl; return false; }
+        auto it = f.find(arg.substr(2, eq - 2));
+        if (it == f.end()) { std::cerr << "unknown flag: " << arg << std::endl; return false; }
+        try { it->second(arg.substr(eq + 1)); }
+        catch (const std::exception&) { std::cerr << "bad value: " << arg << std::endl; return false; }
+    }
+    return true;
+}
+
+// Keeps the compiler from discarding a computed value.
+template <typename T>
+inline void DoNotOptimize(const T& v) {
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(v) : "memory");
+#else
+    static volatile char sink; sink = *(const volatile char*)&v;
+#endif
+}
+
+// CPUs this process may run on, in order; empty where affinity is unsupported.
+std::vector<int> AllowedCpus() {
+    std::vector<int> cpus;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; ++c) if (CPU_ISSET(c, &set)) cpus.push_back(c);
+    }
+#endif
+    return cpus;
+}
+
+bool PinThread(int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+std::string Key(uint64_t n) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%016llu", (unsigned long long)n);
+    return buf;
+}
+
+std::vector<std::string> RandomKeys(size_t n, uint64_t seed) {
+    std::mt19937_64 rnd(seed);
+    std::vector<std::string> keys(n);
+    for (auto& k : keys) k = Key(rnd() % 10000000000000000ull);
+    return keys;
+}
+
+std::vector<std::string> SortedKeys(size_t n, uint64_t seed) {
+    std::vector<std::string> keys = RandomKeys(n, seed);
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+// Bytewise order as a kCustom comparator: what a user-supplied one costs.
+class VirtualBytewise final : public Comparator {
+public:
+    int Compare(const Slice& a, const Slice& b) const override { return a.compare(b); }
+    const char* Name() const override { return "microbench.VirtualBytewise"; }
+};
+const VirtualBytewise kVirtualBytewise;
+
+// Search benchmarks run once per comparator kind; the keys are 16 bytes, so
+// the fixed-width one applies. Bytewise keeps the unsuffixed name.
+const std::pair<const char*, const Comparator*> kComparators[] = {
+    {"", BytewiseComparator()}, {"/fixed128", FixedBigEndian128Comparator()}, {"/custom", &kVirtualBytewise}};
+
+using KeyList = SkipList<std::string, MemValue, UserKeyComparator>;
+
+// Sorted in-memory child for the merger benchmark.
+class VectorIterator final : public InternalIterator {
+public:
+    explicit VectorIterator(const std::vector<std::string>* keys) : keys_(keys) {}
+    bool Valid() const override { return i_ < keys_->size(); }
+    void SeekToFirst() override { i_ = 0; }
+    void Seek(const Slice& target) override {
+        i_ = std::lower_bound(keys_->begin(), keys_->end(), target,
+                              [](const std::string& a, const Slice& b){ return Slice(a).compare(b) < 0; }) - keys_->begin();
+    }
+    void Next() override { ++i_; }
+    Slice key() const override { return Slice((*keys_)[i_]); }
+    Slice value() const override { return Slice((*keys_)[i_]); }
+    ValueType type() const override { return kTypeValue; }
+private:
+    const std::vector<std::string>* keys_;
+    size_t i_ = 0;
+};
+
+// A benchmark's body runs `iters` iterations of `items` operations each.
+// setup builds the inputs outside the timed region and returns the body.
+struct Benchmark {
+    std::string name;
+    uint64_t items = 1;
+    std::function<std::function<void(uint64_t iters)>()> setup;
+};
+
+std::vector<Benchmark> Benchmarks() {
+    std::vector<Benchmark> b;
+
+    b.push_back({"skiplist_insert/10k", 10000, []{
+        auto keys = std::make_shared<std::vector<std::string>>(RandomKeys(10000, 1));
+        return std::function<void(uint64_t)>([keys](uint64_t iters) {
+            MemValue v{kTypeValue, "v"};
+            for (uint64_t i = 0; i < iters; ++i) {
+                KeyList list;
+                for (const auto& k : *keys) list.InsertOrAssign(k, v);
+                DoNotOptimize(list);
+            }
+        });
+    }});
+
+    for (const auto& c : kComparators) {
+        const Comparator* cmp = c.second;
+        b.push_back({std::string("skiplist_seek/100k") + c.first, 1, [cmp]{
+            auto keys = std::make_shared<std::vector<std::string>>(RandomKeys(100000, 2));
+            auto list = std::make_shared<KeyList>(UserKeyComparator(cmp));
+            for (const auto& k : *keys) list->InsertOrAssign(k, MemValue{kTypeValue, "v"});
+            return std::function<void(uint64_t)>([keys, list](uint64_t iters) {
+                size_t n = keys->size();
+                for (uint64_t i = 0; i < iters; ++i) {
+                    auto it = list->Seek((*keys)[(i * 7919) % n]);
+                    DoNotOptimize(it);
+                }
+            });
+        }});
+    }
+
+    b.push_back({"bloom_key_may_match/10bits", 1, []{
+        auto keys = std::make_shared<std::vector<std::string>>(RandomKeys(200000, 3));
+        BloomFilterBuilder builder(10);
+        for (size_t i = 0; i < keys->size(); i += 2) builder.AddKey((*keys)[i]);
+        auto data = std::make_shared<std::string>(builder.Finalize());
+        auto reader = std::make_shared<BloomFilterReader>(Slice(*data));
+        // Half the probes are present keys, half absent.
+        return std::function<void(uint64_t)>([keys, data, reader](uint64_t iters) {
+            size_t n = keys->size();
+            for (uint64_t i = 0; i < iters; ++i) DoNotOptimize(reader->KeyMayMatch((*keys)[(i * 7919) % n]));
+        });
+    }});
+
+    {
+        // One 4KB block of 16-byte keys and 100-byte values.
+        auto keys = std::make_shared<std::vector<std::string>>(SortedKeys(64, 4));
+        auto block = std::make_shared<std::string>();
+        DataBlockBuilder builder(4096);
+        std::string value(100, 'x');
+        uint64_t entries = 0;
+        for (const auto& k : *keys) {
+            if (builder.ShouldFlush()) break;
+            builder.Add(k, kTypeValue, value);
+            ++entries;
+        }
+        *block = builder.Finish();
+        b.push_back({"data_block_decode/4k", entries, [block]{
+            return std::function<void(uint64_t)>([block](uint64_t iters) {
+                for (uint64_t i = 0; i < iters; ++i) {
+                    DataBlockReader reader{Slice(*block)};
+                    ParsedEntry e;
+                    while (reader.Next(e)) DoNotOptimize(e);
+                }
+            });
+        }});
+    }
+
+    for (const auto& c : kComparators) {
+        const Comparator* cmp = c.second;
+        b.push_back({std::string("index_find_block/1k") + c.first, 1, [cmp]{
+            // Index of a 4MB table in 4KB blocks; probes fall between block keys.
+            std::vector<std::string> index_keys = SortedKeys(1024, 5);
+            IndexBlockBuilder builder;
+            for (size_t i = 0; i < index_keys.size(); ++i) builder.Add(index_keys[i], i * 4096, 4096);
+            std::string contents = builder.Finish();
+            auto reader = std::make_shared<IndexBlockReader>(Slice(contents), cmp);
+            auto probes = std::make_shared<std::vector<std::string>>(RandomKeys(4096, 6));
+            return std::function<void(uint64_t)>([reader, probes](uint64_t iters) {
+                size_t n = probes->size();
+                for (uint64_t i = 0; i < iters; ++i) DoNotOptimize(reader->FindBlock((*probes)[i % n]));
+            });
+        }});
+    }
+
+    b.push_back({"hash64/16", 1, []{
+        auto keys = std::make_shared<std::vector<std::string>>(RandomKeys(4096, 7));
+        return std::function<void(uint64_t)>([keys](uint64_t iters) {
+            for (uint64_t i = 0; i < iters; ++i) {
+                const std::string& k = (*keys)[i & 4095];
+                DoNotOptimize(Hash64(k.data(), k.size()));
+            }
+        });
+    }});
+
+    b.push_back({"hash64/4k", 1, []{
+        auto block = std::make_shared<std::string>(4096, 'h');
+        return std::function<void(uint64_t)>([block](uint64_t iters) {
+            for (uint64_t i = 0; i < iters; ++i) DoNotOptimize(Hash64(block->data(), block->size()));
+        });
+    }});
+
+    {
+        // Values spread over every encoded length, 1 to 10 bytes.
+        auto values = std::make_shared<std::vector<uint64_t>>(1024);
+        std::mt19937_64 rnd(8);
+        for (auto& v : *values) v = rnd() >> (rnd() % 64);
+        b.push_back({"varint64_encode", values->size(), [values]{
+            return std::function<void(uint64_t)>([values](uint64_t iters) {
+                std::string buf;
+                for (uint64_t i = 0; i < iters; ++i) {
+                    buf.clear();
+                    for (uint64_t v : *values) PutVarint64(buf, v);
+                    DoNotOptimize(buf);
+                }
+            });
+        }});
+        b.push_back({"varint64_decode", values->size(), [values]{
+            auto buf = std::make_shared<std::string>();
+            for (uint64_t v : *values) PutVarint64(*buf, v);
+            return std::function<void(uint64_t)>([buf](uint64_t iters) {
+                for (uint64_t i = 0; i < iters; ++i) {
+                    const char* p = buf->data();
+                    const char* limit = p + buf->size();
+                    uint64_t v = 0;
+                    while (p && p < limit) { p = GetVarint64Ptr(p, limit, &v); DoNotOptimize(v); }
+                }
+            });
+        }});
+    }
+
+    // 90% Get / 10% Put of 4KB blocks; the cache holds about half the key space,
+    // so Puts also evict. Each thread is pinned to its own allowed CPU.
+    for (int threads : {1, 4}) {
+        b.push_back({"block_cache_get_put/threads:" + std::to_string(threads), 1, [threads]{
+            auto cache = std::make_shared<BlockCache>(2048 * 4096);
+            auto keys = std::make_shared<std::vector<std::string>>();
+            for (int i = 0; i < 4096; ++i) keys->push_back("/db/000123.sst:" + std::to_string(i * 4096));
+            auto block = std::make_shared<std::string>(4096, 'b');
+            for (const auto& k : *keys) cache->Put(k, *block);
+            return std::function<void(uint64_t)>([threads, cache, keys, block](uint64_t iters) {
+                std::vector<int> cpus = AllowedCpus();
+                auto worker = [&](int t, uint64_t ops) {
+                    if (FLAGS.cpu != -1 && !cpus.empty()) PinThread(cpus[t % cpus.size()]);
+                    std::mt19937 rnd(t + 9);
+                    std::string out;
+                    for (uint64_t i = 0; i < ops; ++i) {
+                        const std::string& k = (*keys)[rnd() % keys->size()];
+                        if (rnd() % 10 == 0) cache->Put(k, *block);
+                        else DoNotOptimize(cache->Get(k, &out));
+                    }
+                };
+                std::vector<std::thread> pool;
+                for (int t = 1; t < threads; ++t) pool.emplace_back(worker, t, iters / threads);
+                worker(0, iters - (iters / threads) * (threads - 1));
+                for (auto& th : pool) th.join();
+            });
+        }});
+    }
+
+    // Eight overlapping sorted runs of 16-byte keys, as from L0 files.
+    b.push_back({"merging_iterator/8x16k", 8 * 16384, []{
+        auto runs = std::make_shared<std::vector<std::vector<std::string>>>();
+        for (int i = 0; i < 8; ++i) {
+            runs->push_back(SortedKeys(16384, 10 + i));
+            runs->back().resize(std::min<size_t>(runs->back().size(), 16384));
+        }
+        return std::function<void(uint64_t)>([runs](uint64_t iters) {
+            for (uint64_t i = 0; i < iters; ++i) {
+                std::vector<std::unique_ptr<InternalIterator>> children;
+                for (const auto& r : *runs) children.emplace_back(new VectorIterator(&r));
+                MergingIterator merger(BytewiseComparator(), std::move(children));
+                for (merger.SeekToFirst(); merger.Valid(); merger.Next()) DoNotOptimize(merger.key());
+            }
+        });
+    }});
+
+    return b;
+}
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Result {
+    std::string name;
+    uint64_t iters = 0, items = 1;
+    double median_ns = 0, min_ns = 0, max_ns = 0; // per item
+};
+
+Result Run(const Benchmark& bench) {
+    auto body = bench.setup();
+    Result r;
+    r.name = bench.name;
+    r.items = bench.items;
+    // Warm up, then grow the iteration count until a repetition takes min_time.
+    uint64_t iters = 1;
+    while (true) {
+        auto start = std::chrono::steady_clock::now();
+        body(iters);
+        double secs = Seconds(start);
+        if (secs >= FLAGS.min_time) break;
+        double scale = secs > 0 ? FLAGS.min_time * 1.2 / secs : 100;
+        iters = std::max<uint64_t>(iters + 1, (uint64_t)(iters * std::min(scale, 100.0)));
+    }
+    std::vector<double> ns;
+    for (int i = 0; i < FLAGS.repetitions; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        body(iters);
+        ns.push_back(Seconds(start) * 1e9 / ((double)iters * bench.items));
+    }
+    std::sort(ns.begin(), ns.end());
+    r.iters = iters;
+    r.median_ns = ns[ns.size() / 2];
+    r.min_ns = ns.front();
+    r.max_ns = ns.back();
+    return r;
+}
+
+std::string JsonLine(const Result& r) {
+    char buf[256];
+    std::snprintf(buf, sizeof(buf),
+                  "{\"name\": \"%s\", \"ns_per_item\": %.3f, \"min_ns_per_item\": %.3f, \"max_ns_per_item\": %.3f, "
+                  "\"iterations\": %llu, \"items_per_iteration\": %llu}",
+                  r.name.c_str(), r.median_ns, r.min_ns, r.max_ns, (unsigned long long)r.iters, (unsigned long long)r.items);
+    return buf;
+}
+
+// Reads name -> ns_per_item from a file written by --json, which puts one
+// benchmark object per line.
+bool ReadBaseline(const std::string& path, std::map<std::string, double>* out) {
+    std::ifstream f(path);
+    if (!f) return false;
+    std::string line;
+    while (std::getline(f, line)) {
+        size_t n = line.find("\"name\": \"");
+        size_t t = line.find("\"ns_per_item\": ");
+        if (n == std::string::npos || t == std::string::npos) continue;
+        n += 9;
+        size_t end = line.find('"', n);
+        if (end == std::string::npos) continue;
+        (*out)[line.substr(n, end - n)] = std::strtod(line.c_str() + t + 15, nullptr);
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (!ParseFlags(argc, argv)) return 1;
+
+    std::map<std::string, double> baseline;
+    if (!FLAGS.baseline.empty() && !ReadBaseline(FLAGS.baseline, &baseline)) {
+        std::cerr << "cannot read baseline " << FLAGS.baseline << std::endl;
+        return 1;
+    }
+
+    std::vector<int> cpus = AllowedCpus();
+    int pinned = -1;
+    if (FLAGS.cpu != -1) {
+        int cpu = FLAGS.cpu >= 0 ? FLAGS.cpu : (cpus.empty() ? -1 : cpus.front());
+        if (cpu >= 0 && PinThread(cpu)) pinned = cpu;
+        else std::cerr << "warning: could not pin to CPU " << cpu << std::endl;
+    }
+#if defined(__OPTIMIZE__)
+    const bool optimized = true;
+#else
+    const bool optimized = false;
+    std::cerr << "warning: built without optimization; configure with -DCMAKE_BUILD_TYPE=Release" << std::endl;
+#endif
+    std::printf("CPU: %d (of %zu allowed)  min_time: %.2fs  repetitions: %d\n", pinned, cpus.size(), FLAGS.min_time, FLAGS.repetitions);
+    std::printf("%-32s %12s %12s %12s %10s\n", "benchmark", "ns/item", "min", "max", "vs base");
+
+    std::vector<Result> results;
+    int regressions = 0;
+    for (const Benchmark& bench : Benchmarks()) {
+        if (!FLAGS.filter.empty() && bench.name.find(FLAGS.filter) == std::string::npos) continue;
+        Result r = Run(bench);
+        results.push_back(r);
+        std::string delta;
+        auto it = baseline.find(r.name);
+        if (it != baseline.end() && it->second > 0) {
+            double change = r.median_ns / it->second - 1;
+            char buf[32];
+            std::snprintf(buf, sizeof(buf), "%+.1f%%", change * 100);
+            delta = buf;
+            if (change > FLAGS.max_regression) { delta += " REGRESSION"; ++regressions; }
+        }
+        std::printf("%-32s %12.2f %12.2f %12.2f %10s\n", r.name.c_str(), r.median_ns, r.min_ns, r.max_ns, delta.c_str());
+        std::fflush(stdout);
+    }
+
+    if (!FLAGS.json.empty()) {
+        std::ostringstream out;
+        out << "{\"context\": {\"cpu\": " << pinned << ", \"allowed_cpus\": " << cpus.size()
+            << ", \"optimized\": " << (optimized ? "true" : "false") << ", \"min_time\": " << FLAGS.min_time
+            << ", \"repetitions\": " << FLAGS.repetitions << "},\n \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) out << "  " << JsonLine(results[i]) << (i + 1 < results.size() ? ",\n" : "\n");
+        out << "]}\n";
+        if (FLAGS.json == "-") {
+            std::cout << out.str();
+        } else {
+            std::ofstream f(FLAGS.json);
+            f << out.str();
+            if (!f) std::cerr << "cannot write " << FLAGS.json << std::endl;
+        }
+    }
+    if (regressions > 0) {
+        std::fprintf(stderr, "%d benchmark(s) regressed by more than %.0f%%\n", regressions, FLAGS.max_regression * 100);
+        return 2;
+    }
+    return 0;
+}
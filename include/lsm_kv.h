@@ -1,23 +1,156 @@
 #pragma once
+#include <functional>
+#include <future>
 #include <memory>
 #include <string>
+#include <vector>
 #include "src/util/status.h"
 #include "src/util/slice.h"
 #include "src/util/options.h"
+#include "src/util/perf_context.h"
+#include "write_batch.h"
 
 namespace lsmkv {
 
+// Ordered scan over a consistent view of the DB taken at creation. key() and
+// value() stay valid until the iterator moves. Destroy iterators before the DB.
+class Iterator {
+public:
+    virtual ~Iterator() = default;
+    virtual bool Valid() const = 0;
+    virtual void SeekToFirst() = 0;
+    virtual void Seek(const Slice& target) = 0; // first key >= target
+    virtual void Next() = 0;
+    virtual Slice key() const = 0;
+    virtual Slice value() const = 0;
+    virtual Status status() const = 0;
+};
+
+// Receives the result of DB::GetAsync; value is only meaningful when s.ok().
+using GetCallback = std::function<void(const Status& s, std::string&& value)>;
+
+inline const std::string kDefaultColumnFamilyName = "default";
+
+// A named keyspace with its own memtables, tables and tuning options. All
+// families of a DB share its WAL, block cache and background threads. Handles
+// belong to the DB and stay valid until it is destroyed.
+class ColumnFamilyHandle {
+public:
+    virtual ~ColumnFamilyHandle() = default;
+    virtual const std::string& GetName() const = 0;
+    virtual uint32_t GetID() const = 0;
+};
+
+struct ColumnFamilyDescriptor {
+    std::string name;
+    Options options;
+};
+
+// Methods without a ColumnFamilyHandle act on the default column family.
 class DB {
 public:
     virtual ~DB() = default;
 
     static Status Open(const Options& options, const std::string& dbname, std::unique_ptr<DB>* dbptr);
+    // Opens the listed column families, creating missing ones when
+    // options.create_if_missing, and returns their handles in the same order.
+    // Families that exist but are not listed are opened with options, which
+    // also supplies the settings all families share (see Options).
+    static Status Open(const Options& options, const std::string& dbname,
+                       const std::vector<ColumnFamilyDescriptor>& column_families,
+                       std::vector<ColumnFamilyHandle*>* handles, std::unique_ptr<DB>* dbptr);
+
+    virtual Status CreateColumnFamily(const Options& options, const std::string& name, ColumnFamilyHandle** handle) = 0;
+    // Writes and flushes to the family fail from then on; reads through the
+    // handle still see its last state. Its files are removed when the DB closes.
+    virtual Status DropColumnFamily(ColumnFamilyHandle* column_family) = 0;
+    virtual ColumnFamilyHandle* DefaultColumnFamily() const = 0;
 
-    virtual Status Put(const WriteOptions& options, const Slice& key, const Slice& value) = 0;
-    virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
-    virtual Status Get(const ReadOptions& options, const Slice& key, std::string* value) = 0;
+    // Applies every update in the batch, across column families, as one WAL
+    // record: after a crash either all of them are recovered or none.
+    virtual Status Write(const WriteOptions& options, WriteBatch* updates) = 0;
+    virtual Status Put(const WriteOptions& options, ColumnFamilyHandle* column_family, const Slice& key, const Slice& value) = 0;
+    virtual Status Delete(const WriteOptions& options, ColumnFamilyHandle* column_family, const Slice& key) = 0;
+    virtual Status Get(const ReadOptions& options, ColumnFamilyHandle* column_family, const Slice& key, std::string* value) = 0;
+    Status Put(const WriteOptions& options, const Slice& key, const Slice& value) {
+        return Put(options, DefaultColumnFamily(), key, value);
+    }
+    Status Delete(const WriteOptions& options, const Slice& key) { return Delete(options, DefaultColumnFamily(), key); }
+    Status Get(const ReadOptions& options, const Slice& key, std::string* value) {
+        return Get(options, DefaultColumnFamily(), key, value);
+    }
+    // Looks up many keys against one view of the DB. Block reads that miss the
+    // cache are issued together, so the batch waits on the device about once
+    // per level instead of once per key. Returns one status per key.
+    virtual std::vector<Status> MultiGet(const ReadOptions& options, ColumnFamilyHandle* column_family,
+                                         const std::vector<Slice>& keys, std::vector<std::string>* values) = 0;
+    std::vector<Status> MultiGet(const ReadOptions& options, const std::vector<Slice>& keys, std::vector<std::string>* values) {
+        return MultiGet(options, DefaultColumnFamily(), keys, values);
+    }
+    // Non-blocking Get. Memtable hits and cached blocks of open tables are
+    // answered inline, on the calling thread; opening a table, reading a
+    // block or a blob value is handed to the internal I/O engine and callback
+    // runs on one of its executor threads, so it should be short and must not
+    // block. key is copied. All callbacks run before the DB is destroyed.
+    virtual void GetAsync(const ReadOptions& options, ColumnFamilyHandle* column_family, const Slice& key, GetCallback callback) = 0;
+    void GetAsync(const ReadOptions& options, const Slice& key, GetCallback callback) {
+        GetAsync(options, DefaultColumnFamily(), key, std::move(callback));
+    }
+    // Future-returning variant; *value must stay valid until the future is ready.
+    std::future<Status> GetAsync(const ReadOptions& options, ColumnFamilyHandle* column_family, const Slice& key, std::string* value) {
+        auto done = std::make_shared<std::promise<Status>>();
+        std::future<Status> f = done->get_future();
+        GetAsync(options, column_family, key, [done, value](const Status& s, std::string&& v) {
+            if (s.ok()) *value = std::move(v);
+            done->set_value(s);
+        });
+        return f;
+    }
+    std::future<Status> GetAsync(const ReadOptions& options, const Slice& key, std::string* value) {
+        return GetAsync(options, DefaultColumnFamily(), key, value);
+    }
+    virtual std::unique_ptr<Iterator> NewIterator(const ReadOptions& options, ColumnFamilyHandle* column_family) = 0;
+    std::unique_ptr<Iterator> NewIterator(const ReadOptions& options) { return NewIterator(options, DefaultColumnFamily()); }
+    // Adds SST files built with SstFileWriter without rewriting them. Their
+    // contents are treated as newer than everything already in the DB.
+    virtual Status IngestExternalFile(ColumnFamilyHandle* column_family, const std::vector<std::string>& files,
+                                      const IngestExternalFileOptions& options) = 0;
+    Status IngestExternalFile(const std::vector<std::string>& files, const IngestExternalFileOptions& options) {
+        return IngestExternalFile(DefaultColumnFamily(), files, options);
+    }
+    // Schedules whatever compactions are due, in every column family.
     virtual Status CompactRange(const Slice& begin, const Slice& end) = 0;
-    virtual Status Flush() = 0;
+    // Switches to a new memtable and flushes the old one in the background,
+    // after waiting for an earlier flush of the family still in progress.
+    virtual Status Flush(ColumnFamilyHandle* column_family) = 0;
+    Status Flush() { return Flush(DefaultColumnFamily()); }
+
+    // Introspection. False if the property is unknown. Properties:
+    //   lsmkv.num-files-at-level<N>, lsmkv.bytes-at-level<N>    current shape
+    //   lsmkv.bytes-read-at-level<N>, lsmkv.bytes-written-at-level<N>
+    //                                 cumulative flush/compaction I/O with level N as output
+    //   lsmkv.levelstats              files, size and score per level
+    //   lsmkv.stats                   levelstats plus cumulative compaction stats
+    //                                 and read/write amplification per level
+    //   lsmkv.estimate-pending-compaction-bytes, lsmkv.compaction-pending
+    //   lsmkv.num-running-compactions
+    //   lsmkv.cur-size-active-mem-table, lsmkv.cur-size-all-mem-tables
+    //   lsmkv.num-entries-active-mem-table, lsmkv.num-entries-imm-mem-tables
+    //   lsmkv.num-immutable-mem-table
+    //   lsmkv.block-cache-usage, lsmkv.block-cache-capacity, lsmkv.table-cache-size
+    //   lsmkv.estimate-num-keys       entries minus twice the deletions: a
+    //                                 deletion is an entry itself and usually
+    //                                 hides one in an older file. Overwrites
+    //                                 across files count more than once
+    //   lsmkv.total-sst-files-size, lsmkv.num-live-files
+    //   lsmkv.num-blob-files, lsmkv.total-blob-file-size
+    //   lsmkv.live-blob-file-garbage-size  value bytes in blob files nothing references
+    // GetIntProperty accepts the numeric ones. Cache and compaction thread
+    // properties are shared by all column families, the rest are per family.
+    virtual bool GetProperty(ColumnFamilyHandle* column_family, const Slice& property, std::string* value) = 0;
+    virtual bool GetIntProperty(ColumnFamilyHandle* column_family, const Slice& property, uint64_t* value) = 0;
+    bool GetProperty(const Slice& property, std::string* value) { return GetProperty(DefaultColumnFamily(), property, value); }
+    bool GetIntProperty(const Slice& property, uint64_t* value) { return GetIntProperty(DefaultColumnFamily(), property, value); }
 };
 
 } // namespace lsmkv
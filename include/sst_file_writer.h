@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdio>
+#include <memory>
+#include <string>
+#include "lsm_kv.h"
+#include "src/sstable/sstable_builder.h"
+
+namespace lsmkv {
+
+struct ExternalSstFileInfo {
+    std::string file_path;
+    std::string smallest_key;
+    std::string largest_key;
+    uint64_t file_size = 0;
+    uint64_t num_entries = 0;
+};
+
+// Builds an SST file offline for DB::IngestExternalFile. Keys must be added
+// in strictly increasing order of options.comparator (the target family's);
+// block size and bloom bits come from options so the file reads like one the
+// DB wrote itself.
+class SstFileWriter {
+public:
+    explicit SstFileWriter(const Options& options) : options_(options) {}
+
+    Status Open(const std::string& file_path) {
+        // Never truncate in place: an earlier file at this path may be hard-linked into a DB.
+        std::remove(file_path.c_str());
+        builder_.reset(new SSTableBuilder(file_path, options_.block_size, options_.bloom_bits_per_key));
+        builder_->SetRateLimiter(options_.rate_limiter.get(), RateLimiter::kLow);
+        path_ = file_path;
+        last_key_.clear();
+        return builder_->Open();
+    }
+
+    Status Put(const Slice& key, const Slice& value) { return Add(key, kTypeValue, value); }
+    Status Delete(const Slice& key) { return Add(key, kTypeDeletion, Slice("")); }
+
+    Status Finish(ExternalSstFileInfo* info = nullptr) {
+        if (!builder_) return Status::InvalidArgument("SstFileWriter not open");
+        if (builder_->NumEntries() == 0) return Status::InvalidArgument("cannot create an empty sst file");
+        SSTableMeta meta;
+        size_t n = builder_->NumEntries();
+        Status s = builder_->Finish(&meta);
+        builder_.reset();
+        if (!s.ok()) return s;
+        if (info) {
+            info->file_path = path_;
+            info->smallest_key = meta.smallest_key;
+            info->largest_key = meta.largest_key;
+            info->file_size = meta.file_size;
+            info->num_entries = n;
+        }
+        return Status::OK();
+    }
+
+    uint64_t FileSize() const { return builder_ ? builder_->FileSize() : 0; }
+
+private:
+    Status Add(const Slice& key, ValueType type, const Slice& value) {
+        if (!builder_) return Status::InvalidArgument("SstFileWriter not open");
+        if (builder_->NumEntries() > 0 && options_.comparator->Compare(key, Slice(last_key_)) <= 0) {
+            return Status::InvalidArgument("keys must be added in strictly increasing order of options.comparator");
+        }
+        last_key_.assign(key.data(), key.size());
+        return builder_->Add(key, type, value);
+    }
+
+    Options options_;
+    std::unique_ptr<SSTableBuilder> builder_;
+    std::string path_;
+    std::string last_key_;
+};
+
+} // namespace lsmkv
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "src/util/slice.h"
+#include "src/util/status.h"
+
+namespace lsmkv {
+
+class ColumnFamilyHandle;
+
+// Updates applied atomically by DB::Write, possibly across column families.
+// Encoded as [count fixed32] then per entry [type u8][column family varint32]
+// [key length-prefixed][value length-prefixed, puts only]; this is also what
+// the WAL stores for the batch.
+class WriteBatch {
+public:
+    WriteBatch() { Clear(); }
+
+    // Without a column family the update goes to the default one.
+    void Put(const Slice& key, const Slice& value) { Put(nullptr, key, value); }
+    void Put(ColumnFamilyHandle* column_family, const Slice& key, const Slice& value);
+    void Delete(const Slice& key) { Delete(nullptr, key); }
+    void Delete(ColumnFamilyHandle* column_family, const Slice& key);
+    void Clear();
+
+    uint32_t Count() const;
+    size_t ApproximateSize() const { return rep_.size(); }
+
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+        virtual void Put(uint32_t column_family, const Slice& key, const Slice& value) = 0;
+        virtual void Delete(uint32_t column_family, const Slice& key) = 0;
+    };
+    // Calls handler for every entry in the order they were added.
+    Status Iterate(Handler* handler) const;
+
+    const std::string& Data() const { return rep_; }
+    // Replaces the contents with an encoded batch, e.g. one read back from the WAL.
+    Status SetData(const Slice& data);
+
+private:
+    std::string rep_;
+};
+
+} // namespace lsmkv
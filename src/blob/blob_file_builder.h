@@ -0,0 +1,115 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "../util/coding.h"
+#include "../util/file_writer.h"
+#include "../util/rate_limiter.h"
+#include "../util/slice.h"
+#include "../util/status.h"
+#include "../db/version_edit.h"
+#include "blob_format.h"
+
+namespace lsmkv {
+
+// Moves large values of a flush or compaction into blob files, cutting a new
+// file once the current one reaches target_file_size. Values smaller than
+// min_blob_size stay inline. Files are fsynced by Finish, before the caller
+// records them (and the tables pointing into them) in the MANIFEST.
+class BlobFileBuilder {
+public:
+    using FileNumberFn = std::function<uint64_t()>;
+
+    BlobFileBuilder(std::string dir, FileNumberFn next_file_number, uint64_t min_blob_size, uint64_t target_file_size)
+        : dir_(std::move(dir)), next_file_number_(std::move(next_file_number)),
+          min_blob_size_(min_blob_size), target_file_size_(target_file_size) {}
+    ~BlobFileBuilder() { if (file_) file_->Close(false); }
+
+    void SetRateLimiter(RateLimiter* rl, RateLimiter::Priority pri) { rate_limiter_ = rl; io_priority_ = pri; }
+    void SetDirectIO(bool on) { use_direct_io_ = on; }
+
+    // Appends value to the current blob file and sets *blob_index to its
+    // encoded BlobIndex, or leaves *blob_index empty for a value kept inline.
+    Status Add(const Slice& key, const Slice& value, std::string* blob_index) {
+        blob_index->clear();
+        if (value.size() < min_blob_size_) return Status::OK();
+        if (!file_) {
+            Status s = OpenFile();
+            if (!s.ok()) return s;
+        }
+        header_.clear();
+        PutVarint32(header_, (uint32_t)key.size());
+        PutVarint32(header_, (uint32_t)value.size());
+        const uint64_t record = header_.size() + key.size() + value.size();
+        if (rate_limiter_) rate_limiter_->Request((int64_t)record, io_priority_);
+        Status s = file_->Append(Slice(header_));
+        if (s.ok()) s = file_->Append(key);
+        BlobIndex idx;
+        idx.file_number = current_.number;
+        idx.offset = offset_ + header_.size() + key.size();
+        idx.size = value.size();
+        if (s.ok()) s = file_->Append(value);
+        if (!s.ok()) return s;
+        offset_ += record;
+        ++current_.total_count;
+        current_.total_bytes += value.size();
+        idx.EncodeTo(blob_index);
+        if (offset_ >= target_file_size_) return CloseFile();
+        return Status::OK();
+    }
+
+    Status Finish() { return file_ ? CloseFile() : Status::OK(); }
+
+    // Deletes every file this builder created, finished or not.
+    void Abandon() {
+        if (file_) { file_->Close(false); file_.reset(); }
+        for (const auto& p : paths_) { std::error_code ec; std::filesystem::remove(p, ec); }
+        files_.clear();
+    }
+
+    const std::vector<BlobFile>& files() const { return files_; }
+    const std::vector<std::string>& paths() const { return paths_; }
+
+private:
+    Status OpenFile() {
+        current_ = BlobFile{};
+        current_.number = next_file_number_();
+        current_.path = BlobFileName(dir_, current_.number);
+        paths_.push_back(current_.path);
+        file_.reset(new BufferedFileWriter());
+        Status s = file_->Open(current_.path, use_direct_io_);
+        if (!s.ok()) { file_.reset(); return s; }
+        std::string header;
+        PutFixed64(header, kBlobFileMagic);
+        offset_ = header.size();
+        return file_->Append(Slice(header));
+    }
+
+    Status CloseFile() {
+        Status s = file_->Close(true);
+        file_.reset();
+        if (!s.ok()) return s;
+        current_.size = offset_;
+        files_.push_back(current_);
+        return Status::OK();
+    }
+
+    std::string dir_;
+    FileNumberFn next_file_number_;
+    uint64_t min_blob_size_;
+    uint64_t target_file_size_;
+    RateLimiter* rate_limiter_ = nullptr;
+    RateLimiter::Priority io_priority_ = RateLimiter::kLow;
+    bool use_direct_io_ = false;
+
+    std::unique_ptr<BufferedFileWriter> file_;
+    BlobFile current_;
+    uint64_t offset_ = 0;
+    std::string header_;
+    std::vector<BlobFile> files_;     // finished files
+    std::vector<std::string> paths_;  // every file created
+};
+
+} // namespace lsmkv
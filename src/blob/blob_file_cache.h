@@ -0,0 +1,62 @@
+#pragma once
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "blob_file_reader.h"
+
+namespace lsmkv {
+
+// LRU cache of open BlobFileReaders keyed by file number, like SSTableCache
+// for tables. Handles are refcounted, so an evicted reader stays usable.
+class BlobFileCache {
+public:
+    using Handle = std::shared_ptr<BlobFileReader>;
+
+    BlobFileCache(std::string dir, size_t max_open) : dir_(std::move(dir)), max_open_(max_open) {}
+
+    Status Get(uint64_t number, Handle* out) {
+        {
+            std::lock_guard<std::mutex> lg(mu_);
+            auto it = map_.find(number);
+            if (it != map_.end()) {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                *out = it->second->reader;
+                return Status::OK();
+            }
+        }
+        // Opening is one open() and a header read; racing misses just open twice.
+        Handle r;
+        Status s = BlobFileReader::Open(BlobFileName(dir_, number), &r);
+        if (!s.ok()) return s;
+        std::lock_guard<std::mutex> lg(mu_);
+        if (map_.find(number) == map_.end()) {
+            lru_.push_front(Node{number, r});
+            map_[number] = lru_.begin();
+            while (map_.size() > max_open_ && !lru_.empty()) {
+                map_.erase(lru_.back().number);
+                lru_.pop_back();
+            }
+        }
+        *out = r;
+        return Status::OK();
+    }
+
+    void Erase(uint64_t number) {
+        std::lock_guard<std::mutex> lg(mu_);
+        auto it = map_.find(number);
+        if (it != map_.end()) { lru_.erase(it->second); map_.erase(it); }
+    }
+
+private:
+    struct Node { uint64_t number; Handle reader; };
+
+    std::string dir_;
+    size_t max_open_;
+    std::mutex mu_;
+    std::list<Node> lru_;
+    std::unordered_map<uint64_t, std::list<Node>::iterator> map_;
+};
+
+} // namespace lsmkv
@@ -0,0 +1,70 @@
+#include "blob_file_reader.h"
+#include <cerrno>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace lsmkv {
+
+Status BlobFileReader::Open(const std::string& path, std::shared_ptr<BlobFileReader>* out) {
+    std::shared_ptr<BlobFileReader> r(new BlobFileReader());
+    r->path_ = path;
+#if defined(_WIN32)
+    r->fd_ = _open(path.c_str(), _O_RDONLY | _O_BINARY);
+    if (r->fd_ < 0) return Status::IOError("open blob file failed: " + path);
+    r->file_size_ = (uint64_t)_lseeki64(r->fd_, 0, SEEK_END);
+#else
+    r->fd_ = ::open(path.c_str(), O_RDONLY);
+    if (r->fd_ < 0) return Status::IOError("open blob file failed: " + path);
+    struct stat st;
+    if (::fstat(r->fd_, &st) != 0) return Status::IOError("stat blob file failed: " + path);
+    r->file_size_ = (uint64_t)st.st_size;
+#endif
+    if (r->file_size_ < kBlobFileHeaderSize) return Status::Corruption("blob file too small: " + path);
+    std::string header;
+    Status s = r->Get(BlobIndex{0, 0, kBlobFileHeaderSize}, &header);
+    if (!s.ok()) return s;
+    if (DecodeFixed64(header.data()) != kBlobFileMagic) return Status::Corruption("bad blob file magic: " + path);
+    *out = std::move(r);
+    return Status::OK();
+}
+
+BlobFileReader::~BlobFileReader() {
+    if (fd_ < 0) return;
+#if defined(_WIN32)
+    _close(fd_);
+#else
+    ::close(fd_);
+#endif
+}
+
+Status BlobFileReader::Get(const BlobIndex& idx, std::string* value) const {
+    if (idx.offset > file_size_ || idx.size > file_size_ - idx.offset) return Status::Corruption("blob index past end of " + path_);
+    value->resize(idx.size);
+    size_t done = 0;
+#if defined(_WIN32)
+    std::lock_guard<std::mutex> lg(io_mu_);
+    if (_lseeki64(fd_, (long long)idx.offset, SEEK_SET) < 0) return Status::IOError("seek failed: " + path_);
+    while (done < idx.size) {
+        int r = _read(fd_, &(*value)[done], (unsigned)(idx.size - done));
+        if (r <= 0) return Status::IOError("short read: " + path_);
+        done += (size_t)r;
+    }
+#else
+    while (done < idx.size) {
+        ssize_t r = ::pread(fd_, &(*value)[done], idx.size - done, (off_t)(idx.offset + done));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return Status::IOError("short read: " + path_);
+        done += (size_t)r;
+    }
+#endif
+    return Status::OK();
+}
+
+} // namespace lsmkv
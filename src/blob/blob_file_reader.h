@@ -0,0 +1,35 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include "../util/status.h"
+#include "blob_format.h"
+
+namespace lsmkv {
+
+// Reads values out of one finished blob file. Safe to share between threads.
+class BlobFileReader {
+public:
+    static Status Open(const std::string& path, std::shared_ptr<BlobFileReader>* out);
+    ~BlobFileReader();
+
+    BlobFileReader(const BlobFileReader&) = delete;
+    BlobFileReader& operator=(const BlobFileReader&) = delete;
+
+    // Reads the value idx points at into *value.
+    Status Get(const BlobIndex& idx, std::string* value) const;
+
+    uint64_t file_size() const { return file_size_; }
+
+private:
+    BlobFileReader() = default;
+
+    std::string path_;
+    int fd_ = -1;
+    uint64_t file_size_ = 0;
+#if defined(_WIN32)
+    mutable std::mutex io_mu_; // _lseeki64 + _read share the file position
+#endif
+};
+
+} // namespace lsmkv
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "../util/coding.h"
+#include "../util/slice.h"
+#include "../util/status.h"
+
+namespace lsmkv {
+
+// Blob file: [magic u64] then records [klen varint][vlen varint][key][value]
+// appended in key order. The key is only kept for inspection and recovery
+// tools; reads go straight to the value through a BlobIndex. A blob file is
+// never modified after it is finished and is deleted once compactions have
+// dropped or relocated every reference to it.
+static const uint64_t kBlobFileMagic = 0x626c6f6266696c65ull; // "blobfile"
+static const size_t kBlobFileHeaderSize = 8;
+
+inline std::string BlobFileName(const std::string& dir, uint64_t number) {
+    return dir + "/" + std::to_string(number) + ".blob";
+}
+
+// What a table stores instead of a large value (type kTypeBlobIndex).
+struct BlobIndex {
+    uint64_t file_number = 0;
+    uint64_t offset = 0; // of the value inside the blob file
+    uint64_t size = 0;
+
+    void EncodeTo(std::string* dst) const {
+        PutVarint64(*dst, file_number);
+        PutVarint64(*dst, offset);
+        PutVarint64(*dst, size);
+    }
+
+    Status DecodeFrom(const Slice& src) {
+        const char* p = src.data();
+        const char* limit = src.data() + src.size();
+        p = GetVarint64Ptr(p, limit, &file_number);
+        if (p) p = GetVarint64Ptr(p, limit, &offset);
+        if (p) p = GetVarint64Ptr(p, limit, &size);
+        if (!p || p != limit) return Status::Corruption("bad blob index");
+        return Status::OK();
+    }
+};
+
+} // namespace lsmkv
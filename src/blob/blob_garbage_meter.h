@@ -0,0 +1,75 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include "../util/iterator.h"
+#include "blob_format.h"
+
+namespace lsmkv {
+
+// Counts, per blob file, the references a compaction consumed from its inputs
+// (inflow) and wrote to its outputs (outflow). The difference is the garbage
+// the compaction created: blobs whose last reference was overwritten, deleted
+// or relocated to a newer blob file.
+class BlobGarbageMeter {
+public:
+    struct Flow { uint64_t count = 0, bytes = 0; };
+
+    void AddInflow(const Slice& blob_index) { Add(blob_index, &in_); }
+    void AddOutflow(const Slice& blob_index) { Add(blob_index, &out_); }
+
+    void Merge(const BlobGarbageMeter& other) {
+        for (const auto& kv : other.in_) { in_[kv.first].count += kv.second.count; in_[kv.first].bytes += kv.second.bytes; }
+        for (const auto& kv : other.out_) { out_[kv.first].count += kv.second.count; out_[kv.first].bytes += kv.second.bytes; }
+    }
+
+    // Garbage per input blob file; files that lost nothing are left out.
+    std::map<uint64_t, Flow> Garbage() const {
+        std::map<uint64_t, Flow> out;
+        for (const auto& kv : in_) {
+            auto it = out_.find(kv.first);
+            Flow f = kv.second;
+            if (it != out_.end()) { f.count -= std::min(f.count, it->second.count); f.bytes -= std::min(f.bytes, it->second.bytes); }
+            if (f.count) out[kv.first] = f;
+        }
+        return out;
+    }
+
+private:
+    static void Add(const Slice& blob_index, std::map<uint64_t, Flow>* flows) {
+        BlobIndex idx;
+        if (!idx.DecodeFrom(blob_index).ok()) return; // the read path reports corrupt indexes
+        Flow& f = (*flows)[idx.file_number];
+        ++f.count;
+        f.bytes += idx.size;
+    }
+
+    std::map<uint64_t, Flow> in_, out_;
+};
+
+// Passes a compaction input through, counting each blob reference as inflow
+// when the merge moves past it, so entries the merge skips as older
+// duplicates count too, and entries beyond a subcompaction's range do not.
+class BlobCountingIterator final : public InternalIterator {
+public:
+    BlobCountingIterator(std::unique_ptr<InternalIterator> it, BlobGarbageMeter* meter) : it_(std::move(it)), meter_(meter) {}
+
+    bool Valid() const override { return it_->Valid(); }
+    void SeekToFirst() override { it_->SeekToFirst(); }
+    void Seek(const Slice& target) override { it_->Seek(target); }
+    void Next() override {
+        if (it_->type() == kTypeBlobIndex) meter_->AddInflow(it_->value());
+        it_->Next();
+    }
+    Slice key() const override { return it_->key(); }
+    Slice value() const override { return it_->value(); }
+    ValueType type() const override { return it_->type(); }
+    Status status() const override { return it_->status(); }
+
+private:
+    std::unique_ptr<InternalIterator> it_;
+    BlobGarbageMeter* meter_;
+};
+
+} // namespace lsmkv
@@ -4,49 +4,134 @@
 #include <condition_variable>
 #include <queue>
 #include <functional>
+#include <algorithm>
+#include <chrono>
+#include <vector>
 #include "../util/status.h"
+#include "../util/slice.h"
+#include "../util/comparator.h"
+#include "../db/version_edit.h"
 
 namespace lsmkv {
 
+// One unit of compaction. Leveled: inputs[0] from `level` merged with the
+// overlapping inputs[1] from level+1, written as one or more level+1 files.
+// Universal: inputs[0] holds every file of a window of adjacent sorted runs.
+struct Compaction {
+    int level = 0;
+    int output_level = 1;
+    std::vector<TableFile> inputs[2];
+    std::vector<TableFile> grandparents; // level+2 files overlapping the inputs
+    std::string smallest, largest;       // key range of all inputs
+    uint64_t max_output_file_size = 0;
+    uint64_t max_grandparent_overlap_bytes = 0;
+    bool bottommost = false; // nothing below level+1 overlaps, so deletions can be dropped
+    bool deletion_only = false; // FIFO: inputs are dropped, nothing is written
+    bool trivial_move = false;  // the single input file is relinked to output_level, nothing is rewritten
+    std::string compact_pointer; // largest input key; the next pick at `level` starts after it
+    uint64_t output_number = 0;  // preassigned number of the single output (universal into L0)
+    UserKeyComparator cmp;       // the family's key order
+
+    // Where one output stream stands against the grandparents. Subcompactions
+    // each keep their own.
+    struct OutputState {
+        size_t grandparent_index = 0;
+        bool seen_key = false;
+        uint64_t overlapped_bytes = 0;
+    };
+
+    // True when the current output should be closed before key so that it
+    // does not overlap too many grandparent bytes (which would make the next
+    // compaction of that output expensive).
+    bool ShouldStopBefore(const Slice& key, OutputState* st) const {
+        while (st->grandparent_index < grandparents.size() &&
+               cmp(key, grandparents[st->grandparent_index].largest) > 0) {
+            if (st->seen_key) st->overlapped_bytes += grandparents[st->grandparent_index].size;
+            ++st->grandparent_index;
+        }
+        st->seen_key = true;
+        if (st->overlapped_bytes > max_grandparent_overlap_bytes) { st->overlapped_bytes = 0; return true; }
+        return false;
+    }
+};
+
+// Background thread pool with two lanes: flushes run on their own threads so
+// a long compaction never delays the flush that frees the next memtable.
+// A failed task's Status is handed to the error handler. An optional timer
+// thread runs a periodic check for work that falls due without any write.
 class CompactionManager {
 public:
     enum TaskType { kFlush, kCompact };
     struct Task { TaskType type; std::function<Status()> run; };
+    using ErrorHandler = std::function<void(TaskType, const Status&)>;
+
+    CompactionManager(int flush_threads, int compaction_threads, ErrorHandler on_error = nullptr)
+        : on_error_(std::move(on_error)) {
+        for (int i=0; i<std::max(1, flush_threads); ++i) workers_.emplace_back([this]{ Run(kFlush); });
+        for (int i=0; i<std::max(1, compaction_threads); ++i) workers_.emplace_back([this]{ Run(kCompact); });
+    }
+    ~CompactionManager() { Shutdown(); }
 
-    CompactionManager() : stop_(false) { worker_ = std::thread([this]{ this->Run(); }); }
-    ~CompactionManager() {
+    // Runs queued flushes, drops queued compactions and joins the workers.
+    // Safe to call more than once.
+    void Shutdown() {
         {
             std::lock_guard<std::mutex> lg(mu_);
             stop_ = true;
             cv_.notify_all();
         }
-        if (worker_.joinable()) worker_.join();
+        for (auto& w : workers_) if (w.joinable()) w.join();
+        if (timer_.joinable()) timer_.join();
+    }
+
+    // Calls fn every period on the timer thread until Shutdown. fn should
+    // only schedule tasks. Only the first call starts the timer.
+    void SetPeriodic(std::chrono::milliseconds period, std::function<void()> fn) {
+        std::lock_guard<std::mutex> lg(mu_);
+        if (stop_ || timer_.joinable()) return;
+        timer_ = std::thread([this, period, fn]{
+            std::unique_lock<std::mutex> lk(mu_);
+            while (!cv_.wait_for(lk, period, [&]{ return stop_; })) {
+                lk.unlock();
+                fn();
+                lk.lock();
+            }
+        });
     }
 
     void Schedule(Task&& t) {
         std::lock_guard<std::mutex> lg(mu_);
-        q_.push(std::move(t));
-        cv_.notify_one();
+        if (stop_ && t.type == kCompact) return;
+        queue(t.type).push(std::move(t));
+        cv_.notify_all();
     }
 
 private:
-    void Run() {
+    std::queue<Task>& queue(TaskType type) { return type == kFlush ? flush_q_ : compact_q_; }
+
+    void Run(TaskType lane) {
         while (true) {
             Task t;
             {
                 std::unique_lock<std::mutex> lk(mu_);
-                cv_.wait(lk, [&]{ return stop_ || !q_.empty(); });
-                if (stop_ && q_.empty()) return;
-                t = std::move(q_.front()); q_.pop();
+                cv_.wait(lk, [&]{ return stop_ || !queue(lane).empty(); });
+                if (stop_ && lane == kCompact) return;
+                if (stop_ && queue(lane).empty()) return;
+                t = std::move(queue(lane).front()); queue(lane).pop();
             }
-            t.run(); // ignore status for now
+            Status s = t.run();
+            if (!s.ok() && on_error_) on_error_(t.type, s);
         }
     }
+
+    ErrorHandler on_error_;
     std::mutex mu_;
     std::condition_variable cv_;
-    std::queue<Task> q_;
-    std::thread worker_;
-    bool stop_;
+    std::queue<Task> flush_q_;
+    std::queue<Task> compact_q_;
+    std::vector<std::thread> workers_;
+    std::thread timer_;
+    bool stop_ = false;
 };
 
 } // namespace lsmkv
@@ -1,53 +1,92 @@
 #pragma once
 #include <vector>
-#include <queue>
 #include <memory>
 #include <string>
-#include "../sstable/sstable_reader.h"
-#include "../memtable/memtable.h"
+#include <utility>
+#include "../util/iterator.h"
+#include "../util/comparator.h"
 
 namespace lsmkv {
 
-struct MergeSource {
-    std::unique_ptr<SSTableReader::Iterator> it;
-    int level;
-    uint64_t file_number;
-};
-
-class KWayMerger {
+// K-way merge over sorted children ordered newest first: on equal keys the
+// child with the lower index wins and the others' entries are skipped, so
+// each key appears once with its newest value.
+//
+// A loser tree keeps the winner's child index in tree_[0] and, in each
+// internal node, the loser of the match played there. Advancing the winner
+// replays only its leaf-to-root path: log2(k) key comparisons and no
+// allocation. key()/value() are the winning child's own Slices.
+class MergingIterator final : public InternalIterator {
 public:
-    explicit KWayMerger(std::vector<MergeSource>&& srcs) : sources_(std::move(srcs)) {
-        for (size_t i=0;i<sources_.size();++i) {
-            if (sources_[i].it && sources_[i].it->Valid()) heap_.push(Node{i, sources_[i].it->key().ToString()});
-        }
+    MergingIterator(const Comparator* cmp, std::vector<std::unique_ptr<InternalIterator>>&& children)
+        : cmp_(cmp), children_(std::move(children)), tree_(children_.size()) {}
+
+    bool Valid() const override { return !children_.empty() && children_[tree_[0]]->Valid(); }
+
+    void SeekToFirst() override {
+        for (auto& c : children_) c->SeekToFirst();
+        Build();
     }
-    bool Next(std::string& key_out, MemValue& mv_out) {
-        if (heap_.empty()) return false;
-        Node top = heap_.top(); heap_.pop();
-        std::string cur = top.key;
-        size_t idx = top.source_index;
-        key_out = cur;
-        mv_out = sources_[idx].it->value();
-        // advance this source
-        sources_[idx].it->Next();
-        if (sources_[idx].it->Valid()) heap_.push(Node{idx, sources_[idx].it->key().ToString()});
-        // skip other sources with same key
-        while (!heap_.empty() && heap_.top().key == cur) {
-            size_t j = heap_.top().source_index; heap_.pop();
-            sources_[j].it->Next();
-            if (sources_[j].it->Valid()) heap_.push(Node{j, sources_[j].it->key().ToString()});
+
+    void Seek(const Slice& target) override {
+        for (auto& c : children_) c->Seek(target);
+        Build();
+    }
+
+    void Next() override {
+        // The winner's key lives in its block; keep a copy (capacity is reused) to skip older duplicates.
+        Slice k = key();
+        current_.assign(k.data(), k.size());
+        do {
+            children_[tree_[0]]->Next();
+            Replay(tree_[0]);
+        } while (Valid() && cmp_(key(), Slice(current_)) == 0);
+    }
+
+    Slice key() const override { return children_[tree_[0]]->key(); }
+    Slice value() const override { return children_[tree_[0]]->value(); }
+    ValueType type() const override { return children_[tree_[0]]->type(); }
+
+    Status status() const override {
+        for (const auto& c : children_) {
+            Status s = c->status();
+            if (!s.ok()) return s;
         }
-        return true;
+        return Status::OK();
     }
 
 private:
-    struct Node {
-        size_t source_index;
-        std::string key;
-        bool operator<(const Node& o) const { return key > o.key; }
-    };
-    std::vector<MergeSource> sources_;
-    std::priority_queue<Node> heap_;
+    // True if child a's entry comes before child b's; exhausted children lose to everyone.
+    bool Before(size_t a, size_t b) const {
+        bool va = children_[a]->Valid(), vb = children_[b]->Valid();
+        if (!va || !vb) return va || (!vb && a < b);
+        int c = cmp_(children_[a]->key(), children_[b]->key());
+        return c < 0 || (c == 0 && a < b);
+    }
+
+    // Leaves are nodes k..2k-1 (child i at k+i), internal nodes 1..k-1.
+    size_t Play(size_t node) {
+        const size_t k = children_.size();
+        if (node >= k) return node - k;
+        size_t l = Play(2 * node), r = Play(2 * node + 1);
+        if (Before(l, r)) { tree_[node] = r; return l; }
+        tree_[node] = l; return r;
+    }
+
+    void Build() { if (!children_.empty()) tree_[0] = Play(1); }
+
+    void Replay(size_t child) {
+        size_t winner = child;
+        for (size_t node = (child + children_.size()) / 2; node > 0; node /= 2) {
+            if (Before(tree_[node], winner)) std::swap(tree_[node], winner);
+        }
+        tree_[0] = winner;
+    }
+
+    UserKeyComparator cmp_;
+    std::vector<std::unique_ptr<InternalIterator>> children_;
+    std::vector<size_t> tree_;
+    std::string current_;
 };
 
 } // namespace lsmkv
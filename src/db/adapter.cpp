@@ -1,12 +1,23 @@
 #include "../../include/lsm_kv.h"
+#include "../../include/checkpoint.h"
 #include "db_impl.h"
 
 namespace lsmkv {
 Status DB::Open(const Options& options, const std::string& dbname, std::unique_ptr<DB>* dbptr) {
+    return Open(options, dbname, {}, nullptr, dbptr);
+}
+
+Status DB::Open(const Options& options, const std::string& dbname,
+                const std::vector<ColumnFamilyDescriptor>& column_families,
+                std::vector<ColumnFamilyHandle*>* handles, std::unique_ptr<DB>* dbptr) {
     std::unique_ptr<DB> db;
-    Status s = DBImpl::OpenDB(options, dbname, db);
+    Status s = DBImpl::OpenDB(options, dbname, column_families, handles, db);
     if (!s.ok()) return s;
     dbptr->reset(db.release());
     return Status::OK();
 }
+
+Status Checkpoint::Create(const std::string& dir) {
+    return static_cast<DBImpl*>(db_)->CreateCheckpoint(dir);
+}
 } // namespace lsmkv
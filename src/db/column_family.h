@@ -0,0 +1,149 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <filesystem>
+#include "../../include/lsm_kv.h"
+#include "../util/options.h"
+#include "../memtable/memtable.h"
+#include "version.h"
+#include "../blob/blob_file_cache.h"
+
+namespace lsmkv {
+
+// Everything a read needs: both memtables plus the current Version. Readers
+// pin one with a single atomic load; writers publish a new one on every change.
+struct SuperVersion {
+    std::shared_ptr<MemTable> mem;
+    std::shared_ptr<MemTable> imm;
+    Version* current = nullptr;
+    std::atomic<int> refs{0};
+
+    ~SuperVersion() { if (current) current->Unref(); }
+    void Ref() { refs.fetch_add(1, std::memory_order_relaxed); }
+    void Unref() { if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this; }
+};
+
+// Cumulative flush/compaction work, by output level.
+struct LevelStats {
+    uint64_t micros = 0;
+    uint64_t bytes_read_input = 0;  // from the level(s) above the output level
+    uint64_t bytes_read_output = 0; // from the output level itself
+    uint64_t bytes_written = 0;
+    uint64_t bytes_moved = 0;       // trivial moves
+    uint64_t count = 0;
+};
+
+// db_options' shared settings (see Options) over a family's own.
+inline Options SanitizeColumnFamilyOptions(const Options& db_options, const Options& cf_options) {
+    Options o = cf_options;
+    o.db_path = db_options.db_path;
+    o.block_cache_capacity = db_options.block_cache_capacity;
+    o.max_open_files = db_options.max_open_files;
+    o.max_background_flushes = db_options.max_background_flushes;
+    o.max_background_compactions = db_options.max_background_compactions;
+    o.rate_limiter = db_options.rate_limiter;
+    o.use_direct_reads = db_options.use_direct_reads;
+    o.statistics = db_options.statistics;
+    o.stats_dump_period_sec = db_options.stats_dump_period_sec;
+    o.max_total_wal_size = db_options.max_total_wal_size;
+    o.create_if_missing = db_options.create_if_missing;
+    o.error_if_exists = db_options.error_if_exists;
+    return o;
+}
+
+// One column family. The default family (id 0) keeps its MANIFEST and files
+// in the DB directory, every other one in <db>/cf-<id>, so each VersionSet
+// numbers its files independently. The WAL is the DB's.
+struct ColumnFamilyData {
+    ColumnFamilyData(uint32_t id, const std::string& name, const Options& options, const std::string& path)
+        : id(id), name(name), options(options), path(path), blob_cache(path, options.max_open_files),
+          versions(path, options), level_stats(options.num_levels) {
+        std::filesystem::create_directories(path);
+    }
+    ~ColumnFamilyData() {
+        SuperVersion* sv = super_version.exchange(nullptr);
+        if (sv) sv->Unref();
+        if (dropped) { std::error_code ec; std::filesystem::remove_all(path, ec); }
+    }
+
+    static std::string DirName(uint32_t id) { return "cf-" + std::to_string(id); }
+
+    const uint32_t id;
+    const std::string name;
+    const Options options;
+    const std::string path;
+    BlobFileCache blob_cache; // before versions: blob files are evicted from it as Versions die
+    VersionSet versions;
+
+    // Guarded by DBImpl::mu_.
+    std::shared_ptr<MemTable> mem;
+    std::shared_ptr<MemTable> imm;
+    uint64_t mem_wal = 0, imm_wal = 0; // oldest WAL holding entries of mem / imm, 0 if none
+    bool dropped = false;
+
+    // Grace-period readers: AcquireSuperVersion counts itself in the slot of the
+    // current epoch; InstallSuperVersion flips the epoch and waits for the old slot
+    // to drain before dropping its reference to the replaced SuperVersion.
+    std::atomic<SuperVersion*> super_version{nullptr};
+    std::atomic<uint32_t> sv_epoch{0};
+    std::atomic<int> sv_readers[2] = {};
+
+    // Requires DBImpl::mu_ held exclusively.
+    void InstallSuperVersion() {
+        SuperVersion* sv = new SuperVersion();
+        sv->mem = mem;
+        sv->imm = imm;
+        sv->current = versions.current();
+        sv->Ref();
+        SuperVersion* old = super_version.exchange(sv);
+        uint32_t e = sv_epoch.fetch_add(1);
+        while (sv_readers[e & 1].load() != 0) std::this_thread::yield();
+        if (old) old->Unref();
+    }
+
+    SuperVersion* AcquireSuperVersion() {
+        uint32_t e;
+        while (true) {
+            e = sv_epoch.load();
+            sv_readers[e & 1].fetch_add(1);
+            if (sv_epoch.load() == e) break;
+            sv_readers[e & 1].fetch_sub(1);
+        }
+        SuperVersion* sv = super_version.load();
+        sv->Ref();
+        sv_readers[e & 1].fetch_sub(1);
+        return sv;
+    }
+
+    std::mutex level_stats_mu;
+    std::vector<LevelStats> level_stats;
+    uint64_t flush_bytes = 0; // user data written to L0 by flushes; the Sum row's W-Amp denominator
+
+    void AddLevelStats(int level, const LevelStats& s) {
+        std::lock_guard<std::mutex> lg(level_stats_mu);
+        LevelStats& t = level_stats[level];
+        t.micros += s.micros;
+        t.bytes_read_input += s.bytes_read_input;
+        t.bytes_read_output += s.bytes_read_output;
+        t.bytes_written += s.bytes_written;
+        t.bytes_moved += s.bytes_moved;
+        t.count += s.count;
+    }
+};
+
+class ColumnFamilyHandleImpl final : public ColumnFamilyHandle {
+public:
+    explicit ColumnFamilyHandleImpl(std::shared_ptr<ColumnFamilyData> cfd) : cfd_(std::move(cfd)) {}
+    const std::string& GetName() const override { return cfd_->name; }
+    uint32_t GetID() const override { return cfd_->id; }
+    const std::shared_ptr<ColumnFamilyData>& cfd() const { return cfd_; }
+
+private:
+    std::shared_ptr<ColumnFamilyData> cfd_;
+};
+
+} // namespace lsmkv
@@ -1,38 +1,233 @@
 #include "db_impl.h"
 #include <filesystem>
+#include <thread>
 #include <cassert>
+#include <set>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <fstream>
 
 namespace fs = std::filesystem;
 
 namespace lsmkv {
 
+namespace {
+
+// Applies a batch to the memtables of its column families. With check_only
+// it only verifies that every family exists.
+struct MemTableInserter : public WriteBatch::Handler {
+    MemTableInserter(const std::map<uint32_t, std::shared_ptr<ColumnFamilyData>>* families, uint64_t wal)
+        : families(families), wal(wal) {}
+
+    void Put(uint32_t cf, const Slice& key, const Slice& value) override {
+        bytes += key.size() + value.size();
+        Add(cf, key, value, kTypeValue);
+    }
+    void Delete(uint32_t cf, const Slice& key) override {
+        bytes += key.size();
+        Add(cf, key, Slice(""), kTypeDeletion);
+    }
+
+    void Add(uint32_t cf, const Slice& key, const Slice& value, ValueType type) {
+        ++count;
+        auto it = families->find(cf);
+        if (it == families->end()) {
+            if (status.ok() && !skip_missing) status = Status::InvalidArgument("unknown or dropped column family " + std::to_string(cf));
+            return;
+        }
+        if (check_only) return;
+        ColumnFamilyData* c = it->second.get();
+        if (!c->mem_wal) c->mem_wal = wal;
+        c->mem->Add(key, value, type);
+        if (std::find(touched.begin(), touched.end(), c) == touched.end()) touched.push_back(c);
+    }
+
+    const std::map<uint32_t, std::shared_ptr<ColumnFamilyData>>* families;
+    uint64_t wal;               // WAL holding the batch
+    bool check_only = false;
+    bool skip_missing = false;  // recovery: families dropped since, or already flushed past wal
+    Status status;
+    std::vector<ColumnFamilyData*> touched;
+    uint64_t count = 0, bytes = 0;
+};
+
+// Hard-links src to dst, or copies it when that fails (e.g. dst is on another file system).
+Status LinkOrCopyFile(const std::string& src, const std::string& dst) {
+    std::error_code ec;
+    fs::create_hard_link(src, dst, ec);
+    if (!ec) return Status::OK();
+    ec.clear();
+    fs::copy_file(src, dst, ec);
+    if (ec) return Status::IOError("copy " + src + ": " + ec.message());
+    return FsyncPath(dst);
+}
+
+// Copies the first n bytes of src to dst.
+Status CopyFilePrefix(const std::string& src, const std::string& dst, uint64_t n) {
+    std::ifstream in(src, std::ios::binary);
+    if (!in) return Status::IOError("open " + src + " failed");
+    {
+        std::ofstream out(dst, std::ios::binary | std::ios::trunc);
+        std::vector<char> buf(1 << 16);
+        while (n > 0 && out) {
+            size_t len = (size_t)std::min<uint64_t>(n, buf.size());
+            if (!in.read(buf.data(), len)) return Status::IOError("short read: " + src);
+            out.write(buf.data(), len);
+            n -= len;
+        }
+        out.flush();
+        if (!out.good()) return Status::IOError("write " + dst + " failed");
+    }
+    return FsyncPath(dst);
+}
+
+} // namespace
+
 DBImpl::DBImpl(const Options& opt, const std::string& dbpath)
-    : options_(opt), db_path_(dbpath), versions_(opt.num_levels),
-      block_cache_(opt.block_cache_capacity), table_cache_(opt.max_open_files) {
+    : options_(opt), db_path_(dbpath), stats_(opt.statistics.get()),
+      block_cache_(opt.block_cache_capacity, stats_), table_cache_(opt.max_open_files, opt.use_direct_reads),
+      bg_(opt.max_background_flushes, opt.max_background_compactions,
+          [this](CompactionManager::TaskType, const Status& s){ RecordBackgroundError(s); }) {
     fs::create_directories(db_path_);
 }
 
-DBImpl::~DBImpl() { shutting_down_ = true; }
+DBImpl::~DBImpl() {
+    if (dump_thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lg(dump_mu_);
+            stop_dump_ = true;
+        }
+        dump_cv_.notify_all();
+        dump_thread_.join();
+    }
+    {
+        std::unique_lock<std::mutex> lk(async_mu_);
+        async_cv_.wait(lk, [&]{ return async_gets_ == 0; });
+    }
+    shutting_down_ = true;
+    bg_.Shutdown();
+    // Families go before the table cache their obsolete files are evicted from.
+    column_families_.clear();
+    handles_.clear();
+}
+
+ColumnFamilyData* DBImpl::NewColumnFamily(uint32_t id, const std::string& name, const Options& options) {
+    std::string path = id == 0 ? db_path_ : db_path_ + "/" + ColumnFamilyData::DirName(id);
+    auto cfd = std::make_shared<ColumnFamilyData>(id, name, SanitizeColumnFamilyOptions(options_, options), path);
+    ColumnFamilyData* c = cfd.get();
+    c->versions.SetFileDeleter([this](const TableFile& f){ DeleteObsoleteFile(f); });
+    c->versions.SetBlobFileDeleter([c](const BlobFile& f){
+        c->blob_cache.Erase(f.number);
+        std::error_code ec;
+        fs::remove(f.path, ec);
+    });
+    c->mem = std::make_shared<MemTable>(c->options.comparator);
+    handles_.emplace_back(new ColumnFamilyHandleImpl(cfd));
+    column_families_[id] = std::move(cfd);
+    return c;
+}
 
-Status DBImpl::OpenDB(const Options& options, const std::string& dbname, std::unique_ptr<DB>& dbptr) {
+Status DBImpl::OpenDB(const Options& options, const std::string& dbname,
+                      const std::vector<ColumnFamilyDescriptor>& column_families,
+                      std::vector<ColumnFamilyHandle*>* handles, std::unique_ptr<DB>& dbptr) {
     std::unique_ptr<DBImpl> impl(new DBImpl(options, dbname));
-    impl->versions_.LoadFromDir(impl->db_path_);
-    impl->mem_.reset(new MemTable());
-
-    Status s = impl->RecoverWALs();
+    auto options_for = [&](const std::string& name) -> const Options& {
+        for (const auto& d : column_families) if (d.name == name) return d.options;
+        return options;
+    };
+    ColumnFamilyData* def = impl->NewColumnFamily(0, kDefaultColumnFamilyName, options_for(kDefaultColumnFamilyName));
+    impl->default_cf_ = def;
+    impl->default_handle_ = impl->handles_.back().get();
+    bool found = false;
+    Status s = def->versions.Recover(&found);
     if (!s.ok()) return s;
+    if (found && options.error_if_exists) return Status::InvalidArgument(dbname + " exists");
+    if (!found) def->versions.LoadFromDir(impl->db_path_);
+    for (const auto& cf : def->versions.ColumnFamilies()) {
+        ColumnFamilyData* cfd = impl->NewColumnFamily(cf.first, cf.second, options_for(cf.second));
+        bool cf_found = false;
+        s = cfd->versions.Recover(&cf_found);
+        if (!s.ok()) return s;
+    }
 
-    impl->wal_number_ = impl->versions_.NextFileNumber();
-    std::unique_ptr<WALWriter> w;
-    s = WALWriter::Open(impl->WALFilePath(impl->wal_number_), w);
+    std::vector<std::string> replayed;
+    s = impl->RecoverWALs(&replayed);
+    if (!s.ok()) return s;
+    {
+        std::unique_lock<std::shared_mutex> lk(impl->mu_);
+        s = impl->SwitchWAL();
+    }
     if (!s.ok()) return s;
-    impl->wal_ = std::move(w);
+
+    // Persist whatever the old WALs held before dropping them.
+    for (const auto& kv : impl->column_families_) {
+        ColumnFamilyData* cfd = kv.second.get();
+        VersionEdit edit;
+        edit.SetLogNumber(impl->wal_number_);
+        if (cfd->mem->ApproximateMemoryUsage() > 0) {
+            TableFile tf;
+            std::vector<BlobFile> blobs;
+            s = impl->WriteLevel0Table(cfd, *cfd->mem, cfd->versions.NextFileNumber(), &tf, &blobs);
+            if (!s.ok()) return s;
+            edit.AddFile(tf);
+            for (const auto& b : blobs) edit.AddBlobFile(b);
+            cfd->mem = std::make_shared<MemTable>(cfd->options.comparator);
+        }
+        cfd->mem_wal = 0;
+        s = cfd->versions.LogAndApply(edit);
+        if (!s.ok()) return s;
+    }
+    for (const auto& path : replayed) { std::error_code ec; fs::remove(path, ec); }
+    if (found) {
+        for (const auto& kv : impl->column_families_) impl->RemoveOrphanFiles(kv.second.get());
+    }
+    {
+        std::unique_lock<std::shared_mutex> lk(impl->mu_);
+        for (const auto& kv : impl->column_families_) kv.second->InstallSuperVersion();
+    }
+    if (handles) {
+        handles->clear();
+        for (const auto& d : column_families) {
+            ColumnFamilyHandle* h = nullptr;
+            for (const auto& handle : impl->handles_) {
+                if (handle->GetName() == d.name && !handle->cfd()->dropped) h = handle.get();
+            }
+            if (!h) {
+                if (!options.create_if_missing) return Status::InvalidArgument("column family not found: " + d.name);
+                s = impl->CreateColumnFamily(d.options, d.name, &h);
+                if (!s.ok()) return s;
+            }
+            handles->push_back(h);
+        }
+    }
+    // FIFO expiry is judged by the wall clock, so a DB that stops receiving
+    // writes still needs its TTLs checked: every ttl/2, and at least once a
+    // minute for families created later.
+    uint64_t ttl_check_sec = 60;
+    for (const auto& kv : impl->column_families_) {
+        const Options& o = kv.second->options;
+        if (o.compaction_style == kCompactionStyleFIFO && o.ttl > 0) ttl_check_sec = std::min(ttl_check_sec, std::max<uint64_t>(1, o.ttl / 2));
+    }
+    {
+        DBImpl* db = impl.get();
+        impl->bg_.SetPeriodic(std::chrono::seconds(ttl_check_sec), [db]{ db->MaybeScheduleCompaction(); });
+    }
+    // Recovery may have flushed the WAL or left compactions owed by the last run.
+    impl->MaybeScheduleCompaction();
+    if (options.stats_dump_period_sec > 0) {
+        DBImpl* db = impl.get();
+        impl->dump_thread_ = std::thread([db]{ db->StatsDumpLoop(); });
+    }
 
     dbptr.reset(impl.release());
     return Status::OK();
 }
 
-Status DBImpl::RecoverWALs() {
+// A record goes to its family's memtable unless the family flushed past that
+// WAL already or has been dropped. Batches are replayed whole or not at all:
+// a torn last record fails its checksum.
+Status DBImpl::RecoverWALs(std::vector<std::string>* replayed) {
     std::vector<std::pair<uint64_t, std::string>> wals;
     for (auto& p : fs::directory_iterator(db_path_)) {
         if (!p.is_regular_file()) continue;
@@ -45,181 +240,1007 @@ Status DBImpl::RecoverWALs() {
         }
     }
     std::sort(wals.begin(), wals.end(), [](auto& a, auto& b){ return a.first < b.first; });
+    std::map<uint32_t, uint64_t> log_numbers;
+    for (const auto& kv : column_families_) log_numbers[kv.first] = kv.second->versions.LogNumber();
     for (auto& [num, path] : wals) {
+        default_cf_->versions.MarkFileNumberUsed(num);
+        replayed->push_back(path);
+        std::map<uint32_t, std::shared_ptr<ColumnFamilyData>> targets;
+        for (const auto& kv : column_families_) {
+            if (num >= log_numbers[kv.first]) targets.insert(kv);
+        }
+        if (targets.empty()) continue; // already flushed into tables
+        MemTableInserter inserter(&targets, num);
+        inserter.skip_missing = true;
         std::unique_ptr<WALReader> r;
         Status s = WALReader::Open(path, r);
         if (!s.ok()) return s;
         uint8_t type; std::string key, value;
+        WriteBatch batch;
         while (r->ReadRecord(&type, key, value)) {
-            if (type == kTypeValue) mem_->Add(Slice(key), Slice(value), kTypeValue);
-            else if (type == kTypeDeletion) mem_->Add(Slice(key), Slice(""), kTypeDeletion);
+            if (type == kTypeWriteBatch) {
+                s = batch.SetData(Slice(value));
+                if (s.ok()) s = batch.Iterate(&inserter);
+                if (!s.ok()) return s;
+            } else if (type == kTypeValue) {
+                inserter.Put(0, Slice(key), Slice(value));
+            } else if (type == kTypeDeletion) {
+                inserter.Delete(0, Slice(key));
+            }
         }
         r->Close();
-        fs::remove(path);
     }
     return Status::OK();
 }
 
-Status DBImpl::Put(const WriteOptions& options, const Slice& key, const Slice& value) {
+// Drops tables and blob files the family's MANIFEST does not list (e.g.
+// half-written compaction outputs) and leftovers from an interrupted MANIFEST
+// switch. In the DB directory, also the directories of dropped families.
+void DBImpl::RemoveOrphanFiles(ColumnFamilyData* cfd) {
+    std::set<uint64_t> live = cfd->versions.LiveFileNumbers();
+    std::string manifest = "MANIFEST-" + std::to_string(cfd->versions.ManifestNumber());
+    for (auto& p : fs::directory_iterator(cfd->path)) {
+        auto filename = p.path().filename().string();
+        if (p.is_directory() && cfd == default_cf_ && filename.rfind("cf-", 0) == 0 &&
+            !column_families_.count((uint32_t)std::strtoul(filename.c_str() + 3, nullptr, 10))) {
+            std::error_code ec;
+            fs::remove_all(p.path(), ec);
+            continue;
+        }
+        if (!p.is_regular_file()) continue;
+        bool orphan = false;
+        if (filename.size() > 4 && filename.compare(filename.size() - 4, 4, ".sst") == 0) {
+            size_t dash = filename.find('-');
+            if (dash == std::string::npos) continue;
+            uint64_t number = std::strtoull(filename.c_str() + dash + 1, nullptr, 10);
+            orphan = live.count(number) == 0;
+        } else if (filename.size() > 5 && filename.compare(filename.size() - 5, 5, ".blob") == 0) {
+            orphan = live.count(std::strtoull(filename.c_str(), nullptr, 10)) == 0;
+        } else if (filename.rfind("MANIFEST-", 0) == 0) {
+            orphan = filename != manifest;
+        } else if (filename == "CURRENT.tmp" || (filename.size() > 7 && filename.compare(filename.size() - 7, 7, ".ingest") == 0)) {
+            orphan = true;
+        }
+        if (orphan) { std::error_code ec; fs::remove(p.path(), ec); }
+    }
+}
+
+Status DBImpl::CreateColumnFamily(const Options& options, const std::string& name, ColumnFamilyHandle** handle) {
     std::unique_lock<std::shared_mutex> lk(mu_);
-    if (!wal_) return Status::IOError("WAL not open");
-    Status s = wal_->AddRecord(kTypeValue, key, value, options.sync);
-    if (!s.ok()) return s;
-    mem_->Add(key, value, kTypeValue);
-    if (mem_->ApproximateMemoryUsage() >= options_.write_buffer_size) {
-        s = RotateMemTable();
+    if (!bg_error_.ok()) return bg_error_;
+    for (const auto& kv : column_families_) {
+        if (kv.second->name == name) return Status::InvalidArgument("column family exists: " + name);
+    }
+    // The family's MANIFEST is written before it is registered, so every
+    // registered family has one; a crash in between leaves an orphan directory.
+    uint32_t id = default_cf_->versions.NextColumnFamilyId();
+    ColumnFamilyData* cfd = NewColumnFamily(id, name, options);
+    VersionEdit edit;
+    edit.SetLogNumber(wal_number_);
+    Status s = cfd->versions.LogAndApply(edit);
+    if (s.ok()) {
+        VersionEdit reg;
+        reg.AddColumnFamily(id, name);
+        s = default_cf_->versions.LogAndApply(reg);
+    }
+    if (!s.ok()) {
+        cfd->dropped = true;
+        column_families_.erase(id);
+        return s;
+    }
+    cfd->InstallSuperVersion();
+    *handle = handles_.back().get();
+    return Status::OK();
+}
+
+Status DBImpl::DropColumnFamily(ColumnFamilyHandle* column_family) {
+    ColumnFamilyData* cfd = CFD(column_family);
+    if (cfd == default_cf_) return Status::InvalidArgument("cannot drop the default column family");
+    std::vector<std::string> obsolete;
+    {
+        std::unique_lock<std::shared_mutex> lk(mu_);
+        if (cfd->dropped) return Status::InvalidArgument("column family already dropped: " + cfd->name);
+        VersionEdit edit;
+        edit.DropColumnFamily(cfd->id);
+        Status s = default_cf_->versions.LogAndApply(edit);
         if (!s.ok()) return s;
+        cfd->dropped = true;
+        column_families_.erase(cfd->id);
+        obsolete = ObsoleteWALs();
     }
+    for (const auto& path : obsolete) { std::error_code ec; fs::remove(path, ec); }
     return Status::OK();
 }
 
-Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
+Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+    StopWatch sw(stats_, kDbWriteMicros);
     std::unique_lock<std::shared_mutex> lk(mu_);
+    if (!bg_error_.ok()) return bg_error_;
     if (!wal_) return Status::IOError("WAL not open");
-    Status s = wal_->AddRecord(kTypeDeletion, key, Slice(""), options.sync);
+    // Every family is checked before anything is logged, so a batch naming a
+    // dropped family changes nothing.
+    MemTableInserter inserter(&column_families_, wal_number_);
+    inserter.check_only = true;
+    Status s = updates->Iterate(&inserter);
+    if (s.ok()) s = inserter.status;
+    if (!s.ok() || updates->Count() == 0) return s;
+    s = wal_->AddRecord(kTypeWriteBatch, Slice(""), Slice(updates->Data()), options.sync);
     if (!s.ok()) return s;
-    mem_->Add(key, Slice(""), kTypeDeletion);
-    if (mem_->ApproximateMemoryUsage() >= options_.write_buffer_size) {
-        s = RotateMemTable();
+    inserter.check_only = false;
+    inserter.count = inserter.bytes = 0;
+    updates->Iterate(&inserter);
+    RecordTick(stats_, kKeysWritten, inserter.count);
+    RecordTick(stats_, kBytesWritten, inserter.bytes);
+    for (ColumnFamilyData* cfd : inserter.touched) {
+        s = MakeRoomForWrite(cfd, lk);
         if (!s.ok()) return s;
     }
-    return Status::OK();
+    return FlushOldestWALs();
+}
+
+Status DBImpl::Put(const WriteOptions& options, ColumnFamilyHandle* column_family, const Slice& key, const Slice& value) {
+    WriteBatch batch;
+    batch.Put(column_family, key, value);
+    return WriteOne(options, CFD(column_family), batch, kTypeValue, key, value);
+}
+
+Status DBImpl::Delete(const WriteOptions& options, ColumnFamilyHandle* column_family, const Slice& key) {
+    WriteBatch batch;
+    batch.Delete(column_family, key);
+    return WriteOne(options, CFD(column_family), batch, kTypeDeletion, key, Slice(""));
+}
+
+// Write for a batch holding just (type, key, value) for cfd, without decoding it again.
+Status DBImpl::WriteOne(const WriteOptions& options, ColumnFamilyData* cfd, const WriteBatch& batch,
+                        ValueType type, const Slice& key, const Slice& value) {
+    StopWatch sw(stats_, kDbWriteMicros);
+    std::unique_lock<std::shared_mutex> lk(mu_);
+    if (!bg_error_.ok()) return bg_error_;
+    if (!wal_) return Status::IOError("WAL not open");
+    if (cfd->dropped) return Status::InvalidArgument("column family dropped: " + cfd->name);
+    Status s = wal_->AddRecord(kTypeWriteBatch, Slice(""), Slice(batch.Data()), options.sync);
+    if (!s.ok()) return s;
+    RecordTick(stats_, kKeysWritten);
+    RecordTick(stats_, kBytesWritten, key.size() + value.size());
+    if (!cfd->mem_wal) cfd->mem_wal = wal_number_;
+    cfd->mem->Add(key, value, type);
+    s = MakeRoomForWrite(cfd, lk);
+    if (!s.ok()) return s;
+    return FlushOldestWALs();
 }
 
-Status DBImpl::Get(const ReadOptions& options, const Slice& key, std::string* value) {
+Status DBImpl::Get(const ReadOptions& options, ColumnFamilyHandle* column_family, const Slice& key, std::string* value) {
+    StopWatch sw(stats_, kDbGetMicros);
+    ColumnFamilyData* cfd = CFD(column_family);
+    PerfTimer snapshot_timer(&PerfContext::get_snapshot_nanos);
+    SuperVersion* sv = cfd->AcquireSuperVersion();
+    snapshot_timer.Stop();
+    MemValue mv;
+    Status result = Status::NotFound("not found");
+    bool found = false, blob = false;
     {
-        std::shared_lock<std::shared_mutex> lk(mu_);
-        MemValue mv;
-        if (mem_ && mem_->Get(key, &mv)) {
-            if (mv.type == kTypeDeletion) return Status::NotFound("deleted");
-            *value = mv.value; return Status::OK();
+        PerfTimer t(&PerfContext::get_from_memtable_nanos);
+        PerfCount(&PerfContext::get_from_memtable_count);
+        found = sv->mem->Get(key, &mv) || (sv->imm && sv->imm->Get(key, &mv));
+    }
+    if (found) {
+        if (mv.type == kTypeDeletion) result = Status::NotFound("deleted");
+        else { *value = mv.value; result = Status::OK(); }
+    } else {
+        // Time inside the table probes is broken out by SSTableReader::Get and
+        // taken back out of version_lookup_nanos.
+        const bool timing = GetPerfLevel() >= PerfLevel::kEnableTime;
+        uint64_t probe_nanos = 0;
+        PerfTimer lookup_timer(&PerfContext::version_lookup_nanos);
+        sv->current->ForEachCandidate(key, [&](const TableFile& t) {
+            // A table that cannot be opened may hold the newest version of
+            // the key, so the lookup fails rather than read older levels.
+            SSTableCache::Handle r;
+            Status s = table_cache_.Get(t.path, &r, cfd->options.comparator);
+            if (!s.ok()) { result = s; return false; }
+            std::optional<MemValue> res;
+            uint64_t start = timing ? MonotonicNanos() : 0;
+            s = r->Get(key, res, &block_cache_, options.fill_cache, stats_);
+            if (timing) probe_nanos += MonotonicNanos() - start;
+            if (!s.ok()) { result = s; return false; }
+            if (!res.has_value()) return true;
+            if (res->type == kTypeDeletion) result = Status::NotFound("deleted");
+            else { *value = std::move(res->value); blob = res->type == kTypeBlobIndex; result = Status::OK(); }
+            return false;
+        });
+        lookup_timer.Stop();
+        if (timing) GetPerfContext()->version_lookup_nanos -= probe_nanos;
+        if (blob) {
+            std::string index;
+            index.swap(*value);
+            result = GetBlob(cfd, options, Slice(index), value);
         }
-        if (imm_ && imm_->Get(key, &mv)) {
-            if (mv.type == kTypeDeletion) return Status::NotFound("deleted");
-            *value = mv.value; return Status::OK();
+    }
+    sv->Unref();
+    RecordTick(stats_, kKeysRead);
+    if (result.ok()) RecordTick(stats_, kBytesRead, value->size());
+    return result;
+}
+
+std::vector<Status> DBImpl::MultiGet(const ReadOptions& options, ColumnFamilyHandle* column_family,
+                                     const std::vector<Slice>& keys, std::vector<std::string>* values) {
+    StopWatch sw(stats_, kDbMultiGetMicros);
+    ColumnFamilyData* cfd = CFD(column_family);
+    SuperVersion* sv = cfd->AcquireSuperVersion();
+    values->assign(keys.size(), std::string());
+    std::vector<Status> result(keys.size(), Status::NotFound("not found"));
+
+    // Keys the memtables cannot answer, each with the tables to probe in Get's order.
+    struct Lookup {
+        size_t key;
+        std::vector<const TableFile*> tables;
+        size_t next = 0;
+        SSTableCache::Handle table;
+        int block = -1;
+        std::string data;
+    };
+    std::vector<Lookup> pending;
+    for (size_t i=0; i<keys.size(); ++i) {
+        MemValue mv;
+        if (sv->mem->Get(keys[i], &mv) || (sv->imm && sv->imm->Get(keys[i], &mv))) {
+            if (mv.type == kTypeDeletion) result[i] = Status::NotFound("deleted");
+            else { (*values)[i] = mv.value; result[i] = Status::OK(); }
+            continue;
         }
+        Lookup l; l.key = i;
+        sv->current->ForEachCandidate(keys[i], [&](const TableFile& t) { l.tables.push_back(&t); return true; });
+        if (!l.tables.empty()) pending.push_back(std::move(l));
     }
-    std::vector<TableFile> candidates;
-    versions_.GetCandidateFiles(key, candidates);
-    for (const auto& t : candidates) {
-        std::shared_ptr<SSTableReader> r;
-        if (!table_cache_.Get(t.path, r)) continue;
+
+    // Applies a found block to its lookup; true once the key is resolved.
+    // Values kept in blob files are read once every key is resolved.
+    std::vector<size_t> blobs;
+    auto resolve = [&](Lookup& l, const Slice& block) {
         std::optional<MemValue> res;
-        Status s = r->Get(key, res, &block_cache_, options.fill_cache);
-        if (!s.ok()) return s;
-        if (res.has_value()) {
-            if (res->type == kTypeDeletion) return Status::NotFound("deleted");
-            *value = res->value; return Status::OK();
+        l.table->SearchBlock(block, keys[l.key], res);
+        if (!res.has_value()) return false;
+        RecordTick(stats_, kBloomFilterTruePositive);
+        if (res->type == kTypeDeletion) result[l.key] = Status::NotFound("deleted");
+        else { (*values)[l.key] = std::move(res->value); result[l.key] = Status::OK(); }
+        if (res->type == kTypeBlobIndex) blobs.push_back(l.key);
+        return true;
+    };
+    // Each round moves every unresolved key to the next table that may hold
+    // it; blocks found in the cache are searched right away, the rest are
+    // read in one batch.
+    while (!pending.empty()) {
+        std::vector<Lookup*> waiting;
+        for (auto& l : pending) {
+            bool done = false;
+            l.block = -1;
+            while (!done && l.next < l.tables.size()) {
+                const TableFile* t = l.tables[l.next++];
+                Status s = table_cache_.Get(t->path, &l.table, cfd->options.comparator);
+                if (!s.ok()) { result[l.key] = s; l.next = l.tables.size(); break; }
+                int blk = l.table->BlockFor(keys[l.key], stats_);
+                if (blk < 0) continue;
+                if (block_cache_.Get(l.table->BlockCacheKey(blk), &l.data)) { done = resolve(l, Slice(l.data)); continue; }
+                l.block = blk;
+                break;
+            }
+            if (done) l.next = l.tables.size();
+            else if (l.block >= 0) waiting.push_back(&l);
+        }
+        std::vector<TableRead> reads(waiting.size());
+        for (size_t i=0; i<waiting.size(); ++i) {
+            const auto& e = waiting[i]->table->index().entries()[waiting[i]->block];
+            reads[i].table = waiting[i]->table.get();
+            reads[i].offset = e.off;
+            reads[i].n = e.sz;
+            reads[i].dst = &waiting[i]->data;
+        }
+        {
+            PerfTimer t(&PerfContext::block_read_nanos);
+            SSTableReader::ReadAll(reads.data(), reads.size());
         }
+        for (size_t i=0; i<waiting.size(); ++i) {
+            Lookup& l = *waiting[i];
+            if (!reads[i].status.ok()) { result[l.key] = reads[i].status; l.next = l.tables.size(); continue; }
+            PerfCount(&PerfContext::block_read_count);
+            PerfCount(&PerfContext::block_read_bytes, reads[i].n);
+            if (options.fill_cache) block_cache_.Put(l.table->BlockCacheKey(l.block), l.data);
+            if (resolve(l, Slice(l.data))) l.next = l.tables.size();
+        }
+        pending.erase(std::remove_if(pending.begin(), pending.end(), [](const Lookup& l) {
+            return l.next >= l.tables.size();
+        }), pending.end());
+    }
+    for (size_t i : blobs) {
+        std::string index;
+        index.swap((*values)[i]);
+        result[i] = GetBlob(cfd, options, Slice(index), &(*values)[i]);
+    }
+    sv->Unref();
+    RecordTick(stats_, kKeysRead, keys.size());
+    for (size_t i=0; i<keys.size(); ++i) {
+        if (result[i].ok()) RecordTick(stats_, kBytesRead, (*values)[i].size());
+    }
+    return result;
+}
+
+void DBImpl::GetAsync(const ReadOptions& options, ColumnFamilyHandle* column_family, const Slice& key, GetCallback callback) {
+    ColumnFamilyData* cfd = CFD(column_family);
+    SuperVersion* sv = cfd->AcquireSuperVersion();
+    MemValue mv;
+    if (sv->mem->Get(key, &mv) || (sv->imm && sv->imm->Get(key, &mv))) {
+        sv->Unref();
+        RecordTick(stats_, kKeysRead);
+        if (mv.type == kTypeDeletion) { callback(Status::NotFound("deleted"), std::string()); return; }
+        RecordTick(stats_, kBytesRead, mv.value.size());
+        callback(Status::OK(), std::move(mv.value));
+        return;
+    }
+    AsyncGet* g = new AsyncGet();
+    g->options = options;
+    g->cfd = cfd;
+    g->key = key.ToString();
+    g->callback = std::move(callback);
+    g->sv = sv;
+    sv->current->ForEachCandidate(key, [&](const TableFile& t) { g->tables.push_back(&t); return true; });
+    {
+        std::lock_guard<std::mutex> lg(async_mu_);
+        ++async_gets_;
+    }
+    ContinueGetAsync(g);
+}
+
+// Probes the remaining candidate tables, answering from the block cache
+// where possible, and stops at the first block that must be read from disk.
+// Opening a table reads its footer, index and filter, so a table that is not
+// open yet moves the lookup off the caller's thread first.
+void DBImpl::ContinueGetAsync(AsyncGet* g) {
+    Slice key(g->key);
+    while (g->next < g->tables.size()) {
+        const TableFile* t = g->tables[g->next];
+        if (!table_cache_.Lookup(t->path, &g->table)) {
+            if (g->on_caller) {
+                g->on_caller = false;
+                IOEngine::Default()->Schedule([this, g]{ ContinueGetAsync(g); });
+                return;
+            }
+            Status s = table_cache_.Get(t->path, &g->table, g->cfd->options.comparator);
+            if (!s.ok()) { FinishGetAsync(g, s, std::string()); return; }
+        }
+        ++g->next;
+        g->block = g->table->BlockFor(key, stats_);
+        if (g->block < 0) continue;
+        if (block_cache_.Get(g->table->BlockCacheKey(g->block), &g->data)) {
+            std::optional<MemValue> res;
+            g->table->SearchBlock(Slice(g->data), key, res);
+            if (!res.has_value()) continue;
+            FinishGetAsyncFound(g, std::move(*res));
+            return;
+        }
+        const auto& e = g->table->index().entries()[g->block];
+        g->read = TableRead();
+        g->read.table = g->table.get();
+        g->read.offset = e.off;
+        g->read.n = e.sz;
+        g->read.dst = &g->data;
+        SSTableReader::StartRead(&g->read, [this, g]{ OnGetAsyncBlock(g); });
+        return;
+    }
+    FinishGetAsync(g, Status::NotFound("not found"), std::string());
+}
+
+void DBImpl::OnGetAsyncBlock(AsyncGet* g) {
+    g->on_caller = false;
+    SSTableReader::FinishRead(&g->read);
+    if (!g->read.status.ok()) { FinishGetAsync(g, g->read.status, std::string()); return; }
+    if (g->options.fill_cache) block_cache_.Put(g->table->BlockCacheKey(g->block), g->data);
+    std::optional<MemValue> res;
+    g->table->SearchBlock(Slice(g->data), Slice(g->key), res);
+    if (!res.has_value()) { ContinueGetAsync(g); return; }
+    FinishGetAsyncFound(g, std::move(*res));
+}
+
+// A value kept in a blob file is read on an executor thread: the one that
+// completed the block read, or a new task if the block came from the cache.
+void DBImpl::FinishGetAsyncFound(AsyncGet* g, MemValue&& res) {
+    RecordTick(stats_, kBloomFilterTruePositive);
+    if (res.type == kTypeDeletion) { FinishGetAsync(g, Status::NotFound("deleted"), std::string()); return; }
+    if (res.type != kTypeBlobIndex) { FinishGetAsync(g, Status::OK(), std::move(res.value)); return; }
+    if (g->on_caller) {
+        g->on_caller = false;
+        IOEngine::Default()->Schedule([this, g, index = std::move(res.value)]() mutable {
+            std::string value;
+            Status s = GetBlob(g->cfd, g->options, Slice(index), &value);
+            FinishGetAsync(g, s, std::move(value));
+        });
+        return;
     }
-    return Status::NotFound("not found");
+    std::string value;
+    Status s = GetBlob(g->cfd, g->options, Slice(res.value), &value);
+    FinishGetAsync(g, s, std::move(value));
 }
 
-Status DBImpl::RotateMemTable() {
-    if (imm_) return Status::OK();
-    imm_.reset(mem_.release());
-    mem_.reset(new MemTable());
+void DBImpl::FinishGetAsync(AsyncGet* g, const Status& s, std::string&& value) {
+    RecordTick(stats_, kKeysRead);
+    if (s.ok()) RecordTick(stats_, kBytesRead, value.size());
+    g->sv->Unref();
+    g->table.reset();
+    g->callback(s, std::move(value));
+    delete g;
+    std::lock_guard<std::mutex> lg(async_mu_);
+    if (--async_gets_ == 0) async_cv_.notify_all();
+}
 
-    std::string old_wal_path;
-    if (wal_) { old_wal_path = wal_->path(); wal_->Close(); wal_.reset(); }
+std::unique_ptr<Iterator> DBImpl::NewIterator(const ReadOptions& options, ColumnFamilyHandle* column_family) {
+    ColumnFamilyData* cfd = CFD(column_family);
+    SuperVersion* sv = cfd->AcquireSuperVersion();
+    const Comparator* cmp = cfd->options.comparator;
+    std::vector<std::unique_ptr<InternalIterator>> children;
+    children.emplace_back(new MemTableIterator(cmp, sv->mem->SnapshotInOrder()));
+    if (sv->imm) children.emplace_back(new MemTableIterator(cmp, sv->imm->SnapshotInOrder()));
+    for (const auto& f : sv->current->files(0)) children.emplace_back(new LevelIterator(&table_cache_, cmp, {f}, options.readahead_size));
+    for (int l=1; l<sv->current->NumLevels(); ++l) {
+        if (!sv->current->files(l).empty()) children.emplace_back(new LevelIterator(&table_cache_, cmp, sv->current->files(l), options.readahead_size));
+    }
+    std::unique_ptr<MergingIterator> merged(new MergingIterator(cmp, std::move(children)));
+    merged->RegisterCleanup([sv]{ sv->Unref(); });
+    return std::unique_ptr<Iterator>(new DBIter(std::move(merged), [this, cfd, options](const Slice& index, std::string* value) {
+        return GetBlob(cfd, options, index, value);
+    }));
+}
 
-    wal_number_ = versions_.NextFileNumber();
+// Closes the current WAL (kept until every family flushed what it holds) and starts a new one.
+Status DBImpl::SwitchWAL() {
+    if (wal_) {
+        old_wals_.emplace_back(wal_number_, wal_->size());
+        wal_->Close();
+        wal_.reset();
+    }
+    wal_number_ = default_cf_->versions.NextFileNumber();
     std::unique_ptr<WALWriter> w;
     Status s = WALWriter::Open(WALFilePath(wal_number_), w);
     if (!s.ok()) return s;
+    w->SetStatistics(stats_);
     wal_ = std::move(w);
+    return Status::OK();
+}
+
+// Rotates cfd's memtable once it is full. While the previous one is still
+// being flushed the writer waits (lk released) instead: a slow flush stalls
+// writes rather than letting the memtable grow without bound.
+Status DBImpl::MakeRoomForWrite(ColumnFamilyData* cfd, std::unique_lock<std::shared_mutex>& lk) {
+    uint64_t start = 0;
+    Status s;
+    while (cfd->mem->ApproximateMemoryUsage() >= cfd->options.write_buffer_size && !cfd->dropped) {
+        if (!bg_error_.ok()) { s = bg_error_; break; }
+        if (!cfd->imm) { s = RotateMemTable(cfd); break; }
+        if (stats_ && !start) start = MonotonicMicros();
+        bg_cv_.wait(lk);
+    }
+    if (start) stats_->RecordTick(kStallMicros, MonotonicMicros() - start);
+    return s;
+}
 
-    auto imm_snapshot = std::make_shared<std::vector<MemTable::IterKV>>(imm_->SnapshotInOrder());
-    uint64_t file_number = versions_.NextFileNumber();
-    std::string out_path = L0FilePath(file_number);
-    size_t block_size = options_.block_size;
-    unsigned bloom_bits = options_.bloom_bits_per_key;
-    VersionSet* vset = &versions_;
-    std::string wal_to_delete = old_wal_path;
+// The new WAL only holds entries newer than the memtable being flushed, so
+// the flush records it as the family's log number.
+Status DBImpl::RotateMemTable(ColumnFamilyData* cfd) {
+    if (cfd->imm) return Status::OK();
+    Status s = SwitchWAL();
+    if (!s.ok()) return s;
+    cfd->imm = cfd->mem;
+    cfd->imm_wal = cfd->mem_wal;
+    cfd->mem = std::make_shared<MemTable>(cfd->options.comparator);
+    cfd->mem_wal = 0;
+    cfd->InstallSuperVersion();
 
+    std::shared_ptr<MemTable> imm = cfd->imm;
+    uint64_t file_number = cfd->versions.NextFileNumber();
+    uint64_t log_number = wal_number_;
     bg_.Schedule(CompactionManager::Task{
         CompactionManager::kFlush,
-        [imm_snapshot, out_path, block_size, bloom_bits, file_number, vset, wal_to_delete]() -> Status {
-            SSTableBuilder builder(out_path, block_size, bloom_bits);
-            Status s = builder.Open(); if (!s.ok()) return s;
-            SSTableMeta meta;
-            for (const auto& kv : *imm_snapshot) {
-                s = builder.Add(Slice(kv.key), kv.value); if (!s.ok()) return s;
-            }
-            s = builder.Finish(&meta); if (!s.ok()) return s;
+        [this, cfd, imm, file_number, log_number]() -> Status {
+            return FlushMemTable(cfd, imm, file_number, log_number);
+        }
+    });
+    return Status::OK();
+}
+
+// A family that writes rarely would otherwise keep its first WAL, and every
+// one after it, alive indefinitely.
+Status DBImpl::FlushOldestWALs() {
+    if (old_wals_.empty() || !wal_) return Status::OK();
+    uint64_t limit = options_.max_total_wal_size;
+    if (limit == 0) {
+        for (const auto& kv : column_families_) limit += 4 * kv.second->options.write_buffer_size;
+    }
+    uint64_t total = wal_->size();
+    for (const auto& w : old_wals_) total += w.second;
+    if (total <= limit) return Status::OK();
+    const uint64_t oldest = old_wals_.front().first;
+    for (const auto& kv : column_families_) {
+        ColumnFamilyData* cfd = kv.second.get();
+        if (cfd->mem_wal && cfd->mem_wal <= oldest && !cfd->imm) {
+            Status s = RotateMemTable(cfd);
+            if (!s.ok()) return s;
+        }
+    }
+    return Status::OK();
+}
 
-            TableFile tf; tf.level=0; tf.number=file_number; tf.path=out_path; tf.smallest=meta.smallest_key; tf.largest=meta.largest_key; tf.size=meta.file_size;
-            vset->AddFile(tf);
+// Takes the WALs older than every live family's oldest unflushed entry off
+// old_wals_ and returns their paths for deletion; none while a checkpoint runs.
+std::vector<std::string> DBImpl::ObsoleteWALs() {
+    if (file_deletions_paused_) return {};
+    uint64_t keep = wal_number_;
+    for (const auto& kv : column_families_) {
+        const ColumnFamilyData* cfd = kv.second.get();
+        if (cfd->mem_wal) keep = std::min(keep, cfd->mem_wal);
+        if (cfd->imm_wal) keep = std::min(keep, cfd->imm_wal);
+    }
+    std::vector<std::string> out;
+    auto it = old_wals_.begin();
+    for (; it != old_wals_.end() && it->first < keep; ++it) out.push_back(WALFilePath(it->first));
+    old_wals_.erase(old_wals_.begin(), it);
+    return out;
+}
 
-            if (!wal_to_delete.empty()) { std::error_code ec; fs::remove(wal_to_delete, ec); }
-            return Status::OK();
+Status DBImpl::WriteLevel0Table(ColumnFamilyData* cfd, const MemTable& mem, uint64_t file_number, TableFile* out,
+                                std::vector<BlobFile>* blob_files) {
+    const Options& opt = cfd->options;
+    std::string out_path = cfd->path + "/L0-" + std::to_string(file_number) + ".sst";
+    std::unique_ptr<BlobFileBuilder> blobs = NewBlobFileBuilder(cfd, RateLimiter::kHigh);
+    SSTableMeta meta;
+    Status s;
+    {
+        SSTableBuilder builder(out_path, opt.block_size, opt.bloom_bits_per_key);
+        builder.SetRateLimiter(opt.rate_limiter.get(), RateLimiter::kHigh);
+        builder.SetDirectIO(opt.use_direct_io_for_flush_and_compaction);
+        s = builder.Open();
+        std::string blob_index;
+        for (const auto& kv : mem.SnapshotInOrder()) {
+            if (!s.ok()) break;
+            if (blobs && kv.value.type == kTypeValue) {
+                s = blobs->Add(Slice(kv.key), Slice(kv.value.value), &blob_index); if (!s.ok()) break;
+                if (!blob_index.empty()) { s = builder.Add(Slice(kv.key), kTypeBlobIndex, Slice(blob_index)); continue; }
+            }
+            s = builder.Add(Slice(kv.key), kv.value);
         }
-    });
+        // Blob files are durable before the table pointing into them.
+        if (s.ok() && blobs) s = blobs->Finish();
+        if (s.ok()) s = builder.Finish(&meta);
+    }
+    // The builder has closed the table; nothing names these files yet.
+    if (!s.ok()) {
+        if (blobs) blobs->Abandon();
+        std::error_code ec;
+        fs::remove(out_path, ec);
+        return s;
+    }
+    if (blobs) *blob_files = blobs->files();
+    out->level=0; out->number=file_number; out->path=out_path; out->smallest=meta.smallest_key; out->largest=meta.largest_key; out->size=meta.file_size;
+    out->creation_time=meta.creation_time;
+    out->num_entries=meta.num_entries; out->num_deletions=meta.num_deletions;
+    return Status::OK();
+}
 
-    imm_.reset();
+Status DBImpl::FlushMemTable(ColumnFamilyData* cfd, const std::shared_ptr<MemTable>& imm, uint64_t file_number, uint64_t log_number) {
+    StopWatch sw(stats_, kFlushMicros);
+    const uint64_t start = MonotonicMicros();
+    TableFile tf;
+    std::vector<BlobFile> blobs;
+    Status s = WriteLevel0Table(cfd, *imm, file_number, &tf, &blobs);
+    if (!s.ok()) return s;
+    uint64_t blob_bytes = 0;
+    for (const auto& b : blobs) blob_bytes += b.size;
+    RecordTick(stats_, kFlushWriteBytes, tf.size);
+    RecordTick(stats_, kBlobBytesWritten, blob_bytes);
+    LevelStats ls;
+    ls.micros = MonotonicMicros() - start;
+    ls.bytes_written = tf.size + blob_bytes;
+    ls.count = 1;
+    cfd->AddLevelStats(0, ls);
+    {
+        std::lock_guard<std::mutex> lg(cfd->level_stats_mu);
+        cfd->flush_bytes += tf.size + blob_bytes;
+    }
+
+    VersionEdit edit;
+    edit.AddFile(tf);
+    for (const auto& b : blobs) edit.AddBlobFile(b);
+    edit.SetLogNumber(log_number);
+    s = cfd->versions.LogAndApply(edit); if (!s.ok()) return s;
+    std::vector<std::string> obsolete;
+    {
+        std::unique_lock<std::shared_mutex> lk(mu_);
+        if (cfd->imm == imm) { cfd->imm.reset(); cfd->imm_wal = 0; }
+        cfd->InstallSuperVersion();
+        bg_cv_.notify_all();
+        obsolete = ObsoleteWALs();
+    }
+
+    for (const auto& path : obsolete) { std::error_code ec; fs::remove(path, ec); }
+    if (cfd->options.preload_new_tables) table_cache_.Preload(tf.path, cfd->options.comparator);
     MaybeScheduleCompaction();
     return Status::OK();
 }
 
 void DBImpl::MaybeScheduleCompaction() {
-    auto lvl = versions_.PickCompactionLevel();
-    if (!lvl.has_value()) return;
-    int level = *lvl;
-    VersionSet* vset = &versions_;
-    size_t block_size = options_.block_size;
-    unsigned bloom_bits = options_.bloom_bits_per_key;
-    std::string dbp = db_path_;
+    std::vector<std::shared_ptr<ColumnFamilyData>> families;
+    {
+        std::shared_lock<std::shared_mutex> lk(mu_);
+        for (const auto& kv : column_families_) families.push_back(kv.second);
+    }
+    for (const auto& cfd : families) MaybeScheduleCompaction(cfd);
+}
 
-    bg_.Schedule(CompactionManager::Task{
-        CompactionManager::kCompact,
-        [vset, level, block_size, bloom_bits, dbp]() -> Status {
-            std::vector<TableFile> level_files, next_files;
-            vset->PickCompactionInputs(level, level_files, next_files);
-            if (level_files.empty()) return Status::OK();
-
-            std::vector<MergeSource> sources;
-            auto open_iter = [&](const TableFile& tf)->std::unique_ptr<SSTableReader::Iterator> {
-                std::shared_ptr<SSTableReader> r;
-                Status s = SSTableReader::Open(tf.path, &r);
-                if (!s.ok()) return nullptr;
-                return r->NewIterator();
-            };
-            for (auto& tf : level_files) {
-                auto it = open_iter(tf);
-                if (it) sources.push_back(MergeSource{std::move(it), tf.level, tf.number});
-            }
-            for (auto& tf : next_files) {
-                auto it = open_iter(tf);
-                if (it) sources.push_back(MergeSource{std::move(it), tf.level, tf.number});
+// Keeps up to max_background_compactions jobs in flight across all families.
+// The picker skips files other jobs hold, so a job may find nothing to do;
+// only jobs that did work reschedule, which keeps this from spinning.
+void DBImpl::MaybeScheduleCompaction(const std::shared_ptr<ColumnFamilyData>& cfd) {
+    while (true) {
+        if (shutting_down_) return;
+        int n = bg_compactions_scheduled_.load();
+        if (n >= std::max(1, options_.max_background_compactions)) return;
+        if (!cfd->versions.NeedsCompaction()) return;
+        {
+            std::shared_lock<std::shared_mutex> lk(mu_);
+            if (!bg_error_.ok() || cfd->dropped) return;
+        }
+        if (!bg_compactions_scheduled_.compare_exchange_weak(n, n + 1)) continue;
+        bg_.Schedule(CompactionManager::Task{
+            CompactionManager::kCompact,
+            [this, cfd]() -> Status {
+                bool did_work = false;
+                Status s = BackgroundCompaction(cfd.get(), &did_work);
+                bg_compactions_scheduled_.fetch_sub(1);
+                if (s.ok() && did_work) MaybeScheduleCompaction();
+                return s;
             }
-            if (sources.empty()) return Status::OK();
-
-            KWayMerger merger(std::move(sources));
-            uint64_t new_number = vset->NextFileNumber();
-            std::string out_path = dbp + "/L" + std::to_string(level+1) + "-" + std::to_string(new_number) + ".sst";
-            SSTableBuilder builder(out_path, block_size, bloom_bits);
-            Status s = builder.Open(); if (!s.ok()) return s;
-
-            std::string last_key;
-            while (true) {
-                std::string key; MemValue mv;
-                if (!merger.Next(key, mv)) break;
-                if (!last_key.empty() && key == last_key) continue;
-                builder.Add(Slice(key), mv);
-                last_key = key;
+        });
+    }
+}
+
+Status DBImpl::BackgroundCompaction(ColumnFamilyData* cfd, bool* did_work) {
+    std::unique_ptr<Compaction> c;
+    {
+        // Held across the pick so no memtable rotation (which takes a file number) interleaves.
+        std::shared_lock<std::shared_mutex> lk(mu_);
+        if (cfd->dropped) return Status::OK();
+        c = cfd->versions.PickCompaction(cfd->imm != nullptr);
+    }
+    if (!c) return Status::OK();
+    *did_work = true;
+    Status s = DoCompactionWork(cfd, c.get());
+    cfd->versions.ReleaseCompaction(c.get());
+    return s;
+}
+
+void DBImpl::RecordBackgroundError(const Status& s) {
+    std::unique_lock<std::shared_mutex> lk(mu_);
+    if (bg_error_.ok()) bg_error_ = s;
+    bg_cv_.notify_all();
+}
+
+Status DBImpl::DoCompactionWork(ColumnFamilyData* cfd, Compaction* c) {
+    const Options& opt = cfd->options;
+    const uint64_t start = MonotonicMicros();
+    LevelStats ls;
+    ls.count = 1;
+    // Blob references are only counted when there are blob files to account to.
+    bool count_blobs = false;
+    uint64_t blob_gc_cutoff = 0;
+    {
+        Version* v = cfd->versions.current();
+        const auto& blob_files = v->blob_files();
+        count_blobs = !blob_files.empty();
+        if (count_blobs && opt.enable_blob_garbage_collection) {
+            // The oldest age_cutoff fraction of blob files, by file number.
+            size_t n = (size_t)(blob_files.size() * opt.blob_garbage_collection_age_cutoff);
+            if (n >= blob_files.size()) blob_gc_cutoff = blob_files.rbegin()->first + 1;
+            else if (n > 0) blob_gc_cutoff = std::next(blob_files.begin(), n)->first;
+        }
+        v->Unref();
+    }
+
+    if (c->deletion_only) {
+        VersionEdit edit;
+        for (const auto& tf : c->inputs[0]) edit.RemoveFile(tf.level, tf.number);
+        if (count_blobs) {
+            // Every blob the dropped tables point to becomes garbage.
+            BlobGarbageMeter meter;
+            for (const auto& tf : c->inputs[0]) {
+                SSTableCache::Handle r;
+                Status s = table_cache_.Get(tf.path, &r, opt.comparator);
+                if (!s.ok()) return s;
+                auto it = r->NewIterator(opt.rate_limiter.get(), opt.use_direct_io_for_flush_and_compaction,
+                                         opt.compaction_readahead_size);
+                for (it->SeekToFirst(); it->Valid(); it->Next()) {
+                    if (it->type() == kTypeBlobIndex) meter.AddInflow(it->value());
+                }
+                if (!it->status().ok()) return it->status();
             }
-            SSTableMeta meta;
-            s = builder.Finish(&meta); if (!s.ok()) return s;
+            for (const auto& g : meter.Garbage()) edit.AddBlobGarbage(g.first, g.second.count, g.second.bytes);
+        }
+        Status s = cfd->versions.LogAndApply(edit);
+        if (!s.ok()) return s;
+        std::unique_lock<std::shared_mutex> lk(mu_);
+        cfd->InstallSuperVersion();
+        return Status::OK();
+    }
+
+    if (c->trivial_move) {
+        VersionEdit edit;
+        TableFile f = c->inputs[0][0];
+        edit.RemoveFile(f.level, f.number);
+        f.level = c->output_level;
+        edit.AddFile(f);
+        edit.SetCompactPointer(c->level, c->compact_pointer);
+        Status s = cfd->versions.LogAndApply(edit);
+        if (!s.ok()) return s;
+        {
+            std::unique_lock<std::shared_mutex> lk(mu_);
+            cfd->InstallSuperVersion();
+        }
+        ls.bytes_moved = f.size;
+        ls.micros = MonotonicMicros() - start;
+        cfd->AddLevelStats(c->output_level, ls);
+        return Status::OK();
+    }
+
+    StopWatch sw(stats_, kCompactionMicros);
+    uint64_t newest_data = 0, input_bytes = 0;
+    for (int which=0; which<2; ++which) {
+        for (const auto& tf : c->inputs[which]) {
+            newest_data = std::max(newest_data, tf.creation_time);
+            input_bytes += tf.size;
+        }
+    }
+
+    // Split into key ranges [bounds[i-1], bounds[i]) merged in parallel; the
+    // calling thread takes the first range.
+    std::vector<std::string> bounds = SubcompactionBoundaries(cfd, c);
+    std::vector<SubcompactionState> subs(bounds.size() + 1);
+    for (size_t i=0; i<subs.size(); ++i) {
+        if (i > 0) { subs[i].has_begin = true; subs[i].begin = bounds[i-1]; }
+        if (i < bounds.size()) { subs[i].has_end = true; subs[i].end = bounds[i]; }
+    }
+    std::vector<std::thread> threads;
+    for (size_t i=1; i<subs.size(); ++i) {
+        threads.emplace_back([this, cfd, c, &subs, i, newest_data, count_blobs, blob_gc_cutoff]{
+            RunSubcompaction(cfd, c, &subs[i], newest_data, count_blobs, blob_gc_cutoff);
+        });
+    }
+    RunSubcompaction(cfd, c, &subs[0], newest_data, count_blobs, blob_gc_cutoff);
+    for (auto& t : threads) t.join();
+
+    Status s;
+    VersionEdit edit;
+    BlobGarbageMeter meter;
+    uint64_t blob_bytes = 0;
+    for (const auto& sub : subs) {
+        if (s.ok()) s = sub.status;
+        for (const auto& f : sub.outputs) edit.AddFile(f);
+        for (const auto& b : sub.blob_outputs) { edit.AddBlobFile(b); blob_bytes += b.size; }
+        meter.Merge(sub.blob_meter);
+    }
+    for (const auto& g : meter.Garbage()) edit.AddBlobGarbage(g.first, g.second.count, g.second.bytes);
+    if (s.ok()) {
+        for (int which=0; which<2; ++which) {
+            for (const auto& tf : c->inputs[which]) edit.RemoveFile(tf.level, tf.number);
+        }
+        if (!c->compact_pointer.empty()) edit.SetCompactPointer(c->level, c->compact_pointer);
+        s = cfd->versions.LogAndApply(edit);
+    }
+    if (!s.ok()) {
+        for (const auto& sub : subs) {
+            for (const auto& p : sub.paths) { std::error_code ec; fs::remove(p, ec); }
+        }
+        return s;
+    }
+    {
+        std::unique_lock<std::shared_mutex> lk(mu_);
+        cfd->InstallSuperVersion();
+    }
+    RecordTick(stats_, kCompactReadBytes, input_bytes);
+    for (const auto& sub : subs) {
+        for (const auto& f : sub.outputs) ls.bytes_written += f.size;
+    }
+    RecordTick(stats_, kCompactWriteBytes, ls.bytes_written);
+    RecordTick(stats_, kBlobBytesWritten, blob_bytes);
+    ls.bytes_written += blob_bytes;
+    for (int which=0; which<2; ++which) {
+        for (const auto& tf : c->inputs[which]) (tf.level == c->output_level ? ls.bytes_read_output : ls.bytes_read_input) += tf.size;
+    }
+    ls.micros = MonotonicMicros() - start;
+    cfd->AddLevelStats(c->output_level, ls);
+    if (opt.preload_new_tables) {
+        for (const auto& sub : subs) {
+            for (const auto& f : sub.outputs) table_cache_.Preload(f.path, cfd->options.comparator);
+        }
+    }
+    return Status::OK();
+}
+
+// Picks up to max_subcompactions-1 split keys from the inputs' index blocks
+// (each entry is a block's first key) so that every range covers about the
+// same number of input bytes. Ranges smaller than one output file are not
+// worth a thread. A universal compaction into L0 must stay a single file.
+std::vector<std::string> DBImpl::SubcompactionBoundaries(ColumnFamilyData* cfd, Compaction* c) {
+    const Options& opt = cfd->options;
+    std::vector<std::string> bounds;
+    if (opt.max_subcompactions <= 1 || c->output_number) return bounds;
+
+    std::vector<std::pair<std::string, uint64_t>> blocks;
+    uint64_t total = 0;
+    for (int which=0; which<2; ++which) {
+        for (const auto& tf : c->inputs[which]) {
+            SSTableCache::Handle r;
+            if (!table_cache_.Get(tf.path, &r, opt.comparator).ok()) return bounds;
+            for (const auto& e : r->index().entries()) { blocks.emplace_back(e.key, e.sz); total += e.sz; }
+        }
+    }
+    uint64_t n = std::min<uint64_t>(opt.max_subcompactions, total / std::max<uint64_t>(1, c->max_output_file_size));
+    if (n <= 1) return bounds;
+    UserKeyComparator cmp(opt.comparator);
+    std::sort(blocks.begin(), blocks.end(), [&](const std::pair<std::string, uint64_t>& a, const std::pair<std::string, uint64_t>& b) {
+        return cmp.Less(a.first, b.first);
+    });
 
-            for (auto& tf : level_files) vset->RemoveFile(tf.level, tf.number);
-            for (auto& tf : next_files) vset->RemoveFile(tf.level, tf.number);
-            TableFile out; out.level=level+1; out.number=new_number; out.path=out_path; out.smallest=meta.smallest_key; out.largest=meta.largest_key; out.size=meta.file_size;
-            vset->AddFile(out);
-            for (auto& tf : level_files) { std::error_code ec; fs::remove(tf.path, ec); }
-            for (auto& tf : next_files) { std::error_code ec; fs::remove(tf.path, ec); }
-            return Status::OK();
+    const uint64_t per_range = total / n;
+    uint64_t acc = 0;
+    for (const auto& b : blocks) {
+        if (acc >= per_range * (bounds.size() + 1) && cmp.Less(blocks.front().first, b.first) &&
+            (bounds.empty() || cmp.Less(bounds.back(), b.first))) {
+            bounds.push_back(b.first);
+            if (bounds.size() + 1 == n) break;
         }
+        acc += b.second;
+    }
+    return bounds;
+}
+
+// Merges the inputs over sub's key range into output files of c->output_level.
+// Outputs are only recorded here; DoCompactionWork installs all ranges at once.
+// Large inline values are moved to blob files, and blobs in files older than
+// blob_gc_cutoff are copied into new ones so the old files can be dropped.
+void DBImpl::RunSubcompaction(ColumnFamilyData* cfd, Compaction* c, SubcompactionState* sub, uint64_t newest_data,
+                              bool count_blobs, uint64_t blob_gc_cutoff) {
+    const Options& opt = cfd->options;
+    // Newest first, which is how MergingIterator breaks ties: lower level, then higher file number.
+    std::vector<const TableFile*> files;
+    for (int which=0; which<2; ++which) {
+        for (const auto& tf : c->inputs[which]) files.push_back(&tf);
+    }
+    std::sort(files.begin(), files.end(), [](const TableFile* a, const TableFile* b){
+        return a->level != b->level ? a->level < b->level : a->number > b->number;
     });
+    std::vector<std::unique_ptr<InternalIterator>> children;
+    for (const TableFile* tf : files) {
+        SSTableCache::Handle r;
+        sub->status = table_cache_.Get(tf->path, &r, opt.comparator);
+        if (!sub->status.ok()) return;
+        std::unique_ptr<SSTableReader::Iterator> it = r->NewIterator(opt.rate_limiter.get(), opt.use_direct_io_for_flush_and_compaction,
+                                                                    opt.compaction_readahead_size);
+        it->RegisterCleanup([r]{}); // pins the reader for the iterator's lifetime
+        if (count_blobs) children.emplace_back(new BlobCountingIterator(std::move(it), &sub->blob_meter));
+        else children.push_back(std::move(it));
+    }
+    MergingIterator merger(opt.comparator, std::move(children));
+    if (sub->has_begin) merger.Seek(Slice(sub->begin));
+    else merger.SeekToFirst();
+
+    const int out_level = c->output_level;
+    Compaction::OutputState state;
+    std::unique_ptr<BlobFileBuilder> blobs = NewBlobFileBuilder(cfd, RateLimiter::kLow);
+    std::string blob_index, blob_value;
+    ReadOptions blob_read;
+    blob_read.fill_cache = false;
+    std::unique_ptr<SSTableBuilder> builder;
+    TableFile out;
+    auto finish_output = [&]() -> Status {
+        SSTableMeta meta;
+        Status s = builder->Finish(&meta);
+        builder.reset();
+        if (!s.ok()) return s;
+        out.smallest=meta.smallest_key; out.largest=meta.largest_key; out.size=meta.file_size; out.creation_time=meta.creation_time;
+        out.num_entries=meta.num_entries; out.num_deletions=meta.num_deletions;
+        sub->outputs.push_back(out);
+        return Status::OK();
+    };
+
+    Status s;
+    for (; s.ok() && merger.Valid(); merger.Next()) {
+        Slice key = merger.key();
+        if (sub->has_end && c->cmp(key, sub->end) >= 0) break;
+        bool stop = c->ShouldStopBefore(key, &state);
+        if (builder && (stop || builder->FileSize() >= c->max_output_file_size)) {
+            s = finish_output();
+            if (!s.ok()) break;
+        }
+        // Nothing older remains below, so a tombstone has nothing left to hide.
+        if (merger.type() == kTypeDeletion && c->bottommost) continue;
+        if (!builder) {
+            out = TableFile{};
+            out.level = out_level;
+            out.number = c->output_number ? c->output_number : cfd->versions.NextFileNumber();
+            out.path = cfd->path + "/L" + std::to_string(out_level) + "-" + std::to_string(out.number) + ".sst";
+            sub->paths.push_back(out.path);
+            builder.reset(new SSTableBuilder(out.path, opt.block_size, opt.bloom_bits_per_key));
+            if (newest_data) builder->SetCreationTime(newest_data);
+            builder->SetRateLimiter(opt.rate_limiter.get(), RateLimiter::kLow);
+            builder->SetDirectIO(opt.use_direct_io_for_flush_and_compaction);
+            s = builder->Open();
+            if (!s.ok()) break;
+        }
+        ValueType type = merger.type();
+        Slice value = merger.value();
+        if (type == kTypeBlobIndex) {
+            BlobIndex idx;
+            s = idx.DecodeFrom(value);
+            if (!s.ok()) break;
+            if (idx.file_number < blob_gc_cutoff) {
+                // Relocate; a value now below min_blob_size (or with blob files off) goes back inline.
+                s = GetBlob(cfd, blob_read, value, &blob_value);
+                if (s.ok() && blobs) s = blobs->Add(key, Slice(blob_value), &blob_index);
+                if (!s.ok()) break;
+                if (blobs && !blob_index.empty()) value = Slice(blob_index);
+                else { type = kTypeValue; value = Slice(blob_value); }
+            } else {
+                sub->blob_meter.AddOutflow(value);
+            }
+        } else if (type == kTypeValue && blobs) {
+            s = blobs->Add(key, value, &blob_index);
+            if (!s.ok()) break;
+            if (!blob_index.empty()) { type = kTypeBlobIndex; value = Slice(blob_index); }
+        }
+        s = builder->Add(key, type, value);
+    }
+    // A failed block read ends the merge early; that must not look like the end of the inputs.
+    if (s.ok()) s = merger.status();
+    // Blob files are durable before the tables pointing into them.
+    if (s.ok() && blobs) s = blobs->Finish();
+    if (s.ok() && builder) s = finish_output();
+    if (blobs) {
+        sub->paths.insert(sub->paths.end(), blobs->paths().begin(), blobs->paths().end());
+        sub->blob_outputs = blobs->files();
+    }
+    sub->status = s;
+}
+
+// Runs when the last Version referencing f goes away, possibly on a reader thread.
+void DBImpl::DeleteObsoleteFile(const TableFile& f) {
+    table_cache_.Erase(f.path);
+    std::error_code ec;
+    fs::remove(f.path, ec);
+}
+
+std::unique_ptr<BlobFileBuilder> DBImpl::NewBlobFileBuilder(ColumnFamilyData* cfd, RateLimiter::Priority pri) {
+    const Options& opt = cfd->options;
+    if (!opt.enable_blob_files) return nullptr;
+    std::unique_ptr<BlobFileBuilder> b(new BlobFileBuilder(cfd->path, [cfd]{ return cfd->versions.NextFileNumber(); },
+                                                           opt.min_blob_size, opt.blob_file_size));
+    b->SetRateLimiter(opt.rate_limiter.get(), pri);
+    b->SetDirectIO(opt.use_direct_io_for_flush_and_compaction);
+    return b;
+}
+
+// Blob values share the block cache with data blocks, keyed like them by path and offset.
+Status DBImpl::GetBlob(ColumnFamilyData* cfd, const ReadOptions& options, const Slice& blob_index, std::string* value) {
+    BlobIndex idx;
+    Status s = idx.DecodeFrom(blob_index);
+    if (!s.ok()) return s;
+    std::string cache_key = BlobFileName(cfd->path, idx.file_number) + ":" + std::to_string(idx.offset);
+    if (block_cache_.Get(cache_key, value)) return Status::OK();
+    PerfTimer t(&PerfContext::blob_read_nanos);
+    BlobFileCache::Handle r;
+    s = cfd->blob_cache.Get(idx.file_number, &r);
+    if (s.ok()) s = r->Get(idx, value);
+    t.Stop();
+    if (!s.ok()) return s;
+    PerfCount(&PerfContext::blob_read_count);
+    PerfCount(&PerfContext::blob_read_bytes, idx.size);
+    RecordTick(stats_, kBlobBytesRead, idx.size);
+    if (options.fill_cache) block_cache_.Put(cache_key, *value);
+    return Status::OK();
 }
 
 Status DBImpl::CompactRange(const Slice& begin, const Slice& end) {
@@ -227,9 +1248,385 @@ Status DBImpl::CompactRange(const Slice& begin, const Slice& end) {
     return Status::OK();
 }
 
-Status DBImpl::Flush() {
+Status DBImpl::Flush(ColumnFamilyHandle* column_family) {
+    ColumnFamilyData* cfd = CFD(column_family);
     std::unique_lock<std::shared_mutex> lk(mu_);
-    return RotateMemTable();
+    // Waits for an earlier flush of this family instead of skipping this one.
+    while (cfd->imm && bg_error_.ok() && !cfd->dropped) bg_cv_.wait(lk);
+    if (cfd->dropped) return Status::InvalidArgument("column family dropped: " + cfd->name);
+    if (!bg_error_.ok()) return bg_error_;
+    return RotateMemTable(cfd);
+}
+
+// Checks one external file and links (or copies) it into the DB directory.
+Status DBImpl::PrepareExternalFile(ColumnFamilyData* cfd, const std::string& src, const IngestExternalFileOptions& options, TableFile* out) {
+    std::shared_ptr<SSTableReader> r;
+    Status s = SSTableReader::Open(src, &r, false, cfd->options.comparator);
+    if (!s.ok()) return s;
+    const auto& index = r->index().entries();
+    if (index.empty()) return Status::InvalidArgument("empty external file: " + src);
+    UserKeyComparator cmp(cfd->options.comparator);
+    for (size_t i=1; i<index.size(); ++i) {
+        if (!cmp.Less(index[i-1].key, index[i].key)) return Status::Corruption("blocks out of order: " + src);
+    }
+    out->smallest = index.front().key;
+    s = r->LastKey(&out->largest);
+    if (!s.ok()) return s;
+    if (options.verify_key_order) {
+        auto it = r->NewIterator(nullptr, false, cfd->options.compaction_readahead_size);
+        std::string prev;
+        bool first = true;
+        for (it->SeekToFirst(); it->Valid(); it->Next()) {
+            if (!first && cmp(it->key(), prev) <= 0) return Status::Corruption("keys out of order: " + src);
+            prev.assign(it->key().data(), it->key().size());
+            first = false;
+            ++out->num_entries;
+            if (it->type() == kTypeDeletion) ++out->num_deletions;
+        }
+        if (!it->status().ok()) return it->status();
+    }
+
+    // Staged under a temporary name; VersionSet::AddExternalFiles gives it its number and level.
+    out->path = cfd->path + "/" + std::to_string(cfd->versions.NextFileNumber()) + ".ingest";
+    out->creation_time = NowSeconds();
+    std::error_code ec;
+    out->size = fs::file_size(src, ec);
+    if (ec) return Status::IOError("stat " + src + ": " + ec.message());
+    if (options.move_files) fs::create_hard_link(src, out->path, ec);
+    if (!options.move_files || ec) {
+        ec.clear();
+        fs::copy_file(src, out->path, fs::copy_options::overwrite_existing, ec);
+        if (ec) return Status::IOError("copy " + src + ": " + ec.message());
+        s = FsyncPath(out->path);
+        if (!s.ok()) { fs::remove(out->path, ec); return s; }
+    }
+    return Status::OK();
+}
+
+Status DBImpl::IngestExternalFile(ColumnFamilyHandle* column_family, const std::vector<std::string>& files,
+                                  const IngestExternalFileOptions& options) {
+    ColumnFamilyData* cfd = CFD(column_family);
+    std::vector<TableFile> tables(files.size());
+    Status s;
+    size_t prepared = 0;
+    for (; prepared<files.size() && s.ok(); ++prepared) s = PrepareExternalFile(cfd, files[prepared], options, &tables[prepared]);
+    auto cleanup = [&]{
+        for (size_t i=0; i<prepared; ++i) { std::error_code ec; if (!tables[i].path.empty()) fs::remove(tables[i].path, ec); }
+    };
+    if (!s.ok()) { cleanup(); return s; }
+    UserKeyComparator cmp(cfd->options.comparator);
+    std::sort(tables.begin(), tables.end(), [&](const TableFile& a, const TableFile& b){ return cmp.Less(a.smallest, b.smallest); });
+    for (size_t i=1; i<tables.size(); ++i) {
+        if (!cmp.Less(tables[i-1].largest, tables[i].smallest)) { cleanup(); return Status::InvalidArgument("external files overlap"); }
+    }
+
+    {
+        // Writes wait while we hold mu_, so the memtables cannot gain keys in
+        // the ingested ranges. Older unflushed versions of those keys must reach
+        // L0 first, or they would shadow the ingested data.
+        std::unique_lock<std::shared_mutex> lk(mu_);
+        auto overlaps = [&](const std::shared_ptr<MemTable>& m) {
+            if (!m) return false;
+            for (const auto& t : tables) if (m->OverlapsRange(Slice(t.smallest), Slice(t.largest))) return true;
+            return false;
+        };
+        if (cfd->dropped) { cleanup(); return Status::InvalidArgument("column family dropped: " + cfd->name); }
+        while (bg_error_.ok() && (overlaps(cfd->imm) || overlaps(cfd->mem))) {
+            if (cfd->imm) {
+                uint64_t start = stats_ ? MonotonicMicros() : 0;
+                bg_cv_.wait(lk);
+                if (stats_) stats_->RecordTick(kStallMicros, MonotonicMicros() - start);
+                continue;
+            }
+            s = RotateMemTable(cfd);
+            if (!s.ok()) { cleanup(); return s; }
+        }
+        if (!bg_error_.ok()) { cleanup(); return bg_error_; }
+        s = cfd->versions.AddExternalFiles(&tables);
+        if (!s.ok()) { cleanup(); return s; }
+        cfd->InstallSuperVersion();
+    }
+    if (cfd->options.preload_new_tables) {
+        for (const auto& t : tables) table_cache_.Preload(t.path, cfd->options.comparator);
+    }
+    MaybeScheduleCompaction();
+    return Status::OK();
+}
+
+// Table and blob files never change once written, so each family's current
+// files are hard-linked; the pinned Versions keep compactions from deleting
+// them meanwhile. The MANIFESTs are rewritten from those Versions instead of
+// copied. Of the WALs the checkpoint still needs, closed ones are linked and
+// the active one is copied up to where it ended when the checkpoint started;
+// none is deleted until then.
+Status DBImpl::CreateCheckpoint(const std::string& dir) {
+    std::error_code ec;
+    if (fs::exists(dir, ec)) return Status::InvalidArgument("checkpoint directory exists: " + dir);
+    const std::string tmp = dir + ".tmp";
+    fs::remove_all(tmp, ec);
+
+    struct Family {
+        std::shared_ptr<ColumnFamilyData> cfd;
+        Version* v = nullptr;
+        VersionEdit snap;
+    };
+    std::vector<Family> families;
+    std::vector<uint64_t> wals; // oldest first, the active one last
+    uint64_t active_size = 0;
+    {
+        std::unique_lock<std::shared_mutex> lk(mu_);
+        if (!wal_) return Status::IOError("WAL not open");
+        ++file_deletions_paused_;
+        families.resize(column_families_.size());
+        size_t i = 0;
+        for (const auto& kv : column_families_) {
+            Family& f = families[i++];
+            f.cfd = kv.second;
+            f.v = f.cfd->versions.Snapshot(&f.snap);
+        }
+        for (const auto& w : old_wals_) wals.push_back(w.first);
+        wals.push_back(wal_number_);
+        active_size = wal_->size();
+    }
+
+    Status s;
+    uint64_t min_log = wals.back();
+    for (const auto& f : families) min_log = std::min(min_log, f.snap.log_number);
+    for (const auto& f : families) {
+        std::string to = f.cfd->id == 0 ? tmp : tmp + "/" + ColumnFamilyData::DirName(f.cfd->id);
+        fs::create_directories(to, ec);
+        if (ec) { s = Status::IOError("create " + to + ": " + ec.message()); break; }
+        for (int l=0; s.ok() && l<f.v->NumLevels(); ++l) {
+            for (const auto& t : f.v->files(l)) {
+                s = LinkOrCopyFile(t->path, to + "/" + VersionEdit::FileName(t->path));
+                if (!s.ok()) break;
+            }
+        }
+        for (const auto& kv : f.v->blob_files()) {
+            if (!s.ok()) break;
+            s = LinkOrCopyFile(kv.second.file->path, to + "/" + VersionEdit::FileName(kv.second.file->path));
+        }
+        if (s.ok()) s = VersionSet::WriteManifest(to, f.snap.next_file_number, f.snap);
+        if (!s.ok()) break;
+    }
+    for (size_t i = 0; s.ok() && i < wals.size(); ++i) {
+        if (wals[i] < min_log) continue;
+        std::string to = tmp + "/wal-" + std::to_string(wals[i]) + ".log";
+        if (i + 1 < wals.size()) {
+            s = LinkOrCopyFile(WALFilePath(wals[i]), to);
+            if (s.ok()) s = FsyncPath(to);
+        } else {
+            s = CopyFilePrefix(WALFilePath(wals[i]), to, active_size);
+        }
+    }
+    if (s.ok()) {
+        fs::rename(tmp, dir, ec);
+        if (ec) s = Status::IOError("rename " + tmp + ": " + ec.message());
+    }
+#if !defined(_WIN32)
+    if (s.ok()) {
+        std::string parent = fs::path(dir).parent_path().string();
+        FsyncPath(parent.empty() ? "." : parent);
+    }
+#endif
+
+    for (const auto& f : families) f.v->Unref();
+    std::vector<std::string> obsolete;
+    {
+        std::unique_lock<std::shared_mutex> lk(mu_);
+        if (--file_deletions_paused_ == 0) obsolete = ObsoleteWALs();
+    }
+    for (const auto& path : obsolete) fs::remove(path, ec);
+    if (!s.ok()) fs::remove_all(tmp, ec);
+    return s;
+}
+
+std::string DBImpl::LevelStatsString(ColumnFamilyData* cfd) {
+    SuperVersion* sv = cfd->AcquireSuperVersion();
+    std::string out = "Level Files Size(MB) Score\n--------------------------\n";
+    char buf[128];
+    for (int l=0; l<sv->current->NumLevels(); ++l) {
+        std::snprintf(buf, sizeof(buf), "%5d %5zu %8.1f %5.2f\n", l, sv->current->files(l).size(),
+                      sv->current->LevelBytes(l) / 1048576.0, sv->current->Score(l));
+        out += buf;
+    }
+    sv->Unref();
+    return out;
+}
+
+// Per output level: Rn is read from the level(s) above, Rnp1 from the output
+// level, Write includes blob files, W-Amp = Write / Rn. Read-Amp is the number of sorted runs a point
+// lookup may probe in that level. The Sum row's W-Amp is total writes over
+// flushed bytes, i.e. the write amplification of the whole tree.
+std::string DBImpl::CompactionStatsString(ColumnFamilyData* cfd) {
+    std::vector<LevelStats> stats;
+    uint64_t flushed = 0;
+    {
+        std::lock_guard<std::mutex> lg(cfd->level_stats_mu);
+        stats = cfd->level_stats;
+        flushed = cfd->flush_bytes;
+    }
+    SuperVersion* sv = cfd->AcquireSuperVersion();
+    std::string out = "Level Files Size(MB) Score Read-Amp Rn(MB) Rnp1(MB) Write(MB) Moved(MB) W-Amp Comp(sec) Count\n"
+                      "-----------------------------------------------------------------------------------------------\n";
+    char buf[256];
+    const double mb = 1048576.0;
+    LevelStats sum;
+    size_t files = 0, runs = 0;
+    uint64_t bytes = 0;
+    auto row = [&](const char* name, size_t nfiles, uint64_t size, double score, size_t read_amp, const LevelStats& s, double wamp) {
+        std::snprintf(buf, sizeof(buf), "%5s %5zu %8.1f %5.2f %8zu %6.1f %8.1f %9.1f %9.1f %5.1f %9.1f %5llu\n",
+                      name, nfiles, size / mb, score, read_amp, s.bytes_read_input / mb, s.bytes_read_output / mb,
+                      s.bytes_written / mb, s.bytes_moved / mb, wamp, s.micros / 1e6, (unsigned long long)s.count);
+        out += buf;
+    };
+    for (int l=0; l<sv->current->NumLevels(); ++l) {
+        const LevelStats& s = stats[l];
+        size_t n = sv->current->files(l).size();
+        size_t read_amp = l == 0 ? n : (n > 0 ? 1 : 0);
+        uint64_t size = sv->current->LevelBytes(l);
+        if (n == 0 && s.count == 0) continue;
+        std::string name = "L" + std::to_string(l);
+        row(name.c_str(), n, size, sv->current->Score(l), read_amp, s,
+            s.bytes_read_input ? (double)s.bytes_written / s.bytes_read_input : 0);
+        files += n; runs += read_amp; bytes += size;
+        sum.micros += s.micros; sum.bytes_read_input += s.bytes_read_input; sum.bytes_read_output += s.bytes_read_output;
+        sum.bytes_written += s.bytes_written; sum.bytes_moved += s.bytes_moved; sum.count += s.count;
+    }
+    uint64_t blob_files = sv->current->blob_files().size(), blob_size = 0, blob_garbage = 0;
+    for (const auto& kv : sv->current->blob_files()) { blob_size += kv.second.file->size; blob_garbage += kv.second.garbage_bytes; }
+    sv->Unref();
+    row("Sum", files, bytes, 0, runs, sum, flushed ? (double)sum.bytes_written / flushed : 0);
+    if (blob_files) {
+        std::snprintf(buf, sizeof(buf), "Blob files: %llu, %.1f MB, %.1f MB garbage\n",
+                      (unsigned long long)blob_files, blob_size / mb, blob_garbage / mb);
+        out += buf;
+    }
+    return out;
+}
+
+bool DBImpl::GetIntProperty(ColumnFamilyHandle* column_family, const Slice& property, uint64_t* value) {
+    ColumnFamilyData* cfd = CFD(column_family);
+    Slice in = property;
+    if (!in.starts_with("lsmkv.")) return false;
+    in.remove_prefix(6);
+    std::string name = in.ToString();
+    auto level_arg = [&](const char* prefix, int* level) {
+        size_t n = std::strlen(prefix);
+        if (name.compare(0, n, prefix) != 0 || name.size() == n) return false;
+        char* end = nullptr;
+        long l = std::strtol(name.c_str() + n, &end, 10);
+        if (*end != '\0' || l < 0 || l >= cfd->options.num_levels) return false;
+        *level = (int)l;
+        return true;
+    };
+    int level = 0;
+    if (level_arg("bytes-read-at-level", &level)) {
+        std::lock_guard<std::mutex> lg(cfd->level_stats_mu);
+        *value = cfd->level_stats[level].bytes_read_input + cfd->level_stats[level].bytes_read_output;
+        return true;
+    }
+    if (level_arg("bytes-written-at-level", &level)) {
+        std::lock_guard<std::mutex> lg(cfd->level_stats_mu);
+        *value = cfd->level_stats[level].bytes_written;
+        return true;
+    }
+    if (name == "block-cache-usage") { *value = block_cache_.Usage(); return true; }
+    if (name == "block-cache-capacity") { *value = block_cache_.Capacity(); return true; }
+    if (name == "table-cache-size") { *value = table_cache_.Size(); return true; }
+    if (name == "num-running-compactions") { *value = (uint64_t)bg_compactions_scheduled_.load(); return true; }
+
+    SuperVersion* sv = cfd->AcquireSuperVersion();
+    const Version* v = sv->current;
+    bool found = true;
+    if (level_arg("num-files-at-level", &level)) {
+        *value = v->files(level).size();
+    } else if (level_arg("bytes-at-level", &level)) {
+        *value = v->LevelBytes(level);
+    } else if (name == "estimate-pending-compaction-bytes") {
+        *value = cfd->versions.EstimatePendingCompactionBytes(v);
+    } else if (name == "compaction-pending") {
+        *value = cfd->versions.NeedsCompaction() ? 1 : 0;
+    } else if (name == "cur-size-active-mem-table") {
+        *value = sv->mem->ApproximateMemoryUsage();
+    } else if (name == "cur-size-all-mem-tables") {
+        *value = sv->mem->ApproximateMemoryUsage() + (sv->imm ? sv->imm->ApproximateMemoryUsage() : 0);
+    } else if (name == "num-entries-active-mem-table") {
+        *value = sv->mem->NumEntries();
+    } else if (name == "num-entries-imm-mem-tables") {
+        *value = sv->imm ? sv->imm->NumEntries() : 0;
+    } else if (name == "num-immutable-mem-table") {
+        *value = sv->imm ? 1 : 0;
+    } else if (name == "num-blob-files") {
+        *value = v->blob_files().size();
+    } else if (name == "total-blob-file-size" || name == "live-blob-file-garbage-size") {
+        uint64_t size = 0, garbage = 0;
+        for (const auto& kv : v->blob_files()) { size += kv.second.file->size; garbage += kv.second.garbage_bytes; }
+        *value = name == "total-blob-file-size" ? size : garbage;
+    } else if (name == "total-sst-files-size" || name == "num-live-files" || name == "estimate-num-keys") {
+        uint64_t size = 0, files = 0, entries = 0, deletions = 0;
+        for (int l=0; l<v->NumLevels(); ++l) {
+            for (const auto& f : v->files(l)) {
+                size += f->size; ++files; entries += f->num_entries; deletions += f->num_deletions;
+            }
+        }
+        for (const MemTable* m : {sv->mem.get(), sv->imm.get()}) {
+            if (m) { entries += m->NumEntries(); deletions += m->NumDeletes(); }
+        }
+        if (name == "total-sst-files-size") *value = size;
+        else if (name == "num-live-files") *value = files;
+        else *value = entries > 2 * deletions ? entries - 2 * deletions : 0; // a deletion hides a key and is an entry itself
+    } else {
+        found = false;
+    }
+    sv->Unref();
+    return found;
+}
+
+bool DBImpl::GetProperty(ColumnFamilyHandle* column_family, const Slice& property, std::string* value) {
+    if (property.compare("lsmkv.levelstats") == 0) { *value = LevelStatsString(CFD(column_family)); return true; }
+    if (property.compare("lsmkv.stats") == 0) { *value = CompactionStatsString(CFD(column_family)); return true; }
+    uint64_t n = 0;
+    if (!GetIntProperty(column_family, property, &n)) return false;
+    *value = std::to_string(n);
+    return true;
+}
+
+void DBImpl::StatsDumpLoop() {
+    const std::string path = db_path_ + "/LOG";
+    std::unique_lock<std::mutex> lk(dump_mu_);
+    while (!dump_cv_.wait_for(lk, std::chrono::seconds(options_.stats_dump_period_sec), [&]{ return stop_dump_; })) {
+        lk.unlock();
+        std::string out;
+        time_t now = (time_t)NowSeconds();
+        char ts[64];
+        struct tm tm_now;
+#if defined(_WIN32)
+        localtime_s(&tm_now, &now);
+#else
+        localtime_r(&now, &tm_now);
+#endif
+        std::strftime(ts, sizeof(ts), "%Y/%m/%d-%H:%M:%S", &tm_now);
+        out += std::string("** DB Stats ") + ts + " **\n";
+        std::vector<std::shared_ptr<ColumnFamilyData>> families;
+        {
+            std::shared_lock<std::shared_mutex> sl(mu_);
+            for (const auto& kv : column_families_) families.push_back(kv.second);
+        }
+        for (const auto& cfd : families) {
+            if (families.size() > 1) out += "** Column family " + cfd->name + " **\n";
+            out += CompactionStatsString(cfd.get());
+            SuperVersion* sv = cfd->AcquireSuperVersion();
+            out += "Pending compaction bytes: " + std::to_string(cfd->versions.EstimatePendingCompactionBytes(sv->current)) + "\n";
+            sv->Unref();
+        }
+        out += "Block cache usage: " + std::to_string(block_cache_.Usage()) + " / " + std::to_string(block_cache_.Capacity()) + "\n";
+        if (stats_) out += stats_->ToString();
+        out += "\n";
+        std::ofstream f(path, std::ios::app);
+        f << out;
+        lk.lock();
+    }
 }
 
 } // namespace lsmkv
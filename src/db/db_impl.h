@@ -3,19 +3,27 @@
 #include <memory>
 #include <shared_mutex>
 #include <atomic>
+#include <condition_variable>
 #include <filesystem>
+#include <thread>
+#include <map>
 #include "../../include/lsm_kv.h"
 #include "../util/options.h"
 #include "../util/slice.h"
 #include "../memtable/memtable.h"
 #include "wal.h"
 #include "version.h"
+#include "column_family.h"
+#include "db_iter.h"
 #include "../table_cache/block_cache.h"
 #include "../table_cache/sstable_cache.h"
 #include "../compaction/compaction.h"
 #include "../compaction/merger.h"
 #include "../sstable/sstable_builder.h"
 #include "../sstable/sstable_reader.h"
+#include "../blob/blob_file_builder.h"
+#include "../blob/blob_file_cache.h"
+#include "../blob/blob_garbage_meter.h"
 
 namespace lsmkv {
 
@@ -24,39 +32,152 @@ public:
     DBImpl(const Options& opt, const std::string& dbpath);
     ~DBImpl() override;
 
-    static Status OpenDB(const Options& options, const std::string& dbname, std::unique_ptr<DB>& dbptr);
+    static Status OpenDB(const Options& options, const std::string& dbname,
+                         const std::vector<ColumnFamilyDescriptor>& column_families,
+                         std::vector<ColumnFamilyHandle*>* handles, std::unique_ptr<DB>& dbptr);
 
-    Status Put(const WriteOptions& options, const Slice& key, const Slice& value) override;
-    Status Delete(const WriteOptions& options, const Slice& key) override;
-    Status Get(const ReadOptions& options, const Slice& key, std::string* value) override;
+    Status CreateColumnFamily(const Options& options, const std::string& name, ColumnFamilyHandle** handle) override;
+    Status DropColumnFamily(ColumnFamilyHandle* column_family) override;
+    ColumnFamilyHandle* DefaultColumnFamily() const override { return default_handle_; }
+
+    using DB::Put;
+    using DB::Delete;
+    using DB::Get;
+    using DB::MultiGet;
+    using DB::GetAsync;
+    using DB::NewIterator;
+    using DB::IngestExternalFile;
+    using DB::Flush;
+    using DB::GetProperty;
+    using DB::GetIntProperty;
+    Status Write(const WriteOptions& options, WriteBatch* updates) override;
+    Status Put(const WriteOptions& options, ColumnFamilyHandle* column_family, const Slice& key, const Slice& value) override;
+    Status Delete(const WriteOptions& options, ColumnFamilyHandle* column_family, const Slice& key) override;
+    Status Get(const ReadOptions& options, ColumnFamilyHandle* column_family, const Slice& key, std::string* value) override;
+    std::vector<Status> MultiGet(const ReadOptions& options, ColumnFamilyHandle* column_family,
+                                 const std::vector<Slice>& keys, std::vector<std::string>* values) override;
+    void GetAsync(const ReadOptions& options, ColumnFamilyHandle* column_family, const Slice& key, GetCallback callback) override;
+    std::unique_ptr<Iterator> NewIterator(const ReadOptions& options, ColumnFamilyHandle* column_family) override;
     Status CompactRange(const Slice& begin, const Slice& end) override;
-    Status Flush() override;
+    Status Flush(ColumnFamilyHandle* column_family) override;
+    Status IngestExternalFile(ColumnFamilyHandle* column_family, const std::vector<std::string>& files,
+                              const IngestExternalFileOptions& options) override;
+    bool GetProperty(ColumnFamilyHandle* column_family, const Slice& property, std::string* value) override;
+    bool GetIntProperty(ColumnFamilyHandle* column_family, const Slice& property, uint64_t* value) override;
+    // See Checkpoint::Create.
+    Status CreateCheckpoint(const std::string& dir);
 
 private:
-    Status RecoverWALs();
-    Status RotateMemTable();
+    static ColumnFamilyData* CFD(ColumnFamilyHandle* column_family) {
+        return static_cast<ColumnFamilyHandleImpl*>(column_family)->cfd().get();
+    }
+    Status WriteOne(const WriteOptions& options, ColumnFamilyData* cfd, const WriteBatch& batch,
+                    ValueType type, const Slice& key, const Slice& value);
+    // Creates a family's state and handle; the caller recovers or registers it.
+    ColumnFamilyData* NewColumnFamily(uint32_t id, const std::string& name, const Options& options);
+    Status RecoverWALs(std::vector<std::string>* replayed);
+    void RemoveOrphanFiles(ColumnFamilyData* cfd);
+    // Requires mu_ held exclusively.
+    Status SwitchWAL();
+    Status RotateMemTable(ColumnFamilyData* cfd);
+    Status MakeRoomForWrite(ColumnFamilyData* cfd, std::unique_lock<std::shared_mutex>& lk);
+    Status FlushOldestWALs();
+    std::vector<std::string> ObsoleteWALs();
     void MaybeScheduleCompaction();
+    void MaybeScheduleCompaction(const std::shared_ptr<ColumnFamilyData>& cfd);
+    Status WriteLevel0Table(ColumnFamilyData* cfd, const MemTable& mem, uint64_t file_number, TableFile* out,
+                            std::vector<BlobFile>* blob_files);
+    Status FlushMemTable(ColumnFamilyData* cfd, const std::shared_ptr<MemTable>& imm, uint64_t file_number, uint64_t log_number);
+    Status BackgroundCompaction(ColumnFamilyData* cfd, bool* did_work);
+    void RecordBackgroundError(const Status& s);
+    Status PrepareExternalFile(ColumnFamilyData* cfd, const std::string& src, const IngestExternalFileOptions& options, TableFile* out);
+    Status DoCompactionWork(ColumnFamilyData* cfd, Compaction* c);
+
+    // One key range of a compaction, merged on its own thread.
+    struct SubcompactionState {
+        bool has_begin = false, has_end = false;
+        std::string begin, end; // [begin, end)
+        Status status;
+        std::vector<TableFile> outputs;
+        std::vector<BlobFile> blob_outputs;
+        std::vector<std::string> paths; // every file created, for cleanup on failure
+        BlobGarbageMeter blob_meter;
+    };
+    std::vector<std::string> SubcompactionBoundaries(ColumnFamilyData* cfd, Compaction* c);
+    // blob_gc_cutoff: blobs in files numbered below it are relocated (0 = none).
+    void RunSubcompaction(ColumnFamilyData* cfd, Compaction* c, SubcompactionState* sub, uint64_t newest_data,
+                          bool count_blobs, uint64_t blob_gc_cutoff);
+    void DeleteObsoleteFile(const TableFile& f);
+
+    // Blob files written by a flush (high priority I/O) or compaction (low);
+    // null when key-value separation is off.
+    std::unique_ptr<BlobFileBuilder> NewBlobFileBuilder(ColumnFamilyData* cfd, RateLimiter::Priority pri);
+    // Reads the value a kTypeBlobIndex entry points at.
+    Status GetBlob(ColumnFamilyData* cfd, const ReadOptions& options, const Slice& blob_index, std::string* value);
+
+    std::string LevelStatsString(ColumnFamilyData* cfd);
+    std::string CompactionStatsString(ColumnFamilyData* cfd);
+    void StatsDumpLoop();
+
+    // A GetAsync that had to go to disk; owns its pinned SuperVersion until it completes.
+    struct AsyncGet {
+        ReadOptions options;
+        ColumnFamilyData* cfd = nullptr;
+        std::string key;
+        GetCallback callback;
+        SuperVersion* sv = nullptr;
+        std::vector<const TableFile*> tables; // candidates in Get's probe order
+        size_t next = 0;
+        SSTableCache::Handle table;
+        int block = -1;
+        std::string data;
+        TableRead read;
+        bool on_caller = true; // still on the thread that called GetAsync, which must not do I/O
+    };
+    void ContinueGetAsync(AsyncGet* g);
+    void OnGetAsyncBlock(AsyncGet* g);
+    void FinishGetAsync(AsyncGet* g, const Status& s, std::string&& value);
+    void FinishGetAsyncFound(AsyncGet* g, MemValue&& res);
 
-    std::string L0FilePath(uint64_t number) const { return db_path_ + "/L0-" + std::to_string(number) + ".sst"; }
     std::string WALFilePath(uint64_t number) const { return db_path_ + "/wal-" + std::to_string(number) + ".log"; }
 
     Options options_;
     std::string db_path_;
+    Statistics* stats_; // options_.statistics, or null
 
     mutable std::shared_mutex mu_;
-    std::unique_ptr<MemTable> mem_;
-    std::unique_ptr<MemTable> imm_;
+    // Live families by id, guarded by mu_. Handles (and with them the state
+    // of dropped families) live until the DB is destroyed.
+    std::map<uint32_t, std::shared_ptr<ColumnFamilyData>> column_families_;
+    std::vector<std::unique_ptr<ColumnFamilyHandleImpl>> handles_;
+    ColumnFamilyData* default_cf_ = nullptr; // its VersionSet numbers the WALs and lists the other families
+    ColumnFamilyHandle* default_handle_ = nullptr;
 
     std::unique_ptr<WALWriter> wal_;
     uint64_t wal_number_ = 0;
+    // Closed WALs some family has not flushed yet, oldest first: (number, size). Guarded by mu_.
+    std::vector<std::pair<uint64_t, uint64_t>> old_wals_;
+    int file_deletions_paused_ = 0; // checkpoints in progress; no WAL is deleted meanwhile. Guarded by mu_.
 
-    VersionSet versions_;
     BlockCache block_cache_;
     SSTableCache table_cache_;
 
+    // First failed flush/compaction; once set, writes fail with it. Guarded by mu_.
+    Status bg_error_;
+    std::condition_variable_any bg_cv_; // signalled with mu_ when an imm is flushed or bg_error_ is set
+
     CompactionManager bg_;
 
+    std::atomic<int> bg_compactions_scheduled_{0};
+    std::mutex async_mu_;
+    std::condition_variable async_cv_;
+    int async_gets_ = 0; // GetAsync calls waiting on disk; the destructor waits for them
     std::atomic<bool> shutting_down_{false};
+
+    std::mutex dump_mu_;
+    std::condition_variable dump_cv_;
+    bool stop_dump_ = false;
+    std::thread dump_thread_;
 };
 
 } // namespace lsmkv
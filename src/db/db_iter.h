@@ -0,0 +1,143 @@
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../../include/lsm_kv.h"
+#include "../util/iterator.h"
+#include "../memtable/memtable.h"
+#include "../table_cache/sstable_cache.h"
+#include "../compaction/merger.h"
+#include "version.h"
+
+namespace lsmkv {
+
+// Iterates a copy of a memtable taken when the DB iterator was created.
+class MemTableIterator final : public InternalIterator {
+public:
+    MemTableIterator(const Comparator* cmp, std::vector<MemTable::IterKV>&& kvs) : cmp_(cmp), kvs_(std::move(kvs)), pos_(kvs_.size()) {}
+
+    bool Valid() const override { return pos_ < kvs_.size(); }
+    void SeekToFirst() override { pos_ = 0; }
+    void Seek(const Slice& target) override {
+        pos_ = std::lower_bound(kvs_.begin(), kvs_.end(), target,
+                                [this](const MemTable::IterKV& kv, const Slice& t){ return cmp_.Less(kv.key, t); }) - kvs_.begin();
+    }
+    void Next() override { ++pos_; }
+    Slice key() const override { return Slice(kvs_[pos_].key); }
+    Slice value() const override { return Slice(kvs_[pos_].value.value); }
+    ValueType type() const override { return kvs_[pos_].value.type; }
+
+private:
+    UserKeyComparator cmp_;
+    std::vector<MemTable::IterKV> kvs_;
+    size_t pos_;
+};
+
+// Concatenates the files of one sorted run (an L1+ level, or a single L0
+// file), opening each through the table cache only when the scan reaches it.
+class LevelIterator final : public InternalIterator {
+public:
+    LevelIterator(SSTableCache* cache, const Comparator* cmp, std::vector<TableFileRef> files, size_t readahead_size = 0)
+        : cache_(cache), cmp_(cmp), files_(std::move(files)), readahead_size_(readahead_size) {}
+
+    bool Valid() const override { return it_ && it_->Valid(); }
+
+    void SeekToFirst() override {
+        Open(0);
+        if (it_) it_->SeekToFirst();
+        SkipEmptyFiles();
+    }
+
+    void Seek(const Slice& target) override {
+        size_t i = std::lower_bound(files_.begin(), files_.end(), target,
+                                    [this](const TableFileRef& f, const Slice& t){ return cmp_.Less(f->largest, t); }) - files_.begin();
+        Open(i);
+        if (it_) it_->Seek(target);
+        SkipEmptyFiles();
+    }
+
+    void Next() override {
+        it_->Next();
+        SkipEmptyFiles();
+    }
+
+    Slice key() const override { return it_->key(); }
+    Slice value() const override { return it_->value(); }
+    ValueType type() const override { return it_->type(); }
+    Status status() const override {
+        if (!status_.ok()) return status_;
+        return it_ ? it_->status() : Status::OK();
+    }
+
+private:
+    void Open(size_t index) {
+        it_.reset();
+        table_.reset();
+        index_ = index;
+        if (index_ >= files_.size()) return;
+        status_ = cache_->Get(files_[index_]->path, &table_, cmp_.comparator());
+        if (status_.ok()) it_ = table_->NewIterator(nullptr, false, readahead_size_);
+    }
+
+    void SkipEmptyFiles() {
+        while (it_ && !it_->Valid() && it_->status().ok()) {
+            Open(index_ + 1);
+            if (it_) it_->SeekToFirst();
+        }
+    }
+
+    SSTableCache* cache_;
+    UserKeyComparator cmp_;
+    std::vector<TableFileRef> files_;
+    size_t readahead_size_;
+    size_t index_ = 0;
+    SSTableCache::Handle table_;
+    std::unique_ptr<SSTableReader::Iterator> it_;
+    Status status_;
+};
+
+// User-facing iterator: the newest entry of each key, with deletions hidden.
+// A value kept in a blob file is read through fetch_blob on the first value()
+// call at that position, so key-only scans never touch blob files.
+class DBIter final : public Iterator {
+public:
+    using BlobFetcher = std::function<Status(const Slice& blob_index, std::string* value)>;
+
+    explicit DBIter(std::unique_ptr<MergingIterator> it, BlobFetcher fetch_blob = nullptr)
+        : it_(std::move(it)), fetch_blob_(std::move(fetch_blob)) {}
+
+    bool Valid() const override { return it_->Valid(); }
+    void SeekToFirst() override { it_->SeekToFirst(); SkipDeletions(); }
+    void Seek(const Slice& target) override { it_->Seek(target); SkipDeletions(); }
+    void Next() override { it_->Next(); SkipDeletions(); }
+    Slice key() const override { return it_->key(); }
+    Slice value() const override {
+        if (it_->type() != kTypeBlobIndex) return it_->value();
+        if (!blob_loaded_) {
+            blob_status_ = fetch_blob_ ? fetch_blob_(it_->value(), &blob_value_) : Status::Corruption("blob index without blob files");
+            if (!blob_status_.ok()) blob_value_.clear();
+            blob_loaded_ = true;
+        }
+        return Slice(blob_value_);
+    }
+    Status status() const override {
+        if (!blob_status_.ok()) return blob_status_;
+        return it_->status();
+    }
+
+private:
+    void SkipDeletions() {
+        while (it_->Valid() && it_->type() == kTypeDeletion) it_->Next();
+        blob_loaded_ = false;
+    }
+
+    std::unique_ptr<MergingIterator> it_;
+    BlobFetcher fetch_blob_;
+    mutable bool blob_loaded_ = false;
+    mutable std::string blob_value_;
+    mutable Status blob_status_; // sticky: the first failed blob read
+};
+
+} // namespace lsmkv
@@ -2,44 +2,226 @@
 #include <vector>
 #include <string>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
 #include <algorithm>
 #include <filesystem>
 #include <optional>
+#include <map>
+#include <set>
+#include <fstream>
 #include "../util/slice.h"
 #include "../util/status.h"
+#include "../util/options.h"
+#include "../util/clock.h"
+#include "version_edit.h"
+#include "wal.h"
+#include "../compaction/compaction.h"
 #include "../sstable/sstable_builder.h"
 #include "../sstable/sstable_reader.h"
 
 namespace lsmkv {
 
-struct TableFile {
-    int level;
-    uint64_t number;
-    std::string path;
-    std::string smallest;
-    std::string largest;
-    uint64_t size;
+using TableFileRef = std::shared_ptr<TableFile>;
+using BlobFileRef = std::shared_ptr<BlobFile>;
+
+// A live blob file and how much of it compactions had stopped referencing as of one Version.
+struct BlobFileState {
+    BlobFileRef file;
+    uint64_t garbage_count = 0;
+    uint64_t garbage_bytes = 0;
+};
+
+// Immutable list of live files per level. Readers hold a reference while they
+// look up candidates, so the lookup itself needs no lock and no allocation.
+class Version {
+public:
+    Version(int num_levels, const Comparator* cmp) : cmp_(cmp), files_(num_levels) {}
+
+    void Ref() { refs_.fetch_add(1, std::memory_order_relaxed); }
+    void Unref() { if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this; }
+
+    int NumLevels() const { return (int)files_.size(); }
+    const std::vector<TableFileRef>& files(int level) const { return files_[level]; }
+    uint64_t LevelBytes(int level) const {
+        uint64_t n = 0;
+        for (const auto& f : files_[level]) n += f->size;
+        return n;
+    }
+    // Leveled compaction score of a level (>= 1 means it is due); 0 for other styles.
+    double Score(int level) const { return level < (int)scores_.size() ? scores_[level] : 0; }
+    // Blob files by number; a Version keeps the files its tables point into alive.
+    const std::map<uint64_t, BlobFileState>& blob_files() const { return blob_files_; }
+
+    // Calls fn(const TableFile&) for every file that may contain key, newest first.
+    // Stops early when fn returns false.
+    template <typename Fn>
+    void ForEachCandidate(const Slice& key, Fn&& fn) const {
+        for (const auto& f : files_[0]) {
+            if (cmp_(key, f->smallest) >= 0 && cmp_(key, f->largest) <= 0) {
+                if (!fn(*f)) return;
+            }
+        }
+        for (int l=1; l<(int)files_.size(); ++l) {
+            const auto& v = files_[l];
+            int lo=0, hi=(int)v.size()-1, idx=-1;
+            while (lo<=hi) {
+                int mid=(lo+hi)/2;
+                if (cmp_(v[mid]->smallest, key) <=0 && cmp_(v[mid]->largest, key)>=0) { idx=mid; break; }
+                if (cmp_(v[mid]->smallest, key) > 0) hi=mid-1; else lo=mid+1;
+            }
+            if (idx>=0 && !fn(*v[idx])) return;
+        }
+    }
+
+private:
+    friend class VersionSet;
+    ~Version() = default;
+
+    std::atomic<int> refs_{0};
+    UserKeyComparator cmp_;
+    std::vector<std::vector<TableFileRef>> files_;
+    std::map<uint64_t, BlobFileState> blob_files_;
+    // Level most in need of compaction and its score (>= 1 means compact), set by VersionSet::Finalize.
+    int compaction_level_ = -1;
+    double compaction_score_ = -1;
+    std::vector<double> scores_; // leveled: score per level that can compact into a next one
 };
 
 class VersionSet {
 public:
-    explicit VersionSet(int num_levels) : levels_(num_levels) {}
+    // Invoked once a removed file is no longer referenced by any Version.
+    using FileDeleter = std::function<void(const TableFile&)>;
+    using BlobFileDeleter = std::function<void(const BlobFile&)>;
+
+    VersionSet(const std::string& dbpath, const Options& options)
+        : dbpath_(dbpath), options_(options), cmp_(options.comparator), num_levels_(options.num_levels),
+          compact_pointer_(options.num_levels) {
+        current_ = new Version(num_levels_, options_.comparator);
+        current_->Ref();
+    }
+    ~VersionSet() { current_->Unref(); }
 
-    void AddFile(const TableFile& f) {
+    VersionSet(const VersionSet&) = delete;
+    VersionSet& operator=(const VersionSet&) = delete;
+
+    void SetFileDeleter(FileDeleter d) {
         std::lock_guard<std::mutex> lg(mu_);
-        levels_[f.level].push_back(f);
-        if (f.level == 0) {
-            std::sort(levels_[0].begin(), levels_[0].end(), [](const TableFile& a, const TableFile& b){ return a.number > b.number; });
-        } else {
-            std::sort(levels_[f.level].begin(), levels_[f.level].end(), [](const TableFile& a, const TableFile& b){ return a.smallest < b.smallest; });
+        deleter_ = std::move(d);
+    }
+
+    void SetBlobFileDeleter(BlobFileDeleter d) {
+        std::lock_guard<std::mutex> lg(mu_);
+        blob_deleter_ = std::move(d);
+    }
+
+    // Replays CURRENT -> MANIFEST. *found is false for a directory without a MANIFEST.
+    Status Recover(bool* found) {
+        std::lock_guard<std::mutex> lg(mu_);
+        namespace fs = std::filesystem;
+        *found = false;
+        std::ifstream cur(CurrentFilePath());
+        if (!cur.good()) return Status::OK();
+        std::string name;
+        std::getline(cur, name);
+        if (name.rfind("MANIFEST-", 0) != 0) return Status::Corruption("bad CURRENT file");
+        std::unique_ptr<WALReader> r;
+        Status s = WALReader::Open(dbpath_ + "/" + name, r);
+        if (!s.ok()) return s;
+
+        std::map<uint64_t, TableFile> live;
+        std::map<uint64_t, BlobFile> blobs;
+        std::map<uint64_t, BlobFileGarbage> garbage;
+        std::string comparator = BytewiseComparator()->Name(); // MANIFESTs from before it was recorded
+        uint8_t type; std::string key, value;
+        while (r->ReadRecord(&type, key, value)) {
+            if (type != kTypeVersionEdit) return Status::Corruption("unexpected MANIFEST record");
+            VersionEdit edit;
+            s = edit.DecodeFrom(Slice(value), dbpath_);
+            if (!s.ok()) return s;
+            if (edit.has_comparator) comparator = edit.comparator;
+            if (edit.has_log_number) log_number_ = edit.log_number;
+            if (edit.has_next_file_number) max_number_ = std::max(max_number_, edit.next_file_number - 1);
+            for (const auto& cp : edit.compact_pointers) {
+                if (cp.first >= 0 && cp.first < num_levels_) compact_pointer_[cp.first] = cp.second;
+            }
+            s = CheckEditLevels(edit);
+            if (!s.ok()) return s;
+            for (const auto& d : edit.deleted_files) live.erase(d.second);
+            for (const auto& f : edit.new_files) live[f.number] = f;
+            for (const auto& b : edit.new_blob_files) blobs[b.number] = b;
+            for (const auto& g : edit.blob_garbage) {
+                BlobFileGarbage& t = garbage[g.number];
+                t.count += g.count;
+                t.bytes += g.bytes;
+            }
+            ApplyColumnFamilies(edit);
+        }
+        if (comparator != options_.comparator->Name()) {
+            return Status::InvalidArgument("comparator " + std::string(options_.comparator->Name()) + " does not match " + comparator + " the DB was created with");
+        }
+        max_number_ = std::max<uint64_t>(max_number_, std::stoull(name.substr(9)));
+
+        Version* v = new Version(num_levels_, options_.comparator);
+        for (const auto& kv : live) {
+            v->files_[kv.second.level].push_back(NewFileRef(kv.second));
+            max_number_ = std::max(max_number_, kv.first);
         }
-        max_number_ = std::max(max_number_, f.number);
+        for (const auto& kv : blobs) {
+            max_number_ = std::max(max_number_, kv.first);
+            BlobFileState st;
+            st.file = NewBlobFileRef(kv.second);
+            auto g = garbage.find(kv.first);
+            if (g != garbage.end()) { st.garbage_count = g->second.count; st.garbage_bytes = g->second.bytes; }
+            if (st.garbage_count < kv.second.total_count) v->blob_files_[kv.first] = st;
+        }
+        SortLevels(v);
+        Finalize(v);
+        Install(v);
+        *found = true;
+        return Status::OK();
+    }
+
+    // Appends edit to the MANIFEST, then builds a new Version from current + edit
+    // and installs it. Readers holding the old Version keep seeing it until they
+    // release it. A fresh MANIFEST holding a full snapshot is started on first use
+    // and whenever the current one outgrows options.max_manifest_file_size.
+    Status LogAndApply(VersionEdit& edit) {
+        std::lock_guard<std::mutex> lg(mu_);
+        return LogAndApplyLocked(edit);
     }
 
-    void RemoveFile(int level, uint64_t number) {
+    // Adds externally built files staged at files[i].path. Each goes to the
+    // deepest level that neither it nor any level above overlaps, counting
+    // outputs of running compactions, so every older version of its keys stays
+    // below it. FIFO keeps all files in L0. The file number is taken here, so
+    // an L0 file sorts newer than any compaction output picked before it, and
+    // the file is renamed to match; files[i] is updated accordingly.
+    Status AddExternalFiles(std::vector<TableFile>* files) {
         std::lock_guard<std::mutex> lg(mu_);
-        auto& v = levels_[level];
-        v.erase(std::remove_if(v.begin(), v.end(), [&](const TableFile& t){ return t.number == number; }), v.end());
+        VersionEdit edit;
+        for (auto& f : *files) {
+            f.level = 0;
+            if (options_.compaction_style != kCompactionStyleFIFO) {
+                for (int l=0; l<num_levels_ && !LevelOverlaps(l, f.smallest, f.largest); ++l) f.level = l;
+            }
+            f.number = ++max_number_;
+            std::string path = dbpath_ + "/L" + std::to_string(f.level) + "-" + std::to_string(f.number) + ".sst";
+            std::error_code ec;
+            std::filesystem::rename(f.path, path, ec);
+            if (ec) return Status::IOError("rename " + f.path + ": " + ec.message());
+            f.path = path;
+            edit.AddFile(f);
+        }
+        return LogAndApplyLocked(edit);
+    }
+
+    // Returns the current Version with a reference the caller must Unref().
+    Version* current() {
+        std::lock_guard<std::mutex> lg(mu_);
+        current_->Ref();
+        return current_;
     }
 
     uint64_t NextFileNumber() {
@@ -47,54 +229,152 @@ public:
         return ++max_number_;
     }
 
-    std::optional<int> PickCompactionLevel() {
+    void MarkFileNumberUsed(uint64_t number) {
         std::lock_guard<std::mutex> lg(mu_);
-        if (levels_[0].size() > 4) return 0;
-        return std::nullopt;
+        max_number_ = std::max(max_number_, number);
     }
 
-    std::vector<TableFile> FilesInLevel(int l) const {
+    uint64_t LogNumber() const {
         std::lock_guard<std::mutex> lg(mu_);
-        return levels_[l];
+        return log_number_;
     }
 
-    void PickCompactionInputs(int level, std::vector<TableFile>& level_files, std::vector<TableFile>& next_level_files) {
+    std::set<uint64_t> LiveFileNumbers() const {
         std::lock_guard<std::mutex> lg(mu_);
-        level_files = levels_[level];
-        next_level_files.clear();
-        if (level+1 >= (int)levels_.size()) return;
-        std::string smallest, largest;
-        if (!level_files.empty()) {
-            smallest = level_files.front().smallest;
-            largest = level_files.back().largest;
-            for (auto& f : levels_[level+1]) {
-                if (!(f.largest < smallest || f.smallest > largest)) next_level_files.push_back(f);
-            }
+        std::set<uint64_t> out;
+        for (const auto& level : current_->files_) for (const auto& f : level) out.insert(f->number);
+        for (const auto& kv : current_->blob_files_) out.insert(kv.first);
+        return out;
+    }
+
+    // Column families other than the default one, by id. Only the default
+    // family's VersionSet records them (VersionEdit::AddColumnFamily).
+    std::map<uint32_t, std::string> ColumnFamilies() const {
+        std::lock_guard<std::mutex> lg(mu_);
+        return column_families_;
+    }
+
+    // Ids of dropped families are only reused after a restart, once the WALs
+    // that could hold their records have been replayed and deleted.
+    uint32_t NextColumnFamilyId() {
+        std::lock_guard<std::mutex> lg(mu_);
+        return ++max_column_family_;
+    }
+
+    // The current Version, with a reference the caller must Unref() (its files
+    // are not deleted until then), and in edit the state it describes.
+    Version* Snapshot(VersionEdit* edit) const {
+        std::lock_guard<std::mutex> lg(mu_);
+        SnapshotEdit(current_, log_number_, edit);
+        current_->Ref();
+        return current_;
+    }
+
+    // Starts a MANIFEST-<number> in dir holding only edit (usually a Snapshot)
+    // and points dir/CURRENT at it; a VersionSet on dir recovers that state.
+    static Status WriteManifest(const std::string& dir, uint64_t number, const VersionEdit& edit) {
+        std::string path = dir + "/MANIFEST-" + std::to_string(number);
+        std::unique_ptr<WALWriter> w;
+        Status s = WALWriter::Open(path, w);
+        if (!s.ok()) return s;
+        std::string rec;
+        edit.EncodeTo(rec);
+        s = w->AddRecord(kTypeVersionEdit, Slice(""), Slice(rec), true);
+        w.reset();
+        if (s.ok()) s = SetCurrentFile(dir, number);
+        return s;
+    }
+
+    uint64_t ManifestNumber() const {
+        std::lock_guard<std::mutex> lg(mu_);
+        return manifest_number_;
+    }
+
+    bool NeedsCompaction() const {
+        std::lock_guard<std::mutex> lg(mu_);
+        if (options_.compaction_style == kCompactionStyleFIFO) return !FIFOVictims(current_).empty();
+        return current_->compaction_score_ >= 1;
+    }
+
+    // Returns the next compaction for the configured style, or nullptr if nothing is due.
+    // flush_pending: a memtable is being flushed; its L0 file will be newer than
+    // anything in the current Version (see PickUniversalCompaction).
+    std::unique_ptr<Compaction> PickCompaction(bool flush_pending = false) {
+        std::lock_guard<std::mutex> lg(mu_);
+        Version* v = current_;
+        std::unique_ptr<Compaction> c;
+        if (options_.compaction_style == kCompactionStyleLevel) {
+            if (v->compaction_score_ < 1) return nullptr;
+            c = PickLevelCompaction(v);
+        } else {
+            // Universal and FIFO pick from a global view of the runs: one job at a time.
+            if (!running_.empty()) return nullptr;
+            if (options_.compaction_style == kCompactionStyleFIFO) c = PickFIFOCompaction(v);
+            else if (v->compaction_score_ >= 1) c = PickUniversalCompaction(v, flush_pending);
         }
+        if (!c) return nullptr;
+        c->cmp = cmp_;
+        for (int which=0; which<2; ++which) {
+            for (const auto& f : c->inputs[which]) being_compacted_.insert(f.number);
+        }
+        running_.push_back(c.get());
+        return c;
     }
 
-    void GetCandidateFiles(const Slice& key, std::vector<TableFile>& out_ordered) const {
+    // Must be called once a picked compaction finished, whether or not it succeeded.
+    void ReleaseCompaction(Compaction* c) {
         std::lock_guard<std::mutex> lg(mu_);
-        out_ordered.clear();
-        for (auto& f : levels_[0]) {
-            if (key.compare(Slice(f.smallest)) >= 0 && key.compare(Slice(f.largest)) <= 0) out_ordered.push_back(f);
+        for (int which=0; which<2; ++which) {
+            for (const auto& f : c->inputs[which]) being_compacted_.erase(f.number);
         }
-        for (int l=1; l<(int)levels_.size(); ++l) {
-            const auto& v = levels_[l];
-            int lo=0, hi=(int)v.size()-1, idx=-1;
-            while (lo<=hi) {
-                int mid=(lo+hi)/2;
-                if (Slice(v[mid].smallest).compare(key) <=0 && Slice(v[mid].largest).compare(key)>=0) { idx=mid; break; }
-                if (Slice(v[mid].smallest).compare(key) > 0) hi=mid-1; else lo=mid+1;
-            }
-            if (idx>=0) out_ordered.push_back(v[idx]);
+        running_.erase(std::remove(running_.begin(), running_.end(), c), running_.end());
+    }
+
+    // Bytes compactions must rewrite to bring every level back under its
+    // target. Leveled: an L0 over its trigger is merged with all of L1; a
+    // level's excess over its target costs its size plus its share of the
+    // next level (excess * (fanout + 1)) and flows into that level.
+    // Universal: every run once a merge is due. FIFO: bytes over the size cap.
+    uint64_t EstimatePendingCompactionBytes(const Version* v) const {
+        uint64_t total = 0;
+        for (int l=0; l<v->NumLevels(); ++l) total += v->LevelBytes(l);
+        if (options_.compaction_style == kCompactionStyleFIFO) {
+            uint64_t cap = options_.compaction_options_fifo.max_table_files_size;
+            return total > cap ? total - cap : 0;
+        }
+        if (options_.compaction_style == kCompactionStyleUniversal) return v->compaction_score_ >= 1 ? total : 0;
+        uint64_t pending = 0, inflow = 0;
+        if ((int)v->files(0).size() >= options_.level0_file_num_compaction_trigger) {
+            inflow = v->LevelBytes(0);
+            pending += inflow + (num_levels_ > 1 ? v->LevelBytes(1) : 0);
+        }
+        for (int l=1; l<num_levels_-1; ++l) {
+            uint64_t bytes = v->LevelBytes(l) + inflow;
+            double target = MaxBytesForLevel(l);
+            inflow = 0;
+            if (bytes <= target) continue;
+            uint64_t excess = bytes - (uint64_t)target;
+            double fanout = (double)v->LevelBytes(l + 1) / (double)bytes;
+            pending += (uint64_t)(excess * (fanout + 1));
+            inflow = excess;
         }
+        return pending;
     }
 
+    std::vector<TableFile> FilesInLevel(int l) const {
+        std::lock_guard<std::mutex> lg(mu_);
+        std::vector<TableFile> out;
+        for (const auto& f : current_->files_[l]) out.push_back(*f);
+        return out;
+    }
+
+    // Builds the initial Version by opening every L<level>-<number>.sst in dir.
+    // Only used to import a directory written before the MANIFEST existed.
     void LoadFromDir(const std::string& dir) {
         std::lock_guard<std::mutex> lg(mu_);
         namespace fs = std::filesystem;
         if (!fs::exists(dir)) return;
+        Version* v = new Version(num_levels_, options_.comparator);
         for (auto& p : fs::directory_iterator(dir)) {
             if (!p.is_regular_file()) continue;
             auto filename = p.path().filename().string();
@@ -105,29 +385,528 @@ public:
             if (dash == std::string::npos || dot == std::string::npos) continue;
             int level = std::stoi(filename.substr(1, dash-1));
             uint64_t number = std::stoull(filename.substr(dash+1, dot - (dash+1)));
+            if (level < 0 || level >= num_levels_) continue;
             std::shared_ptr<SSTableReader> r;
-            Status s = SSTableReader::Open(p.path().string(), &r);
+            Status s = SSTableReader::Open(p.path().string(), &r, false, options_.comparator);
             if (!s.ok()) continue;
             const auto& idx = r->index();
             if (idx.entries().empty()) continue;
             std::string smallest = idx.entries().front().key;
-            std::string largest = idx.entries().back().key;
+            std::string largest;
+            if (!r->LastKey(&largest).ok()) continue;
             uint64_t sz = std::filesystem::file_size(p.path());
-            levels_[level].push_back(TableFile{level, number, p.path().string(), smallest, largest, sz});
+            v->files_[level].push_back(NewFileRef(TableFile{level, number, p.path().string(), smallest, largest, sz, NowSeconds()}));
             max_number_ = std::max(max_number_, number);
         }
-        if (!levels_[0].empty()) {
-            std::sort(levels_[0].begin(), levels_[0].end(), [](const TableFile& a, const TableFile& b){ return a.number > b.number; });
+        SortLevels(v);
+        Finalize(v);
+        Install(v);
+    }
+
+private:
+    std::string CurrentFilePath() const { return dbpath_ + "/CURRENT"; }
+    std::string ManifestFilePath(uint64_t number) const { return dbpath_ + "/MANIFEST-" + std::to_string(number); }
+
+    // Levels in an edit index files_; one decoded from a MANIFEST written with
+    // more levels than options.num_levels must not be trusted.
+    Status CheckEditLevels(const VersionEdit& edit) const {
+        for (const auto& d : edit.deleted_files) {
+            if (d.first < 0 || d.first >= num_levels_) return Status::Corruption("file level out of range");
         }
-        for (int l=1; l<(int)levels_.size(); ++l) {
-            std::sort(levels_[l].begin(), levels_[l].end(), [](const TableFile& a, const TableFile& b){ return a.smallest < b.smallest; });
+        for (const auto& f : edit.new_files) {
+            if (f.level < 0 || f.level >= num_levels_) return Status::Corruption("file level out of range");
+        }
+        return Status::OK();
+    }
+
+    // Requires mu_.
+    Status LogAndApplyLocked(VersionEdit& edit) {
+        Status ls = CheckEditLevels(edit);
+        if (!ls.ok()) return ls;
+        Version* v = new Version(num_levels_, options_.comparator);
+        for (int l=0; l<num_levels_; ++l) {
+            for (const auto& f : current_->files_[l]) {
+                bool deleted = false;
+                for (const auto& d : edit.deleted_files) {
+                    if (d.first == l && d.second == f->number) { deleted = true; break; }
+                }
+                if (!deleted) v->files_[l].push_back(f);
+            }
+        }
+        for (const auto& nf : edit.new_files) {
+            v->files_[nf.level].push_back(NewFileRef(nf));
+            max_number_ = std::max(max_number_, nf.number);
+        }
+        // A blob file leaves the Version once all of its blobs are garbage.
+        v->blob_files_ = current_->blob_files_;
+        for (const auto& b : edit.new_blob_files) {
+            v->blob_files_[b.number] = BlobFileState{NewBlobFileRef(b)};
+            max_number_ = std::max(max_number_, b.number);
+        }
+        std::vector<BlobFileRef> dropped_blobs;
+        for (const auto& g : edit.blob_garbage) {
+            auto it = v->blob_files_.find(g.number);
+            if (it == v->blob_files_.end()) continue;
+            it->second.garbage_count += g.count;
+            it->second.garbage_bytes += g.bytes;
+            if (it->second.garbage_count >= it->second.file->total_count) {
+                dropped_blobs.push_back(it->second.file);
+                v->blob_files_.erase(it);
+            }
+        }
+        SortLevels(v);
+        Finalize(v);
+        uint64_t log_number = edit.has_log_number ? edit.log_number : log_number_;
+
+        // Tables and blob files the edit adds were created (or renamed) in
+        // dbpath_; their directory entries must be durable before the MANIFEST
+        // names them. A file the edit also removes is only changing level.
+        bool created = !edit.new_blob_files.empty();
+        for (const auto& nf : edit.new_files) {
+            bool moved = false;
+            for (const auto& d : edit.deleted_files) moved |= d.second == nf.number;
+            created |= !moved;
+        }
+        Status s;
+#if !defined(_WIN32)
+        if (created) s = FsyncPath(dbpath_);
+#endif
+        if (!s.ok()) { delete v; return s; }
+        if (!manifest_ || manifest_->size() >= options_.max_manifest_file_size) {
+            // The snapshot records the compact pointers this edit moves.
+            std::vector<std::string> saved_pointers = compact_pointer_;
+            for (const auto& cp : edit.compact_pointers) compact_pointer_[cp.first] = cp.second;
+            s = WriteNewManifest(v, log_number);
+            if (!s.ok()) compact_pointer_ = std::move(saved_pointers);
+        } else {
+            edit.SetNextFileNumber(max_number_ + 1);
+            std::string rec;
+            edit.EncodeTo(rec);
+            s = manifest_->AddRecord(kTypeVersionEdit, Slice(""), Slice(rec), true);
+        }
+        if (!s.ok()) { delete v; return s; }
+
+        // A file removed and re-added by the same edit was moved to another level; keep it.
+        std::set<uint64_t> moved;
+        for (const auto& nf : edit.new_files) moved.insert(nf.number);
+        for (int l=0; l<num_levels_; ++l) {
+            for (const auto& f : current_->files_[l]) {
+                for (const auto& d : edit.deleted_files) {
+                    if (d.first == l && d.second == f->number && !moved.count(f->number)) f->obsolete = true;
+                }
+            }
+        }
+        for (const auto& b : dropped_blobs) b->obsolete = true;
+        ApplyColumnFamilies(edit);
+        for (const auto& cp : edit.compact_pointers) compact_pointer_[cp.first] = cp.second;
+        log_number_ = log_number;
+        Install(v);
+        return Status::OK();
+    }
+
+
+    void ApplyColumnFamilies(const VersionEdit& edit) {
+        for (const auto& cf : edit.added_column_families) {
+            column_families_[cf.first] = cf.second;
+            max_column_family_ = std::max(max_column_family_, cf.first);
+        }
+        for (uint32_t id : edit.dropped_column_families) column_families_.erase(id);
+    }
+
+    // [a_smallest, a_largest] and [b_smallest, b_largest] share keys.
+    bool Overlaps(const std::string& a_smallest, const std::string& a_largest,
+                  const std::string& b_smallest, const std::string& b_largest) const {
+        return !(cmp_.Less(a_largest, b_smallest) || cmp_.Less(b_largest, a_smallest));
+    }
+
+    bool LevelOverlaps(int level, const std::string& smallest, const std::string& largest) const {
+        for (const auto& f : current_->files_[level]) {
+            if (Overlaps(f->smallest, f->largest, smallest, largest)) return true;
+        }
+        for (const Compaction* r : running_) {
+            if (r->output_level == level && Overlaps(r->smallest, r->largest, smallest, largest)) return true;
+        }
+        return false;
+    }
+
+    // Writes a snapshot of v into a new MANIFEST, points CURRENT at it and drops the old one.
+    Status WriteNewManifest(Version* v, uint64_t log_number) {
+        namespace fs = std::filesystem;
+        uint64_t number = ++max_number_;
+        std::string path = ManifestFilePath(number);
+        std::unique_ptr<WALWriter> w;
+        Status s = WALWriter::Open(path, w);
+        if (!s.ok()) return s;
+
+        VersionEdit snap;
+        SnapshotEdit(v, log_number, &snap);
+        std::string rec;
+        snap.EncodeTo(rec);
+        s = w->AddRecord(kTypeVersionEdit, Slice(""), Slice(rec), true);
+        if (s.ok()) s = SetCurrentFile(dbpath_, number);
+        if (!s.ok()) { w.reset(); std::error_code ec; fs::remove(path, ec); return s; }
+
+        if (manifest_) {
+            std::string old = manifest_->path();
+            manifest_.reset();
+            std::error_code ec;
+            fs::remove(old, ec);
+        }
+        manifest_ = std::move(w);
+        manifest_number_ = number;
+        return Status::OK();
+    }
+
+    // The whole state of v as one edit: what a new MANIFEST starts with.
+    void SnapshotEdit(Version* v, uint64_t log_number, VersionEdit* snap) const {
+        snap->SetComparatorName(options_.comparator->Name());
+        snap->SetLogNumber(log_number);
+        snap->SetNextFileNumber(max_number_ + 1);
+        for (int l=0; l<num_levels_; ++l) {
+            if (!compact_pointer_[l].empty()) snap->SetCompactPointer(l, compact_pointer_[l]);
+        }
+        for (const auto& level : v->files_) for (const auto& f : level) snap->AddFile(*f);
+        for (const auto& kv : v->blob_files_) {
+            snap->AddBlobFile(*kv.second.file);
+            if (kv.second.garbage_count) snap->AddBlobGarbage(kv.first, kv.second.garbage_count, kv.second.garbage_bytes);
+        }
+        for (const auto& cf : column_families_) snap->AddColumnFamily(cf.first, cf.second);
+    }
+
+    static Status SetCurrentFile(const std::string& dir, uint64_t manifest_number) {
+        std::string tmp = dir + "/CURRENT.tmp";
+        {
+            std::ofstream ofs(tmp, std::ios::binary | std::ios::out | std::ios::trunc);
+            ofs << "MANIFEST-" << manifest_number << "\n";
+            ofs.flush();
+            if (!ofs.good()) return Status::IOError("write CURRENT.tmp failed");
+        }
+        Status s = FsyncPath(tmp);
+        if (!s.ok()) return s;
+        std::error_code ec;
+        std::filesystem::rename(tmp, dir + "/CURRENT", ec);
+        if (ec) return Status::IOError("rename CURRENT failed: " + ec.message());
+#if !defined(_WIN32)
+        FsyncPath(dir);
+#endif
+        return Status::OK();
+    }
+
+    // Leveled: levels in score order; in each, one file (round-robin from the
+    // level's compact pointer, all overlapping files for L0) plus the
+    // overlapping files of the next level. Files already being compacted and
+    // outputs that would overlap a running job's outputs are skipped, so
+    // several compactions can run on disjoint key ranges and levels.
+    std::unique_ptr<Compaction> PickLevelCompaction(Version* v) {
+        std::vector<int> levels;
+        for (int l=0; l<(int)v->scores_.size(); ++l) if (v->scores_[l] >= 1) levels.push_back(l);
+        std::sort(levels.begin(), levels.end(), [&](int a, int b){ return v->scores_[a] > v->scores_[b]; });
+        for (int level : levels) {
+            std::unique_ptr<Compaction> c = PickLevelCompaction(v, level);
+            if (c) return c;
+        }
+        return nullptr;
+    }
+
+    std::unique_ptr<Compaction> PickLevelCompaction(Version* v, int level) {
+        const auto& files = v->files_[level];
+        if (files.empty()) return nullptr;
+        if (level == 0) {
+            for (const Compaction* r : running_) if (r->level == 0) return nullptr;
+        }
+        size_t start = 0;
+        while (start < files.size() && !compact_pointer_[level].empty() && cmp_(files[start]->largest, compact_pointer_[level]) <= 0) ++start;
+
+        for (size_t n=0; n<files.size(); ++n) {
+            const TableFile& pick = *files[(start + n) % files.size()];
+            if (being_compacted_.count(pick.number)) continue;
+
+            std::unique_ptr<Compaction> c(new Compaction());
+            c->level = level;
+            c->output_level = level + 1;
+            c->inputs[0].push_back(pick);
+            std::string smallest, largest;
+            GetRange(c->inputs[0], &smallest, &largest);
+            if (level == 0) {
+                // L0 files overlap each other: take every file reachable from the pick.
+                GetOverlappingInputs(v, 0, smallest, largest, &c->inputs[0]);
+                GetRange(c->inputs[0], &smallest, &largest);
+                if (AnyBeingCompacted(c->inputs[0])) return nullptr;
+            }
+            GetOverlappingInputs(v, level+1, smallest, largest, &c->inputs[1]);
+            if (AnyBeingCompacted(c->inputs[1])) continue;
+
+            std::vector<TableFile> all = c->inputs[0];
+            all.insert(all.end(), c->inputs[1].begin(), c->inputs[1].end());
+            GetRange(all, &c->smallest, &c->largest);
+            if (OutputConflicts(c->output_level, c->smallest, c->largest)) continue;
+            if (level + 2 < num_levels_) GetOverlappingInputs(v, level+2, c->smallest, c->largest, &c->grandparents);
+
+            c->bottommost = true;
+            for (int l=level+2; l<num_levels_ && c->bottommost; ++l) {
+                for (const auto& f : v->files_[l]) {
+                    if (Overlaps(f->smallest, f->largest, c->smallest, c->largest)) { c->bottommost = false; break; }
+                }
+            }
+            c->max_output_file_size = options_.target_file_size_base;
+            c->max_grandparent_overlap_bytes = (uint64_t)options_.max_grandparent_overlap_factor * options_.target_file_size_base;
+            c->compact_pointer = largest;
+            // Nothing to merge with: move the file down as is, unless that would
+            // leave it overlapping too much of level+2 for its next compaction.
+            if (c->inputs[0].size() == 1 && c->inputs[1].empty()) {
+                uint64_t overlap = 0;
+                for (const auto& g : c->grandparents) overlap += g.size;
+                c->trivial_move = overlap <= c->max_grandparent_overlap_bytes;
+            }
+            return c;
+        }
+        return nullptr;
+    }
+
+    bool AnyBeingCompacted(const std::vector<TableFile>& files) const {
+        for (const auto& f : files) if (being_compacted_.count(f.number)) return true;
+        return false;
+    }
+
+    // A running job writing into the same level over an overlapping range
+    // would produce overlapping files there.
+    bool OutputConflicts(int output_level, const std::string& smallest, const std::string& largest) const {
+        for (const Compaction* r : running_) {
+            if (r->output_level != output_level) continue;
+            if (Overlaps(r->smallest, r->largest, smallest, largest)) return true;
+        }
+        return false;
+    }
+
+    struct SortedRun {
+        int level;
+        uint64_t size;
+        std::vector<TableFile> files;
+    };
+
+    // Newest first: each L0 file, then each non-empty level.
+    static std::vector<SortedRun> SortedRuns(Version* v) {
+        std::vector<SortedRun> runs;
+        for (const auto& f : v->files_[0]) runs.push_back(SortedRun{0, f->size, {*f}});
+        for (int l=1; l<(int)v->files_.size(); ++l) {
+            if (v->files_[l].empty()) continue;
+            SortedRun r{l, 0, {}};
+            for (const auto& f : v->files_[l]) { r.size += f->size; r.files.push_back(*f); }
+            runs.push_back(std::move(r));
+        }
+        return runs;
+    }
+
+    static bool SpaceAmpExceeded(const std::vector<SortedRun>& runs, unsigned max_percent) {
+        if (runs.size() < 2) return false;
+        uint64_t newer = 0;
+        for (size_t i=0; i+1<runs.size(); ++i) newer += runs[i].size;
+        return newer * 100 > runs.back().size * (uint64_t)max_percent;
+    }
+
+    // Universal: merge adjacent sorted runs of similar size, or everything when
+    // space amplification is too high. The output has to stay ordered between
+    // the runs around the window: it goes to the bottom level if the window
+    // includes the oldest run, otherwise just above the next older run. A window
+    // that would need to land in L0 behind newer L0 files is widened to start
+    // at the newest run so its output can simply be the newest L0 file. L0
+    // files are ordered by number, so that output's number is taken now: any
+    // flush started later gets a higher one. With a flush already in flight the
+    // pick waits, as that flush's number is lower.
+    std::unique_ptr<Compaction> PickUniversalCompaction(Version* v, bool flush_pending) {
+        const auto& uo = options_.compaction_options_universal;
+        std::vector<SortedRun> runs = SortedRuns(v);
+        const size_t n = runs.size();
+        if (n < 2) return nullptr;
+
+        size_t start = 0, end = 0; // inclusive window
+        bool found = false;
+        if (SpaceAmpExceeded(runs, uo.max_size_amplification_percent)) {
+            start = 0; end = n - 1; found = true;
+        } else if (n >= (size_t)options_.level0_file_num_compaction_trigger) {
+            for (size_t i=0; i<n && !found; ++i) {
+                uint64_t candidate = runs[i].size;
+                size_t j = i + 1;
+                while (j < n && j - i < uo.max_merge_width) {
+                    if (candidate * (100 + uo.size_ratio) / 100 < runs[j].size) break;
+                    candidate += runs[j].size;
+                    ++j;
+                }
+                if (j - i >= std::max(2u, uo.min_merge_width)) { start = i; end = j - 1; found = true; }
+            }
+            if (!found) {
+                // No similar-sized window: merge the newest runs to get back under the trigger.
+                start = 0;
+                end = std::min(n - 1, n - (size_t)options_.level0_file_num_compaction_trigger + 1);
+                found = end > start;
+            }
+        }
+        if (!found) return nullptr;
+
+        int output_level;
+        if (end == n - 1) {
+            output_level = num_levels_ - 1;
+        } else {
+            output_level = runs[end + 1].level - 1;
+            if (output_level < 0) output_level = 0;
+            if (output_level == 0) start = 0;
+        }
+        if (output_level == 0 && flush_pending) return nullptr;
+
+        std::unique_ptr<Compaction> c(new Compaction());
+        c->level = runs[start].level;
+        c->output_level = output_level;
+        for (size_t i=start; i<=end; ++i) {
+            c->inputs[0].insert(c->inputs[0].end(), runs[i].files.begin(), runs[i].files.end());
+        }
+        GetRange(c->inputs[0], &c->smallest, &c->largest);
+        c->bottommost = end == n - 1;
+        c->max_output_file_size = output_level == 0 ? UINT64_MAX : options_.target_file_size_base;
+        c->max_grandparent_overlap_bytes = UINT64_MAX;
+        if (output_level == 0) c->output_number = ++max_number_;
+        return c;
+    }
+
+    // FIFO: files (oldest first) whose newest data is past the TTL, then further
+    // oldest files until the rest fits in max_table_files_size. TTL is judged
+    // against the wall clock, so this is evaluated on demand, not in Finalize.
+    std::vector<TableFile> FIFOVictims(Version* v) const {
+        std::vector<TableFile> victims;
+        uint64_t total = 0;
+        for (const auto& level : v->files_) for (const auto& f : level) total += f->size;
+        const uint64_t now = NowSeconds();
+        const auto& l0 = v->files_[0]; // newest first
+        for (auto it = l0.rbegin(); it != l0.rend(); ++it) {
+            const TableFile& f = **it;
+            bool expired = options_.ttl > 0 && f.creation_time > 0 && f.creation_time + options_.ttl < now;
+            bool oversize = total > options_.compaction_options_fifo.max_table_files_size;
+            if (!expired && !oversize) break;
+            victims.push_back(f);
+            total -= f.size;
+        }
+        return victims;
+    }
+
+    std::unique_ptr<Compaction> PickFIFOCompaction(Version* v) {
+        std::vector<TableFile> victims = FIFOVictims(v);
+        if (victims.empty()) return nullptr;
+        std::unique_ptr<Compaction> c(new Compaction());
+        c->level = 0;
+        c->output_level = 0;
+        c->inputs[0] = std::move(victims);
+        c->deletion_only = true;
+        return c;
+    }
+
+    double MaxBytesForLevel(int level) const {
+        double result = (double)options_.max_bytes_for_level_base;
+        for (int l=1; l<level; ++l) result *= options_.max_bytes_for_level_multiplier;
+        return result;
+    }
+
+    // Leveled: scores each level that can be compacted into a next one: L0 by file count
+    // (each L0 file costs a probe per read), L1+ by bytes over the level target.
+    void Finalize(Version* v) const {
+        if (options_.compaction_style == kCompactionStyleUniversal) {
+            std::vector<SortedRun> runs = SortedRuns(v);
+            double score = (double)runs.size() / std::max(1, options_.level0_file_num_compaction_trigger);
+            if (SpaceAmpExceeded(runs, options_.compaction_options_universal.max_size_amplification_percent)) score = std::max(score, 1.0);
+            v->compaction_level_ = 0;
+            v->compaction_score_ = score;
+            return;
+        }
+        int best_level = -1;
+        double best_score = -1;
+        v->scores_.assign(num_levels_ - 1, 0);
+        for (int l=0; l<num_levels_-1; ++l) {
+            double score;
+            if (l == 0) {
+                score = (double)v->files_[0].size() / std::max(1, options_.level0_file_num_compaction_trigger);
+            } else {
+                uint64_t bytes = 0;
+                for (const auto& f : v->files_[l]) bytes += f->size;
+                score = (double)bytes / MaxBytesForLevel(l);
+            }
+            v->scores_[l] = score;
+            if (score > best_score) { best_score = score; best_level = l; }
+        }
+        v->compaction_level_ = best_level;
+        v->compaction_score_ = best_score;
+    }
+
+    void GetRange(const std::vector<TableFile>& files, std::string* smallest, std::string* largest) const {
+        smallest->clear(); largest->clear();
+        for (size_t i=0; i<files.size(); ++i) {
+            if (i == 0 || cmp_.Less(files[i].smallest, *smallest)) *smallest = files[i].smallest;
+            if (i == 0 || cmp_.Less(*largest, files[i].largest)) *largest = files[i].largest;
+        }
+    }
+
+    // Files in level overlapping [smallest, largest]. For L0 the range grows with
+    // each overlapping file so that no newer version of a key is left behind.
+    void GetOverlappingInputs(Version* v, int level, std::string smallest, std::string largest, std::vector<TableFile>* out) const {
+        out->clear();
+        const auto& files = v->files_[level];
+        for (size_t i=0; i<files.size(); ) {
+            const auto& f = files[i++];
+            if (!Overlaps(f->smallest, f->largest, smallest, largest)) continue;
+            if (level == 0 && (cmp_.Less(f->smallest, smallest) || cmp_.Less(largest, f->largest))) {
+                if (cmp_.Less(f->smallest, smallest)) smallest = f->smallest;
+                if (cmp_.Less(largest, f->largest)) largest = f->largest;
+                out->clear(); i = 0;
+                continue;
+            }
+            out->push_back(*f);
+        }
+    }
+
+    void Install(Version* v) {
+        v->Ref();
+        current_->Unref();
+        current_ = v;
+    }
+
+    TableFileRef NewFileRef(const TableFile& f) {
+        FileDeleter d = deleter_;
+        return TableFileRef(new TableFile(f), [d](TableFile* t) {
+            if (t->obsolete && d) d(*t);
+            delete t;
+        });
+    }
+
+    BlobFileRef NewBlobFileRef(const BlobFile& f) {
+        BlobFileDeleter d = blob_deleter_;
+        return BlobFileRef(new BlobFile(f), [d](BlobFile* b) {
+            if (b->obsolete && d) d(*b);
+            delete b;
+        });
+    }
+
+    void SortLevels(Version* v) const {
+        auto& l0 = v->files_[0];
+        std::sort(l0.begin(), l0.end(), [](const TableFileRef& a, const TableFileRef& b){ return a->number > b->number; });
+        for (int l=1; l<(int)v->files_.size(); ++l) {
+            std::sort(v->files_[l].begin(), v->files_[l].end(), [this](const TableFileRef& a, const TableFileRef& b){ return cmp_.Less(a->smallest, b->smallest); });
         }
     }
 
-private:
     mutable std::mutex mu_;
-    std::vector<std::vector<TableFile>> levels_;
+    std::string dbpath_;
+    Options options_;
+    UserKeyComparator cmp_;
+    int num_levels_;
+    Version* current_;
+    FileDeleter deleter_;
+    BlobFileDeleter blob_deleter_;
     uint64_t max_number_ = 0;
+    uint64_t log_number_ = 0;
+    std::unique_ptr<WALWriter> manifest_;
+    uint64_t manifest_number_ = 0;
+    std::vector<std::string> compact_pointer_; // per level: largest key of the last compaction
+    std::set<uint64_t> being_compacted_;        // input file numbers of running compactions
+    std::vector<const Compaction*> running_;
+    std::map<uint32_t, std::string> column_families_;
+    uint32_t max_column_family_ = 0;
 };
 
 } // namespace lsmkv
@@ -0,0 +1,243 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <utility>
+#include "../util/coding.h"
+#include "../util/slice.h"
+#include "../util/status.h"
+
+namespace lsmkv {
+
+struct TableFile {
+    int level;
+    uint64_t number;
+    std::string path;
+    std::string smallest;
+    std::string largest;
+    uint64_t size;
+    uint64_t creation_time = 0; // unix seconds of the newest data; 0 if unknown
+    uint64_t num_entries = 0;   // 0 if unknown (files from before the count was recorded)
+    uint64_t num_deletions = 0;
+    bool obsolete = false; // set once a newer Version dropped the file; it is deleted with its last reference
+};
+
+// A blob file holding values separated out of tables (see blob/blob_format.h).
+struct BlobFile {
+    uint64_t number = 0;
+    std::string path;
+    uint64_t total_count = 0; // blobs written
+    uint64_t total_bytes = 0; // value bytes written
+    uint64_t size = 0;        // file size
+    bool obsolete = false;    // as TableFile::obsolete
+};
+
+// Blobs of one file that compactions stopped referencing; added to the file's running total.
+struct BlobFileGarbage {
+    uint64_t number = 0;
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+// WAL record type used for MANIFEST entries; the MANIFEST shares the WAL framing.
+static const uint8_t kTypeVersionEdit = 0x10;
+
+// A batch of file additions/removals and picker state applied atomically by VersionSet::LogAndApply.
+// Encoded as tagged fields so new fields can be added without breaking old MANIFESTs.
+struct VersionEdit {
+    std::vector<std::pair<int, uint64_t>> deleted_files;
+    std::vector<TableFile> new_files;
+    std::vector<std::pair<int, std::string>> compact_pointers;
+    std::vector<BlobFile> new_blob_files;
+    std::vector<BlobFileGarbage> blob_garbage;
+    std::vector<std::pair<uint32_t, std::string>> added_column_families; // (id, name)
+    std::vector<uint32_t> dropped_column_families;
+    bool has_log_number = false;
+    uint64_t log_number = 0;       // WALs below this number are fully flushed
+    bool has_next_file_number = false;
+    uint64_t next_file_number = 0;
+    bool has_comparator = false;
+    std::string comparator;        // Comparator::Name() of the key order
+
+    void AddFile(const TableFile& f) { new_files.push_back(f); }
+    void SetCompactPointer(int level, const std::string& key) { compact_pointers.emplace_back(level, key); }
+    void RemoveFile(int level, uint64_t number) { deleted_files.emplace_back(level, number); }
+    void AddBlobFile(const BlobFile& f) { new_blob_files.push_back(f); }
+    void AddBlobGarbage(uint64_t number, uint64_t count, uint64_t bytes) { blob_garbage.push_back(BlobFileGarbage{number, count, bytes}); }
+    void AddColumnFamily(uint32_t id, const std::string& name) { added_column_families.emplace_back(id, name); }
+    void DropColumnFamily(uint32_t id) { dropped_column_families.push_back(id); }
+    void SetLogNumber(uint64_t n) { has_log_number = true; log_number = n; }
+    void SetNextFileNumber(uint64_t n) { has_next_file_number = true; next_file_number = n; }
+    void SetComparatorName(const std::string& name) { has_comparator = true; comparator = name; }
+
+    // New files are recorded by file name; the reader joins it with the DB directory.
+    void EncodeTo(std::string& dst) const {
+        if (has_log_number) { PutVarint32(dst, kLogNumber); PutVarint64(dst, log_number); }
+        if (has_next_file_number) { PutVarint32(dst, kNextFileNumber); PutVarint64(dst, next_file_number); }
+        if (has_comparator) { PutVarint32(dst, kComparator); PutLengthPrefixedSlice(dst, comparator.data(), comparator.size()); }
+        for (const auto& cp : compact_pointers) {
+            PutVarint32(dst, kCompactPointer);
+            PutVarint32(dst, (uint32_t)cp.first);
+            PutLengthPrefixedSlice(dst, cp.second.data(), cp.second.size());
+        }
+        for (const auto& d : deleted_files) {
+            PutVarint32(dst, kDeletedFile);
+            PutVarint32(dst, (uint32_t)d.first);
+            PutVarint64(dst, d.second);
+        }
+        for (const auto& f : new_files) {
+            PutVarint32(dst, kNewFile);
+            PutVarint32(dst, (uint32_t)f.level);
+            PutVarint64(dst, f.number);
+            PutVarint64(dst, f.size);
+            std::string name = FileName(f.path);
+            PutLengthPrefixedSlice(dst, name.data(), name.size());
+            PutLengthPrefixedSlice(dst, f.smallest.data(), f.smallest.size());
+            PutLengthPrefixedSlice(dst, f.largest.data(), f.largest.size());
+            if (f.creation_time) {
+                PutVarint32(dst, kFileCreationTime);
+                PutVarint64(dst, f.number);
+                PutVarint64(dst, f.creation_time);
+            }
+            if (f.num_entries) {
+                PutVarint32(dst, kFileEntries);
+                PutVarint64(dst, f.number);
+                PutVarint64(dst, f.num_entries);
+                PutVarint64(dst, f.num_deletions);
+            }
+        }
+        for (const auto& b : new_blob_files) {
+            PutVarint32(dst, kNewBlobFile);
+            PutVarint64(dst, b.number);
+            PutVarint64(dst, b.total_count);
+            PutVarint64(dst, b.total_bytes);
+            PutVarint64(dst, b.size);
+            std::string name = FileName(b.path);
+            PutLengthPrefixedSlice(dst, name.data(), name.size());
+        }
+        for (const auto& g : blob_garbage) {
+            PutVarint32(dst, kBlobFileGarbage);
+            PutVarint64(dst, g.number);
+            PutVarint64(dst, g.count);
+            PutVarint64(dst, g.bytes);
+        }
+        for (const auto& cf : added_column_families) {
+            PutVarint32(dst, kColumnFamilyAdd);
+            PutVarint32(dst, cf.first);
+            PutLengthPrefixedSlice(dst, cf.second.data(), cf.second.size());
+        }
+        for (uint32_t id : dropped_column_families) {
+            PutVarint32(dst, kColumnFamilyDrop);
+            PutVarint32(dst, id);
+        }
+    }
+
+    Status DecodeFrom(const Slice& src, const std::string& dir) {
+        const char* p = src.data();
+        const char* limit = src.data() + src.size();
+        while (p < limit) {
+            uint32_t tag = 0;
+            p = GetVarint32Ptr(p, limit, &tag);
+            if (!p) return Status::Corruption("version edit tag");
+            switch (tag) {
+                case kLogNumber:
+                    p = GetVarint64Ptr(p, limit, &log_number); has_log_number = true; break;
+                case kNextFileNumber:
+                    p = GetVarint64Ptr(p, limit, &next_file_number); has_next_file_number = true; break;
+                case kDeletedFile: {
+                    uint32_t level = 0; uint64_t number = 0;
+                    p = GetVarint32Ptr(p, limit, &level);
+                    if (p) p = GetVarint64Ptr(p, limit, &number);
+                    if (p) deleted_files.emplace_back((int)level, number);
+                    break;
+                }
+                case kNewFile: {
+                    uint32_t level = 0; std::string name;
+                    TableFile f;
+                    p = GetVarint32Ptr(p, limit, &level);
+                    if (p) p = GetVarint64Ptr(p, limit, &f.number);
+                    if (p) p = GetVarint64Ptr(p, limit, &f.size);
+                    if (p) p = GetLengthPrefixed(p, limit, &name);
+                    if (p) p = GetLengthPrefixed(p, limit, &f.smallest);
+                    if (p) p = GetLengthPrefixed(p, limit, &f.largest);
+                    if (p) { f.level = (int)level; f.path = dir + "/" + name; new_files.push_back(f); }
+                    break;
+                }
+                case kCompactPointer: {
+                    uint32_t level = 0; std::string key;
+                    p = GetVarint32Ptr(p, limit, &level);
+                    if (p) p = GetLengthPrefixed(p, limit, &key);
+                    if (p) compact_pointers.emplace_back((int)level, key);
+                    break;
+                }
+                case kFileCreationTime: {
+                    uint64_t number = 0, t = 0;
+                    p = GetVarint64Ptr(p, limit, &number);
+                    if (p) p = GetVarint64Ptr(p, limit, &t);
+                    for (auto& f : new_files) if (f.number == number) f.creation_time = t;
+                    break;
+                }
+                case kFileEntries: {
+                    uint64_t number = 0, entries = 0, deletions = 0;
+                    p = GetVarint64Ptr(p, limit, &number);
+                    if (p) p = GetVarint64Ptr(p, limit, &entries);
+                    if (p) p = GetVarint64Ptr(p, limit, &deletions);
+                    for (auto& f : new_files) if (f.number == number) { f.num_entries = entries; f.num_deletions = deletions; }
+                    break;
+                }
+                case kNewBlobFile: {
+                    BlobFile b; std::string name;
+                    p = GetVarint64Ptr(p, limit, &b.number);
+                    if (p) p = GetVarint64Ptr(p, limit, &b.total_count);
+                    if (p) p = GetVarint64Ptr(p, limit, &b.total_bytes);
+                    if (p) p = GetVarint64Ptr(p, limit, &b.size);
+                    if (p) p = GetLengthPrefixed(p, limit, &name);
+                    if (p) { b.path = dir + "/" + name; new_blob_files.push_back(b); }
+                    break;
+                }
+                case kBlobFileGarbage: {
+                    BlobFileGarbage g;
+                    p = GetVarint64Ptr(p, limit, &g.number);
+                    if (p) p = GetVarint64Ptr(p, limit, &g.count);
+                    if (p) p = GetVarint64Ptr(p, limit, &g.bytes);
+                    if (p) blob_garbage.push_back(g);
+                    break;
+                }
+                case kColumnFamilyAdd: {
+                    uint32_t id = 0; std::string name;
+                    p = GetVarint32Ptr(p, limit, &id);
+                    if (p) p = GetLengthPrefixed(p, limit, &name);
+                    if (p) added_column_families.emplace_back(id, name);
+                    break;
+                }
+                case kComparator:
+                    p = GetLengthPrefixed(p, limit, &comparator); has_comparator = true; break;
+                case kColumnFamilyDrop: {
+                    uint32_t id = 0;
+                    p = GetVarint32Ptr(p, limit, &id);
+                    if (p) dropped_column_families.push_back(id);
+                    break;
+                }
+                default:
+                    return Status::Corruption("unknown version edit tag");
+            }
+            if (!p) return Status::Corruption("truncated version edit");
+        }
+        return Status::OK();
+    }
+
+    // Edits record file names; the directory is the VersionSet's.
+    static std::string FileName(const std::string& path) {
+        size_t pos = path.find_last_of("/\\");
+        return pos == std::string::npos ? path : path.substr(pos + 1);
+    }
+
+private:
+    enum Tag : uint32_t { kLogNumber = 1, kNextFileNumber = 2, kDeletedFile = 3, kNewFile = 4, kCompactPointer = 5,
+                       kFileCreationTime = 6, kFileEntries = 7, // 6 and 7 follow the kNewFile they belong to
+                       kNewBlobFile = 8, kBlobFileGarbage = 9,
+                       kColumnFamilyAdd = 10, kColumnFamilyDrop = 11, // 10 and 11 only in the default family's MANIFEST
+                       kComparator = 12 };
+};
+
+} // namespace lsmkv
@@ -10,6 +10,7 @@
 #include "../util/status.h"
 #include "../util/slice.h"
 #include "../util/coding.h"
+#include "../util/statistics.h"
 
 #if defined(_WIN32)
 #include <io.h>
@@ -23,6 +24,30 @@
 
 namespace lsmkv {
 
+// Flushes a file (or, on POSIX, a directory) identified by path to stable storage.
+inline Status FsyncPath(const std::string& path) {
+#if defined(_WIN32)
+    int fd = _open(path.c_str(), _O_RDONLY);
+    if (fd < 0) return Status::IOError("open for _commit failed");
+    int rc = _commit(fd);
+    _close(fd);
+    if (rc != 0) return Status::IOError("fsync(_commit) failed");
+    return Status::OK();
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return Status::IOError("open for fsync failed");
+    int rc = ::fsync(fd);
+    ::close(fd);
+    if (rc != 0) return Status::IOError("fsync failed");
+    return Status::OK();
+#endif
+}
+
+// WAL record holding an encoded WriteBatch (include/write_batch.h). WALs
+// written before batches existed hold single kTypeValue/kTypeDeletion
+// records of the default column family.
+static const uint8_t kTypeWriteBatch = 0x11;
+
 class WALWriter {
 public:
     WALWriter() = default;
@@ -53,41 +78,35 @@ public:
         PutFixed32(header, checksum);
         ofs_.write(header.data()+header.size()-4, 4);
         ofs_.flush();
+        size_ += header.size() + rec.size();
         if (sync) return Fsync();
         return Status::OK();
     }
 
     Status Fsync() {
-#if defined(_WIN32)
         ofs_.flush();
-        int fd = _open(path_.c_str(), _O_RDONLY);
-        if (fd < 0) return Status::IOError("open for _commit failed");
-        int rc = _commit(fd);
-        _close(fd);
-        if (rc != 0) return Status::IOError("fsync(_commit) failed");
-        return Status::OK();
-#else
-        ofs_.flush();
-        int fd = ::open(path_.c_str(), O_RDONLY);
-        if (fd < 0) return Status::IOError("open for fsync failed");
-        int rc = ::fsync(fd);
-        ::close(fd);
-        if (rc != 0) return Status::IOError("fsync failed");
-        return Status::OK();
-#endif
+        StopWatch sw(stats_, kWalFsyncMicros);
+        RecordTick(stats_, kWalSyncs);
+        return FsyncPath(path_);
     }
 
+    // Syncs are counted and timed in stats when set.
+    void SetStatistics(Statistics* stats) { stats_ = stats; }
+
     void Close() {
         std::lock_guard<std::mutex> lg(mu_);
         if (ofs_.is_open()) ofs_.close();
     }
 
     const std::string& path() const { return path_; }
+    uint64_t size() const { return size_; } // bytes appended through this writer
 
 private:
     std::mutex mu_;
     std::string path_;
     std::ofstream ofs_;
+    uint64_t size_ = 0;
+    Statistics* stats_ = nullptr;
 };
 
 class WALReader {
@@ -0,0 +1,74 @@
+#include "../../include/write_batch.h"
+#include "../../include/lsm_kv.h"
+#include "../memtable/memtable.h"
+#include "../util/coding.h"
+
+namespace lsmkv {
+
+static const size_t kHeader = 4; // entry count
+
+static uint32_t FamilyId(ColumnFamilyHandle* cf) { return cf ? cf->GetID() : 0; }
+
+void WriteBatch::Put(ColumnFamilyHandle* column_family, const Slice& key, const Slice& value) {
+    uint32_t n = Count() + 1;
+    std::memcpy(&rep_[0], &n, 4);
+    rep_.push_back((char)kTypeValue);
+    PutVarint32(rep_, FamilyId(column_family));
+    PutLengthPrefixedSlice(rep_, key.data(), key.size());
+    PutLengthPrefixedSlice(rep_, value.data(), value.size());
+}
+
+void WriteBatch::Delete(ColumnFamilyHandle* column_family, const Slice& key) {
+    uint32_t n = Count() + 1;
+    std::memcpy(&rep_[0], &n, 4);
+    rep_.push_back((char)kTypeDeletion);
+    PutVarint32(rep_, FamilyId(column_family));
+    PutLengthPrefixedSlice(rep_, key.data(), key.size());
+}
+
+void WriteBatch::Clear() {
+    rep_.clear();
+    PutFixed32(rep_, 0);
+}
+
+uint32_t WriteBatch::Count() const { return DecodeFixed32(rep_.data()); }
+
+Status WriteBatch::Iterate(Handler* handler) const {
+    const char* p = rep_.data() + kHeader;
+    const char* limit = rep_.data() + rep_.size();
+    auto slice = [&](Slice* out) {
+        uint32_t n = 0;
+        p = GetVarint32Ptr(p, limit, &n);
+        if (!p || (size_t)(limit - p) < n) return false;
+        *out = Slice(p, n);
+        p += n;
+        return true;
+    };
+    uint32_t found = 0;
+    while (p < limit) {
+        uint8_t type = (uint8_t)*p++;
+        uint32_t cf = 0;
+        Slice key, value;
+        p = GetVarint32Ptr(p, limit, &cf);
+        if (!p || !slice(&key)) return Status::Corruption("truncated write batch");
+        if (type == kTypeValue) {
+            if (!slice(&value)) return Status::Corruption("truncated write batch");
+            handler->Put(cf, key, value);
+        } else if (type == kTypeDeletion) {
+            handler->Delete(cf, key);
+        } else {
+            return Status::Corruption("unknown write batch entry");
+        }
+        ++found;
+    }
+    if (found != Count()) return Status::Corruption("write batch has wrong count");
+    return Status::OK();
+}
+
+Status WriteBatch::SetData(const Slice& data) {
+    if (data.size() < kHeader) return Status::Corruption("write batch too small");
+    rep_.assign(data.data(), data.size());
+    return Status::OK();
+}
+
+} // namespace lsmkv
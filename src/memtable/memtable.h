@@ -7,10 +7,13 @@
 #include <unordered_map>
 #include "skiplist.h"
 #include "../util/slice.h"
+#include "../util/comparator.h"
 
 namespace lsmkv {
 
-enum ValueType : uint8_t { kTypeValue = 1, kTypeDeletion = 2 };
+// kTypeBlobIndex only appears in tables: the value is an encoded BlobIndex
+// pointing into a blob file (see blob/blob_format.h).
+enum ValueType : uint8_t { kTypeValue = 1, kTypeDeletion = 2, kTypeBlobIndex = 3 };
 
 struct MemValue {
     ValueType type;
@@ -19,7 +22,7 @@ struct MemValue {
 
 class MemTable {
 public:
-    MemTable() : approximate_size_(0) {}
+    explicit MemTable(const Comparator* cmp = BytewiseComparator()) : cmp_(cmp), table_(cmp_), approximate_size_(0) {}
 
     void Add(const Slice& key, const Slice& value, ValueType type) {
         std::lock_guard<std::mutex> lg(mu_);
@@ -27,24 +30,30 @@ public:
         bool inserted = table_.InsertOrAssign(key.ToString(), mv);
         if (inserted) {
             approximate_size_ += key.size() + value.size() + sizeof(MemValue);
+            num_entries_.fetch_add(1, std::memory_order_relaxed);
         } else {
             approximate_size_ += value.size();
         }
+        if (type == kTypeDeletion) num_deletes_.fetch_add(1, std::memory_order_relaxed);
     }
 
     bool Get(const Slice& key, MemValue* out) const {
         std::lock_guard<std::mutex> lg(mu_);
-        // linear iteration (ordered), return exact key
-        auto it = table_.NewIterator();
-        while (it.Valid()) {
-            if (Slice(it.key()).compare(key) == 0) { *out = it.value(); return true; }
-            if (Slice(it.key()).compare(key) > 0) break;
-            it.Next();
-        }
+        auto it = table_.Seek(key.ToString());
+        if (it.Valid() && cmp_(it.key(), key) == 0) { *out = it.value(); return true; }
         return false;
     }
 
+    // True if some key (deletions included) lies in [smallest, largest].
+    bool OverlapsRange(const Slice& smallest, const Slice& largest) const {
+        std::lock_guard<std::mutex> lg(mu_);
+        auto it = table_.Seek(smallest.ToString());
+        return it.Valid() && cmp_(it.key(), largest) <= 0;
+    }
+
     size_t ApproximateMemoryUsage() const { return approximate_size_.load(); }
+    uint64_t NumEntries() const { return num_entries_.load(std::memory_order_relaxed); } // distinct keys
+    uint64_t NumDeletes() const { return num_deletes_.load(std::memory_order_relaxed); } // Delete calls
 
     struct IterKV {
         std::string key;
@@ -63,13 +72,11 @@ public:
 
 private:
     mutable std::mutex mu_;
-    struct KeyCmp {
-        int operator()(const std::string& a, const std::string& b) const {
-            if (a < b) return -1; if (a > b) return +1; return 0;
-        }
-    };
-    SkipList<std::string, MemValue, KeyCmp> table_;
+    UserKeyComparator cmp_;
+    SkipList<std::string, MemValue, UserKeyComparator> table_;
     std::atomic<size_t> approximate_size_;
+    std::atomic<uint64_t> num_entries_{0};
+    std::atomic<uint64_t> num_deletes_{0};
 };
 
 } // namespace lsmkv
@@ -8,9 +8,10 @@ namespace lsmkv {
 
 template <typename Key, typename Value, typename KeyComparator>
 class SkipList {
+    struct Node;
 public:
-    explicit SkipList(int max_level = 16)
-        : max_level_(max_level), level_(1), rnd_(0xdeadbeef) {
+    explicit SkipList(KeyComparator comp = KeyComparator(), int max_level = 16)
+        : comp_(comp), max_level_(max_level), level_(1), rnd_(0xdeadbeef) {
         head_ = new Node("", Value{}, max_level_);
         for (int i=0;i<max_level_;++i) head_->next[i] = nullptr;
     }
@@ -60,6 +61,14 @@ public:
 
     Iterator NewIterator() const { return Iterator(head_->next[0]); }
 
+    Iterator Seek(const Key& key) const {
+        Node* x = head_;
+        for (int i = level_ - 1; i >= 0; --i) {
+            while (x->next[i] && comp_(x->next[i]->key, key) < 0) x = x->next[i];
+        }
+        return Iterator(x->next[0]);
+    }
+
 private:
     struct Node {
         Key key;
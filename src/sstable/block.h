@@ -12,13 +12,15 @@ class DataBlockBuilder {
 public:
     explicit DataBlockBuilder(size_t target) : target_size_(target) {}
 
-    void Add(const Slice& key, const MemValue& mv) {
+    void Add(const Slice& key, const MemValue& mv) { Add(key, mv.type, Slice(mv.value)); }
+
+    void Add(const Slice& key, ValueType type, const Slice& value) {
         PutVarint32(buf_, (uint32_t)key.size());
-        PutVarint32(buf_, (uint32_t)mv.value.size() + 1); // include type
+        PutVarint32(buf_, (uint32_t)value.size() + 1); // include type
         buf_.append(key.data(), key.size());
-        buf_.push_back((char)mv.type);
-        buf_.append(mv.value.data(), mv.value.size());
-        if (first_key_.empty()) first_key_ = key.ToString();
+        buf_.push_back((char)type);
+        buf_.append(value.data(), value.size());
+        if (first_key_.empty()) first_key_.assign(key.data(), key.size());
     }
 
     bool ShouldFlush() const { return buf_.size() >= target_size_; }
@@ -7,8 +7,9 @@ namespace lsmkv {
 
 static const uint64_t kSSTableMagic = 0xdb4775248b80fb57ull;
 static const uint32_t kSSTableVersion = 1;
+static const size_t kFooterSize = 48;
 
-// Footer: [index_off u64][index_sz u64][filter_off u64][filter_sz u64][version u32][pad u32][magic u64] = 56 bytes
+// Footer: [index_off u64][index_sz u64][filter_off u64][filter_sz u64][version u32][pad u32][magic u64] = 48 bytes
 struct Footer {
     uint64_t index_offset = 0;
     uint64_t index_size = 0;
@@ -27,7 +28,7 @@ inline void EncodeFooter(std::string& dst, const Footer& f) {
     put32(f.version); put32(f.pad); put64(f.magic);
 }
 inline bool DecodeFooter(const std::string& data, Footer* f) {
-    if (data.size() < 56) return false;
+    if (data.size() < kFooterSize) return false;
     const char* p = data.data();
     auto get64 = [&](uint64_t* v){ std::memcpy(v,p,8); p+=8; };
     auto get32 = [&](uint32_t* v){ std::memcpy(v,p,4); p+=4; };
@@ -4,6 +4,7 @@
 #include <cstdint>
 #include "../util/coding.h"
 #include "../util/slice.h"
+#include "../util/comparator.h"
 
 namespace lsmkv {
 
@@ -28,7 +29,9 @@ private:
 
 class IndexBlockReader {
 public:
-    explicit IndexBlockReader(const Slice& contents) {
+    using Entry = IndexBlockBuilder::Entry;
+
+    explicit IndexBlockReader(const Slice& contents, const Comparator* cmp = BytewiseComparator()) : cmp_(cmp) {
         const char* p = contents.data();
         const char* limit = contents.data()+contents.size();
         while (p < limit) {
@@ -44,12 +47,12 @@ public:
         }
     }
 
-    // binary search
+    // Last block whose first key is <= key, or -1: binary search
     int FindBlock(const Slice& key) const {
         int lo=0, hi=(int)entries_.size()-1, ans=-1;
         while (lo<=hi) {
             int mid=(lo+hi)/2;
-            int c = Slice(entries_[mid].key).compare(key);
+            int c = cmp_(entries_[mid].key, key);
             if (c<=0) { ans=mid; lo=mid+1; } else { hi=mid-1; }
         }
         return ans;
@@ -58,6 +61,7 @@ public:
     const std::vector<Entry>& entries() const { return entries_; }
 
 private:
+    UserKeyComparator cmp_;
     std::vector<Entry> entries_;
 };
 
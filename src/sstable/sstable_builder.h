@@ -1,11 +1,13 @@
 #pragma once
 #include <string>
-#include <fstream>
 #include <memory>
 #include "../util/status.h"
 #include "../util/slice.h"
 #include "../util/coding.h"
 #include "../util/bloom_filter.h"
+#include "../util/clock.h"
+#include "../util/rate_limiter.h"
+#include "../util/file_writer.h"
 #include "format.h"
 #include "block.h"
 #include "index_block.h"
@@ -20,6 +22,9 @@ struct SSTableMeta {
     std::string smallest_key;
     std::string largest_key;
     uint64_t file_size = 0;
+    uint64_t creation_time = 0; // unix seconds of the newest data in the file
+    uint64_t num_entries = 0;
+    uint64_t num_deletions = 0;
 };
 
 class SSTableBuilder {
@@ -27,63 +32,96 @@ public:
     SSTableBuilder(const std::string& file_path, size_t block_size, unsigned bloom_bits)
         : file_path_(file_path), block_size_(block_size), data_block_(block_size), filter_builder_(bloom_bits) {}
 
+    // Age of the newest data being written; defaults to the time Finish() runs.
+    // Compaction passes the newest creation time among its inputs.
+    void SetCreationTime(uint64_t unix_seconds) { creation_time_ = unix_seconds; }
+
+    // Every write is charged to rl first (flushes pass kHigh, compactions kLow).
+    void SetRateLimiter(RateLimiter* rl, RateLimiter::Priority pri) { rate_limiter_ = rl; io_priority_ = pri; }
+
+    // Bypass the page cache when writing (flush/compaction outputs); call before Open.
+    void SetDirectIO(bool on) { use_direct_io_ = on; }
+
     Status Open() {
-        ofs_.open(file_path_, std::ios::binary | std::ios::out | std::ios::trunc);
-        if (!ofs_.good()) return Status::IOError("open sstable for write failed: " + file_path_);
-        offset_ = 0; return Status::OK();
+        offset_ = 0;
+        return file_.Open(file_path_, use_direct_io_);
     }
 
-    Status Add(const Slice& key, const MemValue& mv) {
-        if (num_entries_ == 0) smallest_key_ = key.ToString();
-        largest_key_ = key.ToString();
-        if (data_block_.CurrentSize() == 0) pending_index_key_ = key.ToString();
+    Status Add(const Slice& key, const MemValue& mv) { return Add(key, mv.type, Slice(mv.value)); }
+
+    // Copies nothing per entry beyond the block bytes: key strings reuse their capacity.
+    Status Add(const Slice& key, ValueType type, const Slice& value) {
+        if (num_entries_ == 0) smallest_key_.assign(key.data(), key.size());
+        largest_key_.assign(key.data(), key.size());
+        if (data_block_.CurrentSize() == 0) pending_index_key_.assign(key.data(), key.size());
 
-        data_block_.Add(key, mv);
+        data_block_.Add(key, type, value);
         filter_builder_.AddKey(key);
         ++num_entries_;
+        if (type == kTypeDeletion) ++num_deletions_;
         if (data_block_.ShouldFlush()) {
             std::string block = data_block_.Finish();
             uint64_t off = offset_;
-            ofs_.write(block.data(), block.size());
-            offset_ += block.size();
+            Status s = Write(block);
+            if (!s.ok()) return s;
             index_builder_.Add(Slice(pending_index_key_), off, block.size());
         }
         return Status::OK();
     }
 
+    // Writes index, filter and footer, then fsyncs: a finished table is durable
+    // before it is referenced from the MANIFEST.
     Status Finish(SSTableMeta* meta_out) {
+        Status s;
         if (data_block_.CurrentSize() > 0) {
             std::string block = data_block_.Finish();
             uint64_t off = offset_;
-            ofs_.write(block.data(), block.size());
-            offset_ += block.size();
+            s = Write(block);
             index_builder_.Add(Slice(pending_index_key_), off, block.size());
         }
 
         std::string index_data = index_builder_.Finish();
-        uint64_t index_off = offset_; ofs_.write(index_data.data(), index_data.size()); offset_ += index_data.size();
+        uint64_t index_off = offset_;
+        if (s.ok()) s = Write(index_data);
 
         std::string filter_data = filter_builder_.Finalize();
-        uint64_t filter_off = offset_; ofs_.write(filter_data.data(), filter_data.size()); offset_ += filter_data.size();
+        uint64_t filter_off = offset_;
+        if (s.ok()) s = Write(filter_data);
 
         Footer f; f.index_offset=index_off; f.index_size=index_data.size(); f.filter_offset=filter_off; f.filter_size=filter_data.size();
         std::string footer; EncodeFooter(footer, f);
-        ofs_.write(footer.data(), footer.size()); offset_ += footer.size();
-        ofs_.flush(); ofs_.close();
+        if (s.ok()) s = Write(footer);
+        Status cs = file_.Close(true);
+        if (s.ok()) s = cs;
+        if (!s.ok()) return s;
 
         if (meta_out) {
             meta_out->file_path = file_path_;
             meta_out->smallest_key = smallest_key_;
             meta_out->largest_key = largest_key_;
             meta_out->file_size = offset_;
+            meta_out->creation_time = creation_time_ ? creation_time_ : NowSeconds();
+            meta_out->num_entries = num_entries_;
+            meta_out->num_deletions = num_deletions_;
         }
         return Status::OK();
     }
 
+    // Bytes written so far plus the pending data block.
+    uint64_t FileSize() const { return offset_ + data_block_.CurrentSize(); }
+    size_t NumEntries() const { return num_entries_; }
+
 private:
+    Status Write(const std::string& data) {
+        if (rate_limiter_) rate_limiter_->Request((int64_t)data.size(), io_priority_);
+        offset_ += data.size();
+        return file_.Append(Slice(data));
+    }
+
     std::string file_path_;
     size_t block_size_;
-    std::ofstream ofs_;
+    BufferedFileWriter file_;
+    bool use_direct_io_ = false;
     uint64_t offset_ = 0;
 
     DataBlockBuilder data_block_;
@@ -91,9 +129,13 @@ private:
     BloomFilterBuilder filter_builder_;
     std::string pending_index_key_;
     size_t num_entries_ = 0;
+    size_t num_deletions_ = 0;
 
     std::string smallest_key_;
     std::string largest_key_;
+    uint64_t creation_time_ = 0;
+    RateLimiter* rate_limiter_ = nullptr;
+    RateLimiter::Priority io_priority_ = RateLimiter::kLow;
 };
 
 } // namespace lsmkv
@@ -1,112 +1,364 @@
 #include "sstable_reader.h"
 #include "../table_cache/block_cache.h"
+#include <cerrno>
+#include <algorithm>
+#include <cstdlib>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
 
 namespace lsmkv {
 
-Status SSTableReader::Open(const std::string& file_path, std::shared_ptr<SSTableReader>* out) {
+Status SSTableReader::Open(const std::string& file_path, std::shared_ptr<SSTableReader>* out, bool use_direct_reads,
+                           const Comparator* cmp) {
     std::shared_ptr<SSTableReader> r(new SSTableReader());
     r->path_ = file_path;
-    r->ifs_.open(file_path, std::ios::binary | std::ios::in);
-    if (!r->ifs_.good()) return Status::IOError("open sstable for read failed: " + file_path);
+    r->use_direct_reads_ = use_direct_reads;
+    r->cmp_ = UserKeyComparator(cmp);
+#if defined(_WIN32)
+    r->fd_ = _open(file_path.c_str(), _O_RDONLY | _O_BINARY);
+    if (r->fd_ < 0) return Status::IOError("open sstable for read failed: " + file_path);
+    r->file_size_ = (uint64_t)_lseeki64(r->fd_, 0, SEEK_END);
+#else
+    r->fd_ = ::open(file_path.c_str(), O_RDONLY);
+    if (r->fd_ < 0) return Status::IOError("open sstable for read failed: " + file_path);
+    struct stat st;
+    if (::fstat(r->fd_, &st) != 0) return Status::IOError("stat sstable failed: " + file_path);
+    r->file_size_ = (uint64_t)st.st_size;
+#endif
     Status s = r->Load(); if (!s.ok()) return s;
     *out = std::move(r);
     return Status::OK();
 }
 
 Status SSTableReader::Load() {
-    ifs_.seekg(0, std::ios::end);
-    std::streamoff sz = ifs_.tellg();
-    if (sz < 56) return Status::Corruption("file too small");
-    ifs_.seekg(sz - 56, std::ios::beg);
-    std::string footer_block(56, '\0');
-    if (!ifs_.read(&footer_block[0], 56)) return Status::IOError("read footer failed");
+    if (file_size_ < kFooterSize) return Status::Corruption("file too small");
+    std::string footer_block;
+    Status s = ReadAt(file_size_ - kFooterSize, kFooterSize, &footer_block);
+    if (!s.ok()) return s;
     if (!DecodeFooter(footer_block, &footer_)) return Status::Corruption("bad footer");
 
-    ifs_.seekg(footer_.index_offset, std::ios::beg);
-    std::string index_data(footer_.index_size, '\0');
-    if (!ifs_.read(&index_data[0], footer_.index_size)) return Status::IOError("read index failed");
-    index_reader_.reset(new IndexBlockReader(Slice(index_data)));
+    std::string index_data;
+    s = ReadAt(footer_.index_offset, footer_.index_size, &index_data);
+    if (!s.ok()) return s;
+    index_reader_.reset(new IndexBlockReader(Slice(index_data), cmp_.comparator()));
 
-    ifs_.seekg(footer_.filter_offset, std::ios::beg);
-    std::string filter_data(footer_.filter_size, '\0');
-    if (!ifs_.read(&filter_data[0], footer_.filter_size)) return Status::IOError("read filter failed");
-    filter_reader_.reset(new BloomFilterReader(Slice(filter_data)));
+    s = ReadAt(footer_.filter_offset, footer_.filter_size, &filter_data_);
+    if (!s.ok()) return s;
+    filter_reader_.reset(new BloomFilterReader(Slice(filter_data_)));
 
     return Status::OK();
 }
 
-void SSTableReader::Close() { if (ifs_.is_open()) ifs_.close(); }
+void SSTableReader::Close() {
+    if (fd_ < 0) return;
+#if defined(_WIN32)
+    _close(fd_);
+#else
+    ::close(fd_);
+    if (direct_fd_ >= 0) ::close(direct_fd_);
+    direct_fd_ = -1;
+#endif
+    fd_ = -1;
+}
 
-Status SSTableReader::Get(const Slice& key, std::optional<MemValue>& result, BlockCache* bc, bool fill_cache) {
-    if (!filter_reader_->KeyMayMatch(key)) { result.reset(); return Status::OK(); }
-    int blk = index_reader_->FindBlock(key);
-    if (blk < 0) { result.reset(); return Status::OK(); }
-    const auto& e = index_reader_->entries()[blk];
+Status SSTableReader::ReadAt(uint64_t offset, size_t n, std::string* dst, bool direct) const {
+#if defined(O_DIRECT)
+    if (direct) {
+        std::call_once(direct_once_, [this]{ direct_fd_ = ::open(path_.c_str(), O_RDONLY | O_DIRECT); });
+        if (direct_fd_ >= 0) {
+            const uint64_t kAlign = 4096;
+            uint64_t start = offset / kAlign * kAlign;
+            uint64_t end = (offset + n + kAlign - 1) / kAlign * kAlign;
+            void* buf = nullptr;
+            if (posix_memalign(&buf, kAlign, end - start) != 0) return Status::IOError("out of memory");
+            // The last aligned chunk may run past EOF; only [start, file end) comes back.
+            size_t got = 0;
+            Status s;
+            while (start + got < end) {
+                ssize_t r = ::pread(direct_fd_, (char*)buf + got, end - start - got, (off_t)(start + got));
+                if (r < 0 && errno == EINTR) continue;
+                if (r < 0) { s = Status::IOError("direct read failed: " + path_); break; }
+                if (r == 0) break;
+                got += (size_t)r;
+            }
+            if (s.ok() && start + got < offset + n) s = Status::IOError("short read: " + path_);
+            if (s.ok()) dst->assign((const char*)buf + (offset - start), n);
+            free(buf);
+            return s;
+        }
+    }
+#else
+    (void)direct;
+#endif
+    dst->resize(n);
+    size_t done = 0;
+#if defined(_WIN32)
+    std::lock_guard<std::mutex> lg(io_mu_);
+    if (_lseeki64(fd_, (long long)offset, SEEK_SET) < 0) return Status::IOError("seek failed: " + path_);
+    while (done < n) {
+        int r = _read(fd_, &(*dst)[done], (unsigned)(n - done));
+        if (r <= 0) return Status::IOError("short read: " + path_);
+        done += (size_t)r;
+    }
+#else
+    while (done < n) {
+        ssize_t r = ::pread(fd_, &(*dst)[done], n - done, (off_t)(offset + done));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return Status::IOError("short read: " + path_);
+        done += (size_t)r;
+    }
+#endif
+    return Status::OK();
+}
 
-    std::string block_data;
-    std::string cache_key = path_ + ":" + std::to_string(e.off);
-    if (bc) {
-        if (bc->Get(cache_key, &block_data)) { /* cached */ }
-        else {
-            ifs_.seekg(e.off, std::ios::beg);
-            block_data.resize(e.sz);
-            if (!ifs_.read(&block_data[0], e.sz)) return Status::IOError("read data block failed");
-            if (fill_cache) bc->Put(cache_key, block_data);
+int SSTableReader::BlockFor(const Slice& key, Statistics* stats) const {
+    {
+        PerfTimer t(&PerfContext::filter_nanos);
+        if (!filter_reader_->KeyMayMatch(key)) {
+            RecordTick(stats, kBloomFilterUseful);
+            PerfCount(&PerfContext::bloom_filter_useful);
+            return -1;
         }
-    } else {
-        ifs_.seekg(e.off, std::ios::beg);
-        block_data.resize(e.sz);
-        if (!ifs_.read(&block_data[0], e.sz)) return Status::IOError("read data block failed");
     }
+    RecordTick(stats, kBloomFilterFullPositive);
+    PerfCount(&PerfContext::bloom_filter_full_positive);
+    PerfTimer t(&PerfContext::index_nanos);
+    return index_reader_->FindBlock(key);
+}
 
-    DataBlockReader dbr(Slice(block_data));
+void SSTableReader::SearchBlock(const Slice& block, const Slice& key, std::optional<MemValue>& result) const {
+    DataBlockReader dbr{block};
     ParsedEntry pe;
     while (dbr.Next(pe)) {
-        int c = pe.key.compare(key);
+        int c = cmp_(pe.key, key);
         if (c == 0) {
             MemValue mv; mv.type = pe.type; mv.value = pe.value.ToString();
-            result = mv; return Status::OK();
+            result = mv; return;
         }
         if (c > 0) break;
     }
-    result.reset(); return Status::OK();
+    result.reset();
 }
 
-void SSTableReader::Iterator::Init() {
-    if (r_->index().entries().empty()) { valid_ = false; return; }
-    block_index_ = 0;
-    ReadBlock(block_index_);
-    ParsedEntry e;
-    if (reader_ && reader_->Next(e)) {
-        key_ = e.key;
-        mv_.type = e.type; mv_.value = e.value.ToString();
-        valid_ = true;
-    } else { valid_ = false; }
+Status SSTableReader::Get(const Slice& key, std::optional<MemValue>& result, BlockCache* bc, bool fill_cache, Statistics* stats) {
+    int blk = BlockFor(key, stats);
+    if (blk < 0) { result.reset(); return Status::OK(); }
+    const auto& e = index_reader_->entries()[blk];
+
+    std::string block_data;
+    std::string cache_key = BlockCacheKey(blk);
+    if (!bc || !bc->Get(cache_key, &block_data)) {
+        {
+            PerfTimer t(&PerfContext::block_read_nanos);
+            Status s = ReadAt(e.off, e.sz, &block_data); if (!s.ok()) return s;
+        }
+        PerfCount(&PerfContext::block_read_count);
+        PerfCount(&PerfContext::block_read_bytes, e.sz);
+        if (bc && fill_cache) bc->Put(cache_key, block_data);
+    }
+    {
+        PerfTimer t(&PerfContext::block_decode_nanos);
+        SearchBlock(Slice(block_data), key, result);
+    }
+    if (result.has_value()) RecordTick(stats, kBloomFilterTruePositive);
+    return Status::OK();
 }
-void SSTableReader::Iterator::ReadBlock(int index) {
-    const auto& ent = r_->index().entries()[index];
-    r_->ifs_.seekg(ent.off, std::ios::beg);
-    block_buf_.resize(ent.sz);
-    if (!r_->ifs_.read(&block_buf_[0], ent.sz)) { valid_ = false; return; }
+
+#if defined(_WIN32)
+void SSTableReader::PrepareRead(TableRead*) const {}
+void SSTableReader::ReadAll(TableRead* reads, size_t n) {
+    for (size_t i = 0; i < n; ++i) reads[i].status = reads[i].table->ReadAt(reads[i].offset, reads[i].n, reads[i].dst, reads[i].direct);
+}
+std::future<void> SSTableReader::StartRead(TableRead* read) {
+    ReadAll(read, 1);
+    std::promise<void> p;
+    p.set_value();
+    return p.get_future();
+}
+void SSTableReader::StartRead(TableRead* read, std::function<void()> done) {
+    ReadAll(read, 1);
+    done();
+}
+void SSTableReader::FinishRead(TableRead*) {}
+#else
+void SSTableReader::PrepareRead(TableRead* read) const {
+    IORequest& req = read->req_;
+    req = IORequest{};
+    req.fd = fd_;
+    req.offset = read->offset;
+    req.len = read->n;
+#if defined(O_DIRECT)
+    if (read->direct || use_direct_reads_) {
+        std::call_once(direct_once_, [this]{ direct_fd_ = ::open(path_.c_str(), O_RDONLY | O_DIRECT); });
+        const uint64_t kAlign = 4096;
+        void* buf = nullptr;
+        uint64_t start = read->offset / kAlign * kAlign;
+        size_t len = (size_t)((read->offset + read->n + kAlign - 1) / kAlign * kAlign - start);
+        if (direct_fd_ >= 0 && posix_memalign(&buf, kAlign, len) == 0) {
+            read->bounce_.reset((char*)buf);
+            req.fd = direct_fd_;
+            req.offset = start;
+            req.len = len;
+            req.buf = read->bounce_.get();
+            return;
+        }
+    }
+#endif
+    read->dst->resize(read->n);
+    req.buf = &(*read->dst)[0];
+}
+
+void SSTableReader::ReadAll(TableRead* reads, size_t n) {
+    std::vector<IORequest> reqs(n);
+    for (size_t i = 0; i < n; ++i) {
+        reads[i].table->PrepareRead(&reads[i]);
+        reqs[i] = reads[i].req_;
+    }
+    IOEngine::Default()->Read(reqs.data(), n);
+    for (size_t i = 0; i < n; ++i) {
+        reads[i].req_.result = reqs[i].result;
+        FinishRead(&reads[i]);
+    }
+}
+
+std::future<void> SSTableReader::StartRead(TableRead* read) {
+    read->table->PrepareRead(read);
+    return IOEngine::Default()->ReadAsync(&read->req_, 1);
+}
+
+void SSTableReader::StartRead(TableRead* read, std::function<void()> done) {
+    read->table->PrepareRead(read);
+    IOEngine::Default()->ReadAsync(&read->req_, 1, std::move(done));
+}
+
+void SSTableReader::FinishRead(TableRead* read) {
+    const IORequest& req = read->req_;
+    uint64_t skip = read->offset - req.offset;
+    if (req.result < 0) read->status = Status::IOError("read failed: " + read->table->path_);
+    else if ((uint64_t)req.result < skip + read->n) read->status = Status::IOError("short read: " + read->table->path_);
+    else {
+        if (read->bounce_) read->dst->assign(read->bounce_.get() + skip, read->n);
+        read->status = Status::OK();
+    }
+    read->bounce_.reset();
+}
+#endif
+
+Status SSTableReader::LastKey(std::string* out) const {
+    const auto& entries = index_reader_->entries();
+    if (entries.empty()) return Status::NotFound("empty table");
+    std::string block_data;
+    Status s = ReadAt(entries.back().off, entries.back().sz, &block_data);
+    if (!s.ok()) return s;
+    DataBlockReader dbr{Slice(block_data)};
+    ParsedEntry pe;
+    bool any = false;
+    while (dbr.Next(pe)) { out->assign(pe.key.data(), pe.key.size()); any = true; }
+    return any ? Status::OK() : Status::Corruption("empty data block");
+}
+
+void SSTableReader::Iterator::SeekToFirst() {
+    block_index_ = -1;
     delete reader_;
-    reader_ = new DataBlockReader(Slice(block_buf_));
+    reader_ = nullptr;
+    Advance();
+}
+// Last block (exclusive) of a readahead_-byte window starting at block first.
+int SSTableReader::Iterator::WindowEnd(int first) const {
+    const auto& entries = r_->index().entries();
+    int end = first + 1;
+    while (end < (int)entries.size() && entries[end].off + entries[end].sz - entries[first].off <= readahead_) ++end;
+    return end;
+}
+
+// Data blocks are laid out back to back, so a window is one contiguous read.
+Status SSTableReader::Iterator::ReadWindow(int first, int end, Window* w) const {
+    const auto& entries = r_->index().entries();
+    uint64_t off = entries[first].off;
+    size_t n = (size_t)(entries[end - 1].off + entries[end - 1].sz - off);
+    if (rate_limiter_) rate_limiter_->Request((int64_t)n, RateLimiter::kLow);
+    return r_->ReadAt(off, n, &w->buf, direct_);
+}
+
+// Reads the window starting at block first through the IO engine while the
+// caller keeps consuming ra_.
+void SSTableReader::Iterator::StartPrefetch(int first) {
+    if (prefetch_.valid()) FinishPrefetch(); // pf_ may still be being filled
+    const auto& entries = r_->index().entries();
+    if (readahead_ == 0 || first >= (int)entries.size()) { pf_.first = pf_.end = 0; return; }
+    pf_.first = first;
+    pf_.end = WindowEnd(first);
+    pf_.off = entries[first].off;
+    pf_read_.table = r_;
+    pf_read_.offset = pf_.off;
+    pf_read_.n = (size_t)(entries[pf_.end - 1].off + entries[pf_.end - 1].sz - pf_.off);
+    pf_read_.dst = &pf_.buf;
+    pf_read_.direct = direct_;
+    if (rate_limiter_) rate_limiter_->Request((int64_t)pf_read_.n, RateLimiter::kLow);
+    prefetch_ = SSTableReader::StartRead(&pf_read_);
+}
+
+bool SSTableReader::Iterator::FinishPrefetch() {
+    prefetch_.get();
+    SSTableReader::FinishRead(&pf_read_);
+    return pf_read_.status.ok();
+}
+
+bool SSTableReader::Iterator::ReadBlock(int index) {
+    delete reader_;
+    reader_ = nullptr;
+    const auto& ent = r_->index().entries()[index];
+    bool sequential = index == last_block_ + 1;
+    last_block_ = index;
+    if (!ra_.Contains(index)) {
+        if (max_readahead_ > 0 && sequential) readahead_ = std::min(max_readahead_, readahead_ ? readahead_ * 2 : kInitialReadahead);
+        else readahead_ = 0;
+        if (pf_.Contains(index) && prefetch_.valid() && FinishPrefetch()) {
+            std::swap(ra_, pf_);
+            StartPrefetch(ra_.end);
+        } else if (readahead_ > 0 && WindowEnd(index) > index + 1) {
+            if (prefetch_.valid()) FinishPrefetch();
+            ra_.first = index;
+            ra_.end = WindowEnd(index);
+            ra_.off = ent.off;
+            status_ = ReadWindow(ra_.first, ra_.end, &ra_);
+            if (!status_.ok()) { ra_.first = ra_.end = 0; return false; }
+            StartPrefetch(ra_.end);
+        } else {
+            if (rate_limiter_) rate_limiter_->Request((int64_t)ent.sz, RateLimiter::kLow);
+            status_ = r_->ReadAt(ent.off, ent.sz, &block_buf_, direct_);
+            if (!status_.ok()) return false;
+            reader_ = new DataBlockReader(Slice(block_buf_));
+            return true;
+        }
+    }
+    reader_ = new DataBlockReader(Slice(ra_.buf.data() + (ent.off - ra_.off), ent.sz));
+    return true;
+}
+// Moves to the next entry, crossing into following blocks as needed.
+void SSTableReader::Iterator::Advance() {
+    while (!reader_ || !reader_->Next(e_)) {
+        if (++block_index_ >= (int)r_->index().entries().size() || !ReadBlock(block_index_)) { valid_ = false; return; }
+    }
+    valid_ = true;
 }
 void SSTableReader::Iterator::Next() {
     if (!valid_) return;
-    ParsedEntry e;
-    if (reader_->Next(e)) {
-        key_ = e.key;
-        mv_.type = e.type; mv_.value = e.value.ToString();
-        valid_ = true; return;
-    }
-    block_index_++;
-    if (block_index_ >= (int)r_->index().entries().size()) { valid_ = false; return; }
-    ReadBlock(block_index_);
-    if (reader_->Next(e)) {
-        key_ = e.key;
-        mv_.type = e.type; mv_.value = e.value.ToString();
-        valid_ = true;
-    } else valid_ = false;
+    Advance();
+}
+void SSTableReader::Iterator::Seek(const Slice& target) {
+    // Index keys are each block's first key: start in the last block beginning at or before target.
+    block_index_ = std::max(0, r_->index().FindBlock(target)) - 1;
+    delete reader_;
+    reader_ = nullptr;
+    do { Advance(); } while (valid_ && r_->cmp_(e_.key, target) < 0);
 }
 
 } // namespace lsmkv
@@ -1,51 +1,146 @@
 #pragma once
 #include <string>
-#include <fstream>
 #include <memory>
 #include <optional>
+#include <future>
 #include <cstring>
+#include <mutex>
+#include <cstdlib>
 #include "format.h"
 #include "block.h"
 #include "index_block.h"
 #include "../util/status.h"
 #include "../util/slice.h"
 #include "../util/bloom_filter.h"
+#include "../util/rate_limiter.h"
+#include "../util/iterator.h"
+#include "../util/io_engine.h"
+#include "../util/statistics.h"
+#include "../util/perf_context.h"
+#include "../util/comparator.h"
 
 namespace lsmkv {
 
 class BlockCache;
+class SSTableReader;
+
+// A read of [offset, offset+n) from one table into *dst, issued together with
+// others through SSTableReader::ReadAll or one at a time in the background.
+// Direct reads go through an aligned bounce buffer.
+struct TableRead {
+    const SSTableReader* table = nullptr;
+    uint64_t offset = 0;
+    size_t n = 0;
+    std::string* dst = nullptr;
+    bool direct = false; // O_DIRECT even if the table does not use direct reads
+    Status status;
+
+private:
+    friend class SSTableReader;
+    IORequest req_;
+    std::unique_ptr<char, void(*)(void*)> bounce_{nullptr, free};
+};
 
 class SSTableReader {
 public:
-    static Status Open(const std::string& file_path, std::shared_ptr<SSTableReader>* out);
+    // use_direct_reads: every read bypasses the page cache (O_DIRECT). cmp is
+    // the order the table was written in.
+    static Status Open(const std::string& file_path, std::shared_ptr<SSTableReader>* out, bool use_direct_reads = false,
+                       const Comparator* cmp = BytewiseComparator());
 
     ~SSTableReader() { Close(); }
 
-    Status Get(const Slice& key, std::optional<MemValue>& result, BlockCache* bc, bool fill_cache);
+    // Filter outcomes are counted in stats when given.
+    Status Get(const Slice& key, std::optional<MemValue>& result, BlockCache* bc, bool fill_cache, Statistics* stats = nullptr);
     void Close();
 
-    class Iterator {
+    // Largest key in the file, decoded from the last data block.
+    Status LastKey(std::string* out) const;
+
+    // Positional read, safe to call from several threads sharing one reader.
+    Status ReadAt(uint64_t offset, size_t n, std::string* dst) const { return ReadAt(offset, n, dst, use_direct_reads_); }
+    // direct: read the aligned range around [offset, offset+n) with O_DIRECT into an aligned buffer.
+    Status ReadAt(uint64_t offset, size_t n, std::string* dst, bool direct) const;
+
+    // Issues all reads at once through IOEngine and waits for them; each
+    // read's status is set. Reads may target different tables.
+    static void ReadAll(TableRead* reads, size_t n);
+    // Background variant for a single read: call FinishRead after the future is ready.
+    static std::future<void> StartRead(TableRead* read);
+    // Callback variant: done runs on an IOEngine executor thread and should call FinishRead.
+    static void StartRead(TableRead* read, std::function<void()> done);
+    static void FinishRead(TableRead* read);
+
+    // Point-lookup building blocks, shared by Get and DB::MultiGet. BlockFor
+    // returns the index of the block that may hold key, or -1 when the
+    // filter or key range rules the table out.
+    int BlockFor(const Slice& key, Statistics* stats = nullptr) const;
+    std::string BlockCacheKey(int block) const { return path_ + ":" + std::to_string(index_reader_->entries()[block].off); }
+    void SearchBlock(const Slice& block, const Slice& key, std::optional<MemValue>& result) const;
+
+    // Walks the data blocks in order; starts unpositioned. Once blocks are
+    // read back to back, whole runs of them are read at once into a window
+    // that starts at kInitialReadahead and doubles up to max_readahead bytes,
+    // and the next window is prefetched in the background while this one is
+    // consumed. Random access (Seek) reads single blocks and resets the window.
+    class Iterator final : public InternalIterator {
     public:
-        explicit Iterator(SSTableReader* r) : r_(r) { Init(); }
-        ~Iterator() { delete reader_; }
-        bool Valid() const { return valid_; }
-        void Next();
-        Slice key() const { return key_; }
-        MemValue value() const { return mv_; }
+        static constexpr size_t kInitialReadahead = 16 * 1024;
+
+        // Reads are charged to rl at low priority when given (compaction
+        // inputs); direct reads with O_DIRECT even if the reader does not;
+        // max_readahead 0 reads one block at a time.
+        explicit Iterator(SSTableReader* r, RateLimiter* rl = nullptr, bool direct = false, size_t max_readahead = 0)
+            : r_(r), rate_limiter_(rl), direct_(direct || r->use_direct_reads_), max_readahead_(max_readahead) {}
+        ~Iterator() override {
+            if (prefetch_.valid()) prefetch_.wait();
+            delete reader_;
+        }
+        bool Valid() const override { return valid_; }
+        void SeekToFirst() override;
+        void Seek(const Slice& target) override;
+        void Next() override;
+        Slice key() const override { return e_.key; }
+        Slice value() const override { return e_.value; }
+        ValueType type() const override { return e_.type; }
+        Status status() const override { return status_; }
     private:
-        void Init();
-        void ReadBlock(int index);
+        // Blocks [first, end) read in one request, starting at file offset off.
+        struct Window {
+            std::string buf;
+            uint64_t off = 0;
+            int first = 0, end = 0;
+            bool Contains(int index) const { return index >= first && index < end; }
+        };
+
+        void Advance();
+        bool ReadBlock(int index);
+        int WindowEnd(int first) const;
+        Status ReadWindow(int first, int end, Window* w) const;
+        void StartPrefetch(int first);
+        bool FinishPrefetch();
+
         SSTableReader* r_;
+        RateLimiter* rate_limiter_;
+        bool direct_;
+        size_t max_readahead_;
+        size_t readahead_ = 0; // current window size; 0 until access turns sequential
+        int last_block_ = -2;
+        Window ra_;            // window the current block is served from
+        Window pf_;            // filled by prefetch_
+        TableRead pf_read_;
+        std::future<void> prefetch_;
         bool valid_ = false;
         int block_index_ = -1;
         std::string block_buf_;
         DataBlockReader* reader_ = nullptr;
         ParsedEntry e_;
-        Slice key_;
-        MemValue mv_;
+        Status status_;
     };
 
-    std::unique_ptr<Iterator> NewIterator() { return std::unique_ptr<Iterator>(new Iterator(this)); }
+    std::unique_ptr<Iterator> NewIterator(RateLimiter* rl = nullptr, bool direct = false, size_t max_readahead = 0) {
+        return std::unique_ptr<Iterator>(new Iterator(this, rl, direct, max_readahead));
+    }
 
     const IndexBlockReader& index() const { return *index_reader_; }
     const BloomFilterReader& filter() const { return *filter_reader_; }
@@ -53,11 +148,21 @@ public:
 private:
     SSTableReader() = default;
     Status Load();
+    void PrepareRead(TableRead* read) const;
 
-    std::ifstream ifs_;
+    int fd_ = -1;
+    bool use_direct_reads_ = false;
+    UserKeyComparator cmp_;
+    mutable std::once_flag direct_once_;
+    mutable int direct_fd_ = -1; // opened on the first direct read; -1 if O_DIRECT is unsupported
+    uint64_t file_size_ = 0;
+#if defined(_WIN32)
+    mutable std::mutex io_mu_; // _lseeki64 + _read share the file position
+#endif
     std::string path_;
     Footer footer_;
     std::unique_ptr<IndexBlockReader> index_reader_;
+    std::string filter_data_; // BloomFilterReader points into this
     std::unique_ptr<BloomFilterReader> filter_reader_;
 };
 
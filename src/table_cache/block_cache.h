@@ -3,22 +3,33 @@
 #include <list>
 #include <string>
 #include <mutex>
+#include "../util/statistics.h"
+#include "../util/perf_context.h"
 
 namespace lsmkv {
 
 class BlockCache {
 public:
-    explicit BlockCache(size_t capacity_bytes) : capacity_(capacity_bytes), usage_(0) {}
+    // Hits and misses are counted in stats when given.
+    explicit BlockCache(size_t capacity_bytes, Statistics* stats = nullptr) : stats_(stats), capacity_(capacity_bytes), usage_(0) {}
 
     bool Get(const std::string& key, std::string* value_out) {
         std::lock_guard<std::mutex> lg(mu_);
         auto it = map_.find(key);
-        if (it == map_.end()) return false;
+        if (it == map_.end()) { RecordTick(stats_, kBlockCacheMiss); return false; }
+        RecordTick(stats_, kBlockCacheHit);
+        PerfCount(&PerfContext::block_cache_hit_count);
         lru_.splice(lru_.begin(), lru_, it->second);
         *value_out = it->second->value;
         return true;
     }
 
+    size_t Usage() const {
+        std::lock_guard<std::mutex> lg(mu_);
+        return usage_;
+    }
+    size_t Capacity() const { return capacity_; }
+
     void Put(const std::string& key, const std::string& value) {
         std::lock_guard<std::mutex> lg(mu_);
         auto it = map_.find(key);
@@ -38,7 +49,8 @@ public:
 
 private:
     struct Node { std::string key; std::string value; };
-    std::mutex mu_;
+    mutable std::mutex mu_;
+    Statistics* stats_;
     size_t capacity_, usage_;
     std::list<Node> lru_;
     std::unordered_map<std::string, std::list<Node>::iterator> map_;
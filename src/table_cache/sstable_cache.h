@@ -1,38 +1,119 @@
 #pragma once
 #include <unordered_map>
+#include <list>
 #include <string>
 #include <memory>
 #include <mutex>
+#include <condition_variable>
 #include "../sstable/sstable_reader.h"
 
 namespace lsmkv {
 
+// LRU cache of open SSTableReaders keyed by file path. Tables of all column
+// families share it; each caller passes its family's comparator, which the
+// table is opened with on a miss.
+// Handles are refcounted: an evicted table stays usable until the last handle goes away.
+// Opening happens outside the cache lock and concurrent misses on the same file share one open.
 class SSTableCache {
 public:
-    explicit SSTableCache(size_t max_open) : max_open_(max_open) {}
+    using Handle = std::shared_ptr<SSTableReader>;
+
+    explicit SSTableCache(size_t max_open, bool use_direct_reads = false)
+        : max_open_(max_open), use_direct_reads_(use_direct_reads) {}
+
+    Status Get(const std::string& path, Handle* out, const Comparator* cmp) {
+        std::shared_ptr<Loading> loading;
+        {
+            std::unique_lock<std::mutex> lk(mu_);
+            auto it = map_.find(path);
+            if (it != map_.end()) {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                *out = it->second->table;
+                return Status::OK();
+            }
+            auto lit = loading_.find(path);
+            if (lit != loading_.end()) {
+                loading = lit->second;
+                cv_.wait(lk, [&]{ return loading->done; });
+                if (!loading->status.ok()) return loading->status;
+                *out = loading->table;
+                return Status::OK();
+            }
+            loading = std::make_shared<Loading>();
+            loading_[path] = loading;
+        }
+
+        Handle r;
+        Status s = SSTableReader::Open(path, &r, use_direct_reads_, cmp);
 
-    bool Get(const std::string& path, std::shared_ptr<SSTableReader>& out) {
         std::lock_guard<std::mutex> lg(mu_);
-        auto it = cache_.find(path);
-        if (it != cache_.end()) { out = it->second; return true; }
-        if (cache_.size() >= max_open_) cache_.erase(cache_.begin());
-        std::shared_ptr<SSTableReader> r;
-        Status s = SSTableReader::Open(path, &r);
-        if (!s.ok()) return false;
-        cache_[path] = r;
-        out = r;
+        loading->status = s;
+        loading->table = r;
+        loading->done = true;
+        loading_.erase(path);
+        if (s.ok() && !loading->erased) Insert(path, r);
+        cv_.notify_all();
+        if (!s.ok()) return s;
+        *out = r;
+        return Status::OK();
+    }
+
+    // The table if it is open already; never opens it or waits for an open.
+    bool Lookup(const std::string& path, Handle* out) {
+        std::lock_guard<std::mutex> lg(mu_);
+        auto it = map_.find(path);
+        if (it == map_.end()) return false;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        *out = it->second->table;
         return true;
     }
 
+    // Opens the table and loads its index and filter so the first read does not pay for it.
+    void Preload(const std::string& path, const Comparator* cmp) {
+        Handle h;
+        Get(path, &h, cmp);
+    }
+
+    // Called when a file is deleted; in-flight opens of the same path are not cached.
     void Erase(const std::string& path) {
         std::lock_guard<std::mutex> lg(mu_);
-        cache_.erase(path);
+        auto it = map_.find(path);
+        if (it != map_.end()) { lru_.erase(it->second); map_.erase(it); }
+        auto lit = loading_.find(path);
+        if (lit != loading_.end()) lit->second->erased = true;
+    }
+
+    size_t Size() const {
+        std::lock_guard<std::mutex> lg(mu_);
+        return map_.size();
     }
 
 private:
+    struct Node { std::string path; Handle table; };
+    struct Loading {
+        bool done = false;
+        bool erased = false;
+        Status status;
+        Handle table;
+    };
+
+    void Insert(const std::string& path, const Handle& r) {
+        lru_.push_front(Node{path, r});
+        map_[path] = lru_.begin();
+        while (map_.size() > max_open_ && !lru_.empty()) {
+            auto last = std::prev(lru_.end());
+            map_.erase(last->path);
+            lru_.pop_back();
+        }
+    }
+
     size_t max_open_;
-    std::mutex mu_;
-    std::unordered_map<std::string, std::shared_ptr<SSTableReader>> cache_;
+    bool use_direct_reads_;
+    mutable std::mutex mu_;
+    std::condition_variable cv_;
+    std::list<Node> lru_;
+    std::unordered_map<std::string, std::list<Node>::iterator> map_;
+    std::unordered_map<std::string, std::shared_ptr<Loading>> loading_;
 };
 
 } // namespace lsmkv
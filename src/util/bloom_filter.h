@@ -11,10 +11,11 @@ class BloomFilterBuilder {
 public:
     explicit BloomFilterBuilder(unsigned bits_per_key = 10) : bits_per_key_(bits_per_key) {}
 
-    void AddKey(const Slice& key) { keys_.emplace_back(key.ToString()); }
+    // Only the hash is kept; the bits are laid out in Finalize once the key count is known.
+    void AddKey(const Slice& key) { hashes_.push_back(Hash64(key.data(), key.size())); }
 
     std::string Finalize() {
-        size_t n = keys_.size();
+        size_t n = hashes_.size();
         size_t bits = n * bits_per_key_;
         if (bits < 64) bits = 64;
         size_ = (bits + 7) / 8;
@@ -23,8 +24,7 @@ public:
         if (k_ < 1) k_ = 1;
         if (k_ > 30) k_ = 30;
 
-        for (const auto& key : keys_) {
-            uint64_t h = Hash64(key.data(), key.size());
+        for (uint64_t h : hashes_) {
             uint32_t delta = (h >> 17) | (h << 15);
             for (unsigned j=0;j<k_;++j) {
                 uint32_t bitpos = (h % (size_ * 8));
@@ -40,7 +40,7 @@ public:
 
 private:
     unsigned bits_per_key_;
-    std::vector<std::string> keys_;
+    std::vector<uint64_t> hashes_;
     std::vector<unsigned char> data_;
     unsigned size_ = 0;
     unsigned k_ = 0;
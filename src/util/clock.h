@@ -0,0 +1,22 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+namespace lsmkv {
+
+inline uint64_t NowMicros() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+inline uint64_t NowSeconds() { return NowMicros() / 1000000; }
+
+// For measuring intervals: never jumps with wall-clock adjustments.
+inline uint64_t MonotonicNanos() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline uint64_t MonotonicMicros() { return MonotonicNanos() / 1000; }
+
+} // namespace lsmkv
@@ -32,6 +32,15 @@ inline const char* GetVarint64Ptr(const char* p, const char* limit, uint64_t* va
     return nullptr;
 }
 
+inline void PutLengthPrefixedSlice(std::string& dst, const char* data, size_t n) { PutVarint32(dst, (uint32_t)n); dst.append(data, n); }
+inline const char* GetLengthPrefixed(const char* p, const char* limit, std::string* out) {
+    uint32_t len = 0;
+    p = GetVarint32Ptr(p, limit, &len);
+    if (!p || (size_t)(limit - p) < len) return nullptr;
+    out->assign(p, len);
+    return p + len;
+}
+
 inline uint64_t Hash64(const char* data, size_t n, uint64_t seed=1469598103934665603ull) {
     uint64_t h = seed;
     for (size_t i=0;i<n;++i) { h ^= (unsigned char)data[i]; h *= 1099511628211ull; }
@@ -1,24 +1,118 @@
 #pragma once
+#include <cstdint>
+#include <cstring>
 #include "slice.h"
 
 namespace lsmkv {
 
+// Orders the keys of a column family: memtables, tables, index blocks and the
+// key ranges the MANIFEST records all follow it. Its Name() is stored in the
+// MANIFEST, and a DB cannot be reopened with a comparator of another name.
 class Comparator {
 public:
+    // The built-in orders, which hot loops compare inline (see KeyCompare and
+    // UserKeyComparator); any other comparator is kCustom and called virtually.
+    enum Kind { kCustom, kBytewise, kFixed64, kFixed128 };
+
     virtual ~Comparator() = default;
     virtual int Compare(const Slice& a, const Slice& b) const = 0;
     virtual const char* Name() const = 0;
+    Kind kind() const { return kind_; }
+
+protected:
+    explicit Comparator(Kind kind = kCustom) : kind_(kind) {}
+
+private:
+    const Kind kind_;
+};
+
+inline uint64_t DecodeBigEndian64(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return v;
+#elif defined(_MSC_VER)
+    return _byteswap_uint64(v);
+#else
+    return __builtin_bswap64(v);
+#endif
+}
+
+template <Comparator::Kind K> struct KeyCompare;
+
+template <> struct KeyCompare<Comparator::kBytewise> {
+    static int Compare(const Slice& a, const Slice& b) { return a.compare(b); }
+};
+
+// Keys of exactly 8 (16) bytes compared as big-endian unsigned integers: one
+// (two) integer compares instead of a memcmp call. That is the keys' bytewise
+// order too, which keys of any other length fall back to.
+template <> struct KeyCompare<Comparator::kFixed64> {
+    static int Compare(const Slice& a, const Slice& b) {
+        if (a.size() != 8 || b.size() != 8) return a.compare(b);
+        uint64_t x = DecodeBigEndian64(a.data()), y = DecodeBigEndian64(b.data());
+        return x < y ? -1 : x > y;
+    }
+};
+
+template <> struct KeyCompare<Comparator::kFixed128> {
+    static int Compare(const Slice& a, const Slice& b) {
+        if (a.size() != 16 || b.size() != 16) return a.compare(b);
+        uint64_t x = DecodeBigEndian64(a.data()), y = DecodeBigEndian64(b.data());
+        if (x == y) { x = DecodeBigEndian64(a.data() + 8); y = DecodeBigEndian64(b.data() + 8); }
+        return x < y ? -1 : x > y;
+    }
 };
 
-class BytewiseComparatorImpl : public Comparator {
+template <Comparator::Kind K>
+class BuiltinComparator final : public Comparator {
 public:
-    int Compare(const Slice& a, const Slice& b) const override { return a.compare(b); }
-    const char* Name() const override { return "lsmkv.BytewiseComparator"; }
+    explicit BuiltinComparator(const char* name) : Comparator(K), name_(name) {}
+    int Compare(const Slice& a, const Slice& b) const override { return KeyCompare<K>::Compare(a, b); }
+    const char* Name() const override { return name_; }
+
+private:
+    const char* name_;
 };
 
 inline const Comparator* BytewiseComparator() {
-    static BytewiseComparatorImpl cmp;
+    static BuiltinComparator<Comparator::kBytewise> cmp("lsmkv.BytewiseComparator");
+    return &cmp;
+}
+
+// For keys that are 8-byte big-endian unsigned integers, e.g. timestamps.
+inline const Comparator* FixedBigEndian64Comparator() {
+    static BuiltinComparator<Comparator::kFixed64> cmp("lsmkv.FixedBigEndian64Comparator");
+    return &cmp;
+}
+
+// For 16-byte big-endian keys, e.g. a series id followed by a timestamp.
+inline const Comparator* FixedBigEndian128Comparator() {
+    static BuiltinComparator<Comparator::kFixed128> cmp("lsmkv.FixedBigEndian128Comparator");
     return &cmp;
 }
 
+// A Comparator as a function object, for SkipList and the search loops. The
+// switch is on a kind fixed for the object's lifetime, so it predicts
+// perfectly and each built-in case inlines; only kCustom makes a virtual call.
+class UserKeyComparator {
+public:
+    explicit UserKeyComparator(const Comparator* cmp = BytewiseComparator()) : cmp_(cmp), kind_(cmp->kind()) {}
+
+    int operator()(const Slice& a, const Slice& b) const {
+        switch (kind_) {
+            case Comparator::kBytewise: return KeyCompare<Comparator::kBytewise>::Compare(a, b);
+            case Comparator::kFixed64: return KeyCompare<Comparator::kFixed64>::Compare(a, b);
+            case Comparator::kFixed128: return KeyCompare<Comparator::kFixed128>::Compare(a, b);
+            default: return cmp_->Compare(a, b);
+        }
+    }
+    bool Less(const Slice& a, const Slice& b) const { return (*this)(a, b) < 0; }
+    const Comparator* comparator() const { return cmp_; }
+
+private:
+    const Comparator* cmp_;
+    Comparator::Kind kind_;
+};
+
 } // namespace lsmkv
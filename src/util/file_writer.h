@@ -0,0 +1,245 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "slice.h"
+#include "status.h"
+
+#if defined(_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#include <malloc.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace lsmkv {
+
+// Threads shared by every BufferedFileWriter in the process. A thread per open
+// file would add one per flush, subcompaction output and blob file; a writer
+// never has more than one buffer queued here, so its writes stay in order.
+class FileWriterThreads {
+public:
+    static constexpr unsigned kThreads = 4;
+
+    // Process-wide pool, created on first use and never destroyed.
+    static FileWriterThreads* Default() {
+        static FileWriterThreads* pool = new FileWriterThreads();
+        return pool;
+    }
+
+    void Schedule(std::function<void()> fn) {
+        std::lock_guard<std::mutex> lg(mu_);
+        queue_.push_back(std::move(fn));
+        cv_.notify_one();
+    }
+
+private:
+    FileWriterThreads() {
+        for (unsigned i = 0; i < kThreads; ++i) std::thread([this]{ Run(); }).detach();
+    }
+
+    void Run() {
+        while (true) {
+            std::function<void()> fn;
+            {
+                std::unique_lock<std::mutex> lk(mu_);
+                cv_.wait(lk, [&]{ return !queue_.empty(); });
+                fn = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            fn();
+        }
+    }
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> queue_;
+};
+
+// Sequential file writer with two aligned buffers: the caller fills one while
+// a shared I/O thread writes the other, so building the next block overlaps
+// the write() of the previous buffer. Each written buffer is handed to
+// sync_file_range for early writeback, which keeps the fsync in Close short.
+//
+// With direct I/O (O_DIRECT) the page cache is bypassed: every write is a
+// whole aligned buffer, the tail is zero-padded and the file is truncated back
+// to its real size on Close. Filesystems that refuse O_DIRECT get buffered I/O.
+class BufferedFileWriter {
+public:
+    static constexpr size_t kAlignment = 4096;
+
+    explicit BufferedFileWriter(size_t buffer_size = 1 << 20)
+        : cap_(std::max(kAlignment, (buffer_size + kAlignment - 1) / kAlignment * kAlignment)) {
+        for (auto& b : buf_) b = static_cast<char*>(AlignedAlloc(cap_));
+    }
+    ~BufferedFileWriter() {
+        Close(false);
+        for (auto& b : buf_) AlignedFree(b);
+    }
+    BufferedFileWriter(const BufferedFileWriter&) = delete;
+    BufferedFileWriter& operator=(const BufferedFileWriter&) = delete;
+
+    Status Open(const std::string& path, bool use_direct_io = false) {
+        path_ = path;
+        direct_ = false;
+#if defined(_WIN32)
+        (void)use_direct_io;
+        fd_ = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+#if defined(O_DIRECT)
+        if (use_direct_io) {
+            fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+            direct_ = fd_ >= 0;
+        }
+#else
+        (void)use_direct_io;
+#endif
+        if (!direct_) fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+        if (fd_ < 0) return Status::IOError("open for write failed: " + path);
+        fill_ = 0;
+        written_ = 0;
+        written_total_ = 0;
+        status_ = Status::OK();
+        return Status::OK();
+    }
+
+    Status Append(const Slice& data) {
+        const char* p = data.data();
+        size_t n = data.size();
+        while (n > 0) {
+            size_t take = std::min(n, cap_ - fill_);
+            std::memcpy(buf_[active_] + fill_, p, take);
+            fill_ += take; p += take; n -= take;
+            if (fill_ == cap_) {
+                Status s = Submit();
+                if (!s.ok()) return s;
+            }
+        }
+        return Status::OK();
+    }
+
+    // Writes what is buffered, fsyncs if asked and closes. Safe to call twice.
+    Status Close(bool sync) {
+        if (fd_ < 0) return Status::OK();
+        const uint64_t size = written_total_ + fill_;
+        if (direct_ && fill_ % kAlignment) {
+            size_t padded = (fill_ + kAlignment - 1) / kAlignment * kAlignment;
+            std::memset(buf_[active_] + fill_, 0, padded - fill_);
+            fill_ = padded;
+        }
+        Status s = fill_ > 0 ? Submit() : Status::OK();
+        {
+            std::unique_lock<std::mutex> lk(mu_);
+            cv_.wait(lk, [&]{ return pending_ == nullptr; });
+            if (s.ok()) s = status_;
+        }
+#if !defined(_WIN32)
+        if (s.ok() && direct_ && ::ftruncate(fd_, (off_t)size) != 0) s = Status::IOError("truncate failed: " + path_);
+#else
+        (void)size;
+#endif
+#if defined(_WIN32)
+        if (s.ok() && sync && _commit(fd_) != 0) s = Status::IOError("fsync failed: " + path_);
+        _close(fd_);
+#else
+        if (s.ok() && sync && ::fsync(fd_) != 0) s = Status::IOError("fsync failed: " + path_);
+        ::close(fd_);
+#endif
+        fd_ = -1;
+        return s;
+    }
+
+private:
+    static void* AlignedAlloc(size_t n) {
+#if defined(_WIN32)
+        return _aligned_malloc(n, kAlignment);
+#else
+        void* p = nullptr;
+        if (posix_memalign(&p, kAlignment, n) != 0) throw std::bad_alloc();
+        return p;
+#endif
+    }
+    static void AlignedFree(void* p) {
+#if defined(_WIN32)
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+
+    // Hands the active buffer to the I/O threads and switches to the other one,
+    // waiting only while that one is still being written.
+    Status Submit() {
+        std::unique_lock<std::mutex> lk(mu_);
+        cv_.wait(lk, [&]{ return pending_ == nullptr; });
+        if (!status_.ok()) return status_;
+        pending_ = buf_[active_];
+        pending_len_ = fill_;
+        written_total_ += fill_;
+        active_ ^= 1;
+        fill_ = 0;
+        lk.unlock();
+        FileWriterThreads::Default()->Schedule([this]{ WritePending(); });
+        return Status::OK();
+    }
+
+    // Runs on an I/O thread. Close waits for pending_ to clear, so the writer
+    // outlives this call.
+    void WritePending() {
+        Status s = WriteFully(pending_, pending_len_);
+        std::lock_guard<std::mutex> lg(mu_);
+        if (!s.ok() && status_.ok()) status_ = s;
+        pending_ = nullptr;
+        cv_.notify_all();
+    }
+
+    Status WriteFully(const char* p, size_t n) {
+        uint64_t start = written_;
+        while (n > 0) {
+#if defined(_WIN32)
+            int r = _write(fd_, p, (unsigned)n);
+#else
+            ssize_t r = ::write(fd_, p, n);
+            if (r < 0 && errno == EINTR) continue;
+#endif
+            if (r <= 0) return Status::IOError("write failed: " + path_);
+            p += r; n -= (size_t)r; written_ += (uint64_t)r;
+        }
+#if defined(__linux__)
+        if (!direct_) ::sync_file_range(fd_, (off_t)start, (off_t)(written_ - start), SYNC_FILE_RANGE_WRITE);
+#else
+        (void)start;
+#endif
+        return Status::OK();
+    }
+
+    const size_t cap_;
+    char* buf_[2] = {nullptr, nullptr};
+    int active_ = 0;
+    size_t fill_ = 0;
+    std::string path_;
+    int fd_ = -1;
+    bool direct_ = false;
+    uint64_t written_ = 0;       // only touched by the write of the pending buffer
+    uint64_t written_total_ = 0; // bytes submitted, only touched by the caller
+
+    std::mutex mu_;
+    std::condition_variable cv_;
+    const char* pending_ = nullptr; // buffer handed to the I/O threads
+    size_t pending_len_ = 0;
+    Status status_;
+};
+
+} // namespace lsmkv
@@ -0,0 +1,269 @@
+#include "io_engine.h"
+
+#if !defined(_WIN32)
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define LSMKV_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace lsmkv {
+
+struct IOEngine::Batch {
+    std::promise<void> done;
+    std::function<void()> callback; // run instead of fulfilling done when set
+    std::atomic<size_t> remaining{0};
+    std::vector<Op> ops;
+};
+
+#if defined(LSMKV_HAVE_IO_URING)
+// Submission and completion queues shared with the kernel. Only the caller
+// holding mu_ touches the SQ tail and only the reaper thread the CQ head.
+struct IOEngine::Ring {
+    int fd = -1;
+    unsigned entries = 0;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_sqe* sqes;
+    io_uring_cqe* cqes;
+
+    static int Enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+    }
+
+    // Maps the rings; false if the kernel (or a seccomp filter) refuses io_uring.
+    bool Setup(unsigned depth) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        fd = (int)syscall(__NR_io_uring_setup, depth, &p);
+        if (fd < 0) return false;
+        entries = p.sq_entries;
+        size_t sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sq_sz = cq_sz = std::max(sq_sz, cq_sz);
+        char* sq = (char*)mmap(nullptr, sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq == MAP_FAILED) { close(fd); return false; }
+        char* cq = single ? sq : (char*)mmap(nullptr, cq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) { close(fd); return false; }
+        sqes = (io_uring_sqe*)mmap(nullptr, p.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) { close(fd); return false; }
+        sq_head = (unsigned*)(sq + p.sq_off.head);
+        sq_tail = (unsigned*)(sq + p.sq_off.tail);
+        sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+        sq_array = (unsigned*)(sq + p.sq_off.array);
+        cq_head = (unsigned*)(cq + p.cq_off.head);
+        cq_tail = (unsigned*)(cq + p.cq_off.tail);
+        cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        return true;
+    }
+};
+#else
+struct IOEngine::Ring {};
+#endif
+
+IOEngine* IOEngine::Default() {
+    static IOEngine* engine = new IOEngine();
+    return engine;
+}
+
+IOEngine::IOEngine() {
+    for (unsigned i = 0; i < kCallbackThreads; ++i) threads_.emplace_back([this]{ CallbackLoop(); });
+#if defined(LSMKV_HAVE_IO_URING)
+    std::unique_ptr<Ring> ring(new Ring());
+    if (ring->Setup(kQueueDepth)) {
+        ring_ = std::move(ring);
+        threads_.emplace_back([this]{ ReapLoop(); });
+        return;
+    }
+#endif
+    for (unsigned i = 0; i < 16; ++i) threads_.emplace_back([this]{ PoolLoop(); });
+}
+
+std::future<void> IOEngine::ReadAsync(IORequest* reqs, size_t n) {
+    Batch* b = new Batch();
+    std::future<void> f = b->done.get_future();
+    if (n == 0) { b->done.set_value(); delete b; return f; }
+    Submit(b, reqs, n);
+    return f;
+}
+
+void IOEngine::ReadAsync(IORequest* reqs, size_t n, std::function<void()> done) {
+    if (n == 0) { Schedule(std::move(done)); return; }
+    Batch* b = new Batch();
+    b->callback = std::move(done);
+    Submit(b, reqs, n);
+}
+
+void IOEngine::Schedule(std::function<void()> fn) {
+    std::lock_guard<std::mutex> lg(cb_mu_);
+    callbacks_.push_back(std::move(fn));
+    cb_cv_.notify_one();
+}
+
+void IOEngine::CallbackLoop() {
+    while (true) {
+        std::function<void()> fn;
+        {
+            std::unique_lock<std::mutex> lk(cb_mu_);
+            cb_cv_.wait(lk, [&]{ return !callbacks_.empty(); });
+            fn = std::move(callbacks_.front());
+            callbacks_.pop_front();
+        }
+        fn();
+    }
+}
+
+void IOEngine::Submit(Batch* b, IORequest* reqs, size_t n) {
+    b->remaining = n;
+    b->ops.resize(n);
+    for (size_t i = 0; i < n; ++i) b->ops[i] = Op{&reqs[i], b};
+    // b may be freed by the last completion, so only its ops are touched below.
+    Op* ops = b->ops.data();
+    if (ring_) {
+        SubmitToRing(ops, n);
+    } else {
+        std::lock_guard<std::mutex> lg(mu_);
+        for (size_t i = 0; i < n; ++i) queue_.push_back(&ops[i]);
+        cv_.notify_all();
+    }
+}
+
+// Short reads are finished, and failed ring reads retried, with plain pread.
+void IOEngine::Finish(Op* op, long long res) {
+    IORequest* r = op->req;
+    size_t done = res > 0 ? (size_t)res : 0;
+    long long err = 0;
+    while (done < r->len) {
+        ssize_t got = ::pread(r->fd, r->buf + done, r->len - done, (off_t)(r->offset + done));
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) { err = -errno; break; }
+        if (got == 0) break;
+        done += (size_t)got;
+    }
+    r->result = err ? err : (long long)done;
+    Batch* b = op->batch;
+    if (b->remaining.fetch_sub(1) == 1) {
+        if (b->callback) Schedule(std::move(b->callback));
+        else b->done.set_value();
+        delete b;
+    }
+}
+
+void IOEngine::PoolLoop() {
+    while (true) {
+        Op* op;
+        {
+            std::unique_lock<std::mutex> lk(mu_);
+            cv_.wait(lk, [&]{ return !queue_.empty(); });
+            op = queue_.front();
+            queue_.pop_front();
+        }
+        Finish(op, 0);
+    }
+}
+
+#if defined(LSMKV_HAVE_IO_URING)
+void IOEngine::SubmitToRing(Op* ops, size_t n) {
+    std::vector<Op*> rejected;
+    {
+        std::lock_guard<std::mutex> lg(mu_);
+        for (size_t i = 0; i < n; ++i) queue_.push_back(&ops[i]);
+        FillRing(&rejected);
+    }
+    for (Op* op : rejected) Finish(op, 0);
+}
+
+// Moves queued ops into free SQ slots and submits them; what does not fit is
+// submitted by the reaper as completions free slots, so callers never block.
+// Never more in flight than SQ entries, so the CQ (twice as large) cannot overflow.
+// Entries the kernel refuses are taken back and returned in rejected, to be
+// read with pread outside mu_: no completion would ever arrive for them.
+void IOEngine::FillRing(std::vector<Op*>* rejected) {
+    Ring* r = ring_.get();
+    unsigned tail = *r->sq_tail;
+    for (; !queue_.empty() && inflight_ < r->entries; ++tail, ++inflight_) {
+        Op* op = queue_.front();
+        queue_.pop_front();
+        unsigned idx = tail & *r->sq_mask;
+        io_uring_sqe* sqe = &r->sqes[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = op->req->fd;
+        sqe->off = op->req->offset;
+        sqe->addr = (uint64_t)(uintptr_t)op->req->buf;
+        sqe->len = (uint32_t)op->req->len;
+        sqe->user_data = (uint64_t)(uintptr_t)op;
+        r->sq_array[idx] = idx;
+    }
+    __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+    // Entries left behind by an earlier failed enter are submitted too.
+    unsigned pending = tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    while (pending > 0) {
+        int ret;
+        if (inject_submit_errors_ > 0) { --inject_submit_errors_; ret = -1; errno = EIO; }
+        else ret = Ring::Enter(r->fd, pending, 0, 0);
+        if (ret < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY)) { std::this_thread::yield(); continue; }
+        if (ret <= 0) break;
+        pending -= (unsigned)ret;
+    }
+    if (pending == 0) return;
+    // Without SQPOLL the kernel only consumes entries inside enter, which is
+    // called with mu_ held, so the unconsumed tail can safely be rolled back.
+    unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    for (unsigned i = head; i != tail; ++i) rejected->push_back((Op*)(uintptr_t)r->sqes[r->sq_array[i & *r->sq_mask]].user_data);
+    __atomic_store_n(r->sq_tail, head, __ATOMIC_RELEASE);
+    inflight_ -= tail - head;
+    // With nothing in flight no completion will wake the reaper to refill
+    // the ring from the queue, so whatever waits there is read with pread too.
+    if (inflight_ == 0) {
+        rejected->insert(rejected->end(), queue_.begin(), queue_.end());
+        queue_.clear();
+    }
+}
+
+void IOEngine::ReapLoop() {
+    Ring* r = ring_.get();
+    std::vector<std::pair<Op*, long long>> done;
+    std::vector<Op*> rejected;
+    while (true) {
+        int ret = Ring::Enter(r->fd, 0, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) std::this_thread::yield();
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) continue;
+        done.clear();
+        for (; head != tail; ++head) {
+            io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+            done.emplace_back((Op*)(uintptr_t)cqe->user_data, (long long)cqe->res);
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+        rejected.clear();
+        {
+            std::lock_guard<std::mutex> lg(mu_);
+            inflight_ -= (unsigned)done.size();
+            if (!queue_.empty()) FillRing(&rejected);
+        }
+        for (auto& d : done) Finish(d.first, d.second);
+        for (Op* op : rejected) Finish(op, 0);
+    }
+}
+#else
+void IOEngine::SubmitToRing(Op*, size_t) {}
+void IOEngine::FillRing(std::vector<Op*>*) {}
+void IOEngine::ReapLoop() {}
+#endif
+
+} // namespace lsmkv
+
+#endif // !_WIN32
@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lsmkv {
+
+// One positional read. result is the number of bytes read (short only at
+// end of file) or -errno.
+struct IORequest {
+    int fd = -1;
+    uint64_t offset = 0;
+    size_t len = 0;
+    char* buf = nullptr;
+    long long result = 0;
+};
+
+// Keeps many reads in flight at once so a batch of block reads costs about
+// one device round trip instead of one per block. Uses io_uring through raw
+// syscalls where the kernel allows it, otherwise a pool of threads calling
+// pread. Thread-safe; requests must stay alive until their batch completes.
+//
+// Completion callbacks run on a few executor threads owned by the engine,
+// never on the thread reaping completions, so they may submit further reads.
+class IOEngine {
+public:
+    static constexpr unsigned kQueueDepth = 128;
+    static constexpr unsigned kCallbackThreads = 4;
+
+    // Process-wide engine, created on first use and never destroyed.
+    static IOEngine* Default();
+
+    // Starts the reads; the future is ready once every request has a result.
+    std::future<void> ReadAsync(IORequest* reqs, size_t n);
+    void Read(IORequest* reqs, size_t n) { if (n > 0) ReadAsync(reqs, n).wait(); }
+    // Starts the reads and calls done on an executor thread once all have finished.
+    void ReadAsync(IORequest* reqs, size_t n, std::function<void()> done);
+    // Runs fn on an executor thread.
+    void Schedule(std::function<void()> fn);
+
+    bool UsesIoUring() const { return ring_ != nullptr; }
+    // Makes the next n io_uring submissions fail with EIO. For tests.
+    void InjectSubmitErrors(int n) { inject_submit_errors_ = n; }
+
+private:
+    struct Batch;
+    struct Op { IORequest* req; Batch* batch; };
+    struct Ring;
+
+    IOEngine();
+    IOEngine(const IOEngine&) = delete;
+    IOEngine& operator=(const IOEngine&) = delete;
+
+    void Submit(Batch* b, IORequest* reqs, size_t n);
+    void SubmitToRing(Op* ops, size_t n);
+    void FillRing(std::vector<Op*>* rejected); // requires mu_
+    void ReapLoop();
+    void PoolLoop();
+    void CallbackLoop();
+    void Finish(Op* op, long long res);
+
+    std::unique_ptr<Ring> ring_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    unsigned inflight_ = 0;      // ring: submitted but not yet reaped
+    std::deque<Op*> queue_;      // waiting for a ring slot or a pool thread
+    std::atomic<int> inject_submit_errors_{0};
+    std::vector<std::thread> threads_;
+
+    std::mutex cb_mu_;
+    std::condition_variable cb_cv_;
+    std::deque<std::function<void()>> callbacks_;
+};
+
+} // namespace lsmkv
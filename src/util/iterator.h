@@ -0,0 +1,36 @@
+#pragma once
+#include <functional>
+#include <vector>
+#include "slice.h"
+#include "status.h"
+#include "../memtable/memtable.h"
+
+namespace lsmkv {
+
+// Sorted stream of entries, deletions included. key()/value() stay valid
+// until the next Seek/SeekToFirst/Next.
+class InternalIterator {
+public:
+    InternalIterator() = default;
+    InternalIterator(const InternalIterator&) = delete;
+    InternalIterator& operator=(const InternalIterator&) = delete;
+    virtual ~InternalIterator() { for (auto& fn : cleanups_) fn(); }
+
+    virtual bool Valid() const = 0;
+    virtual void SeekToFirst() = 0;
+    // Positions at the first key >= target.
+    virtual void Seek(const Slice& target) = 0;
+    virtual void Next() = 0;
+    virtual Slice key() const = 0;
+    virtual Slice value() const = 0;
+    virtual ValueType type() const = 0;
+    virtual Status status() const { return Status::OK(); }
+
+    // Runs fn when the iterator is destroyed, e.g. to drop what pins its data.
+    void RegisterCleanup(std::function<void()> fn) { cleanups_.push_back(std::move(fn)); }
+
+private:
+    std::vector<std::function<void()>> cleanups_;
+};
+
+} // namespace lsmkv
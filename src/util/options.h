@@ -1,23 +1,124 @@
 #pragma once
 #include <cstddef>
+#include <cstdint>
+#include <climits>
 #include <string>
+#include <memory>
+#include "rate_limiter.h"
+#include "statistics.h"
+#include "comparator.h"
 
 namespace lsmkv {
 
+enum CompactionStyle {
+    kCompactionStyleLevel = 0,     // bounded read/space amplification, 10-30x write amplification
+    kCompactionStyleUniversal = 1, // size-tiered sorted runs, low write amplification
+    kCompactionStyleFIFO = 2,      // never merges; drops whole files by age or total size
+};
+
+// Universal (size-tiered) compaction. Every L0 file and every non-empty L1+ level
+// is one sorted run; runs of similar size are merged once there are at least
+// level0_file_num_compaction_trigger of them.
+struct CompactionOptionsUniversal {
+    unsigned size_ratio = 1; // percent: a run joins the merge if it is at most this much bigger than the runs before it
+    unsigned min_merge_width = 2;
+    unsigned max_merge_width = UINT_MAX;
+    // Merge everything once the runs newer than the oldest exceed this percentage of its size.
+    unsigned max_size_amplification_percent = 200;
+};
+
+// FIFO compaction keeps every flush as its own L0 file and deletes the oldest
+// files once their total size exceeds max_table_files_size.
+struct CompactionOptionsFIFO {
+    uint64_t max_table_files_size = 1024ull * 1024 * 1024; // 1GB
+};
+
+// Column families each take their own Options, but the fields that size or
+// drive what the families share (db_path, block_cache_capacity,
+// max_open_files, background threads, rate_limiter, use_direct_reads,
+// statistics, stats_dump_period_sec, max_total_wal_size, create_if_missing,
+// error_if_exists) always come from the Options given to DB::Open.
 struct Options {
     std::string db_path = "./db";
+    // Key order; must outlive the DB and match the one the DB was created with.
+    // The built-in ones (bytewise, FixedBigEndian64/128) are compared inline.
+    const Comparator* comparator = BytewiseComparator();
     size_t write_buffer_size = 4 * 1024 * 1024; // 4MB
     size_t block_size = 4 * 1024; // 4KB
     size_t block_cache_capacity = 64 * 1024 * 1024; // 64MB
     unsigned bloom_bits_per_key = 10;
     size_t max_open_files = 500;
+    bool preload_new_tables = true; // open flush/compaction outputs in the background before the first read
     int num_levels = 7;
+
+    // Leveled compaction: L0 compacts once it holds level0_file_num_compaction_trigger files,
+    // level L>=1 once it exceeds max_bytes_for_level_base * multiplier^(L-1).
+    int level0_file_num_compaction_trigger = 4;
+    uint64_t max_bytes_for_level_base = 10 * 1024 * 1024; // 10MB
+    double max_bytes_for_level_multiplier = 10.0;
+    uint64_t target_file_size_base = 2 * 1024 * 1024; // compaction output files are cut at this size
+    int max_grandparent_overlap_factor = 10; // cut outputs overlapping more than factor * target_file_size_base in level+2
+
+    // Background threads: flushes get their own lane so compactions never delay them.
+    int max_background_flushes = 1;
+    int max_background_compactions = 2;
+    // A large compaction is split into up to this many key ranges merged in parallel.
+    uint32_t max_subcompactions = 1;
+    // Shared by flush (high priority) and compaction (low priority) writes and
+    // compaction reads; null means unlimited. See NewGenericRateLimiter.
+    std::shared_ptr<RateLimiter> rate_limiter;
+    // O_DIRECT keeps bulk table I/O out of the page cache so it does not evict
+    // the hot working set. Falls back to buffered I/O where unsupported.
+    bool use_direct_reads = false;                      // all SST reads
+    bool use_direct_io_for_flush_and_compaction = false; // flush/compaction writes and compaction reads
+    // Upper bound of the readahead window used when reading compaction inputs.
+    size_t compaction_readahead_size = 2 * 1024 * 1024; // 2MB
+    // Tickers and latency histograms (see statistics.h); null disables them. See CreateDBStatistics.
+    std::shared_ptr<Statistics> statistics;
+    // Every this many seconds the "lsmkv.stats" property (and statistics, if
+    // set) is appended to <db_path>/LOG. 0 disables.
+    unsigned stats_dump_period_sec = 600;
+
+    // Key-value separation: at flush and compaction, values of at least
+    // min_blob_size bytes go to append-only blob files and the tables keep a
+    // small reference, so compactions stop rewriting them. With garbage
+    // collection on, compactions move the still-referenced blobs of the oldest
+    // blob_garbage_collection_age_cutoff fraction of blob files into new ones;
+    // a blob file is deleted once nothing references it.
+    bool enable_blob_files = false;
+    uint64_t min_blob_size = 4096;
+    uint64_t blob_file_size = 256 * 1024 * 1024; // 256MB
+    bool enable_blob_garbage_collection = true;
+    double blob_garbage_collection_age_cutoff = 0.25;
+
+    CompactionStyle compaction_style = kCompactionStyleLevel;
+    CompactionOptionsUniversal compaction_options_universal;
+    CompactionOptionsFIFO compaction_options_fifo;
+    // FIFO only: a file is dropped once the newest data in it is older than ttl seconds (0 = off).
+    // Checked after flushes and, without writes, every ttl/2 seconds.
+    uint64_t ttl = 0;
+    size_t max_manifest_file_size = 8 * 1024 * 1024; // rewrite the MANIFEST as a snapshot beyond this
+    // A WAL is kept until every column family has flushed what it wrote there.
+    // Once the WALs add up to more than this, families holding the oldest one
+    // are flushed. 0 means four times the sum of all write_buffer_size.
+    uint64_t max_total_wal_size = 0;
     bool create_if_missing = true;
     bool error_if_exists = false;
 };
 
 struct ReadOptions {
     bool fill_cache = true;
+    // Iterators read ahead once a scan turns sequential, growing the window up
+    // to this many bytes and prefetching the next one in the background. 0 disables.
+    size_t readahead_size = 256 * 1024;
+};
+
+struct IngestExternalFileOptions {
+    bool move_files = true;       // hard-link the files into the DB (copy if linking fails); false always copies
+    // Read every entry to check keys are strictly increasing. Without it only
+    // the blocks' order is checked, and a file unsorted within a block would
+    // be ingested and break reads.
+    bool verify_key_order = true;
 };
 
 struct WriteOptions {
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "clock.h"
+
+namespace lsmkv {
+
+enum class PerfLevel {
+    kDisable = 0,    // record nothing (default)
+    kEnableCount,    // counters only
+    kEnableTime,     // counters and timings; reads the clock around each step
+};
+
+// Where the calling thread's operations spent their time. Accumulates across
+// operations until Reset. Timings are in nanoseconds.
+//
+// A DB::Get breaks down into get_snapshot (pinning the SuperVersion),
+// get_from_memtable, version_lookup (walking the Version for candidate
+// tables and finding them in the table cache), then per probed table
+// filter, index, block_read (cache misses only) and block_decode (searching
+// the block). A value kept in a blob file adds blob_read (cache misses only).
+struct PerfContext {
+    uint64_t get_snapshot_nanos = 0;
+    uint64_t get_from_memtable_nanos = 0;
+    uint64_t get_from_memtable_count = 0;
+    uint64_t version_lookup_nanos = 0;
+    uint64_t filter_nanos = 0;
+    uint64_t index_nanos = 0;
+    uint64_t block_read_nanos = 0;
+    uint64_t block_decode_nanos = 0;
+    uint64_t blob_read_nanos = 0;
+
+    uint64_t block_read_count = 0;
+    uint64_t block_read_bytes = 0;
+    uint64_t block_cache_hit_count = 0;
+    uint64_t bloom_filter_useful = 0;       // tables the filter ruled out
+    uint64_t bloom_filter_full_positive = 0; // tables the filter let through
+    uint64_t blob_read_count = 0;
+    uint64_t blob_read_bytes = 0;
+
+    void Reset() { *this = PerfContext(); }
+
+    std::string ToString(bool exclude_zero = false) const {
+        std::string out;
+        auto add = [&](const char* name, uint64_t v) {
+            if (exclude_zero && v == 0) return;
+            char buf[64];
+            std::snprintf(buf, sizeof(buf), "%s = %llu, ", name, (unsigned long long)v);
+            out += buf;
+        };
+        add("get_snapshot_nanos", get_snapshot_nanos);
+        add("get_from_memtable_nanos", get_from_memtable_nanos);
+        add("get_from_memtable_count", get_from_memtable_count);
+        add("version_lookup_nanos", version_lookup_nanos);
+        add("filter_nanos", filter_nanos);
+        add("index_nanos", index_nanos);
+        add("block_read_nanos", block_read_nanos);
+        add("block_decode_nanos", block_decode_nanos);
+        add("blob_read_nanos", blob_read_nanos);
+        add("block_read_count", block_read_count);
+        add("block_read_bytes", block_read_bytes);
+        add("block_cache_hit_count", block_cache_hit_count);
+        add("bloom_filter_useful", bloom_filter_useful);
+        add("bloom_filter_full_positive", bloom_filter_full_positive);
+        add("blob_read_count", blob_read_count);
+        add("blob_read_bytes", blob_read_bytes);
+        if (out.size() >= 2) out.resize(out.size() - 2);
+        return out;
+    }
+};
+
+inline thread_local PerfLevel perf_level = PerfLevel::kDisable;
+inline thread_local PerfContext perf_context;
+
+inline void SetPerfLevel(PerfLevel level) { perf_level = level; }
+inline PerfLevel GetPerfLevel() { return perf_level; }
+// The calling thread's context.
+inline PerfContext* GetPerfContext() { return &perf_context; }
+
+inline void PerfCount(uint64_t PerfContext::*field, uint64_t n = 1) {
+    if (perf_level >= PerfLevel::kEnableCount) perf_context.*field += n;
+}
+
+// Adds the time until Stop (or destruction) to one PerfContext field; does
+// nothing below kEnableTime.
+class PerfTimer {
+public:
+    explicit PerfTimer(uint64_t PerfContext::*field)
+        : field_(perf_level >= PerfLevel::kEnableTime ? field : nullptr), start_(field_ ? MonotonicNanos() : 0) {}
+    ~PerfTimer() { Stop(); }
+    void Stop() {
+        if (!field_) return;
+        perf_context.*field_ += MonotonicNanos() - start_;
+        field_ = nullptr;
+    }
+private:
+    uint64_t PerfContext::*field_;
+    uint64_t start_;
+};
+
+} // namespace lsmkv
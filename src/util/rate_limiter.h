@@ -0,0 +1,119 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace lsmkv {
+
+// Token bucket shared by background writers (flush, compaction). Tokens are
+// refilled once per refill period up to one period's worth, so a burst can
+// never exceed rate * period. Waiting high-priority requests (flushes) are
+// served before low-priority ones (compactions).
+//
+// Auto-tuned: the rate moves between max/20 and max. Every kTuneWindow refills
+// it is raised 5% if requests had to wait in most periods and lowered 5% if
+// they rarely did, so an idle DB does not keep a large budget for a burst.
+class RateLimiter {
+public:
+    enum Priority { kLow = 0, kHigh = 1 };
+
+    explicit RateLimiter(int64_t bytes_per_second, int64_t refill_period_us = 100 * 1000, bool auto_tuned = false)
+        : refill_period_us_(std::max<int64_t>(1000, refill_period_us)), auto_tuned_(auto_tuned),
+          max_bytes_per_second_(std::max<int64_t>(1, bytes_per_second)),
+          next_refill_(Clock::now()) {
+        SetRate(max_bytes_per_second_);
+    }
+
+    // Blocks until `bytes` may be written. Large requests are granted in
+    // chunks of at most one refill so they cannot starve everyone else.
+    void Request(int64_t bytes, Priority pri) {
+        std::unique_lock<std::mutex> lk(mu_);
+        total_bytes_[pri] += bytes;
+        while (bytes > 0) {
+            int64_t chunk = std::min(bytes, refill_bytes_);
+            ++waiting_[pri];
+            bool drained = false;
+            while (true) {
+                Refill();
+                if (available_ >= chunk && (pri == kHigh || waiting_[kHigh] == 0)) break;
+                if (!drained) { drained = true; ++drains_; }
+                cv_.wait_until(lk, next_refill_);
+            }
+            --waiting_[pri];
+            available_ -= chunk;
+            bytes -= chunk;
+        }
+    }
+
+    int64_t GetBytesPerSecond() const {
+        std::lock_guard<std::mutex> lg(mu_);
+        return bytes_per_second_;
+    }
+
+    // Sets the ceiling; without auto-tuning it is also the current rate.
+    void SetBytesPerSecond(int64_t bytes_per_second) {
+        std::lock_guard<std::mutex> lg(mu_);
+        max_bytes_per_second_ = std::max<int64_t>(1, bytes_per_second);
+        SetRate(max_bytes_per_second_);
+    }
+
+    int64_t GetTotalBytesThrough(Priority pri) const {
+        std::lock_guard<std::mutex> lg(mu_);
+        return total_bytes_[pri];
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr int kTuneWindow = 100;
+
+    // Requires mu_.
+    void SetRate(int64_t bytes_per_second) {
+        bytes_per_second_ = bytes_per_second;
+        refill_bytes_ = std::max<int64_t>(1, bytes_per_second_ * refill_period_us_ / 1000000);
+    }
+
+    // Requires mu_.
+    void Refill() {
+        Clock::time_point now = Clock::now();
+        if (now < next_refill_) return;
+        available_ = std::min(available_ + refill_bytes_, refill_bytes_);
+        next_refill_ = now + std::chrono::microseconds(refill_period_us_);
+        cv_.notify_all();
+        if (auto_tuned_ && ++refills_ >= kTuneWindow) Tune();
+    }
+
+    // Requires mu_.
+    void Tune() {
+        int64_t drained_pct = drains_ * 100 / refills_;
+        int64_t rate = bytes_per_second_;
+        if (drained_pct > 90) rate = rate + rate / 20;
+        else if (drained_pct < 50) rate = rate - rate / 20;
+        SetRate(std::min(max_bytes_per_second_, std::max(max_bytes_per_second_ / 20, rate)));
+        refills_ = 0;
+        drains_ = 0;
+    }
+
+    mutable std::mutex mu_;
+    std::condition_variable cv_;
+    const int64_t refill_period_us_;
+    const bool auto_tuned_;
+    int64_t max_bytes_per_second_;
+    int64_t bytes_per_second_ = 0;
+    int64_t refill_bytes_ = 0;
+    int64_t available_ = 0;
+    Clock::time_point next_refill_;
+    int waiting_[2] = {0, 0};
+    int64_t total_bytes_[2] = {0, 0};
+    int64_t refills_ = 0;
+    int64_t drains_ = 0;
+};
+
+inline std::shared_ptr<RateLimiter> NewGenericRateLimiter(int64_t bytes_per_second, int64_t refill_period_us = 100 * 1000,
+                                                          bool auto_tuned = false) {
+    return std::make_shared<RateLimiter>(bytes_per_second, refill_period_us, auto_tuned);
+}
+
+} // namespace lsmkv
@@ -11,6 +11,7 @@ class Slice {
 public:
     Slice() : data_(nullptr), size_(0) {}
     Slice(const char* d, size_t n) : data_(d), size_(n) {}
+    Slice(const char* s) : data_(s), size_(std::strlen(s)) {}
     Slice(const std::string& s) : data_(s.data()), size_(s.size()) {}
     Slice(std::string_view sv) : data_(sv.data()), size_(sv.size()) {}
 
@@ -0,0 +1,176 @@
+#include "statistics.h"
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace lsmkv {
+
+namespace {
+
+const char* const kTickerNames[kTickerMax] = {
+    "block.cache.hit",
+    "block.cache.miss",
+    "bloom.filter.useful",
+    "bloom.filter.full.positive",
+    "bloom.filter.true.positive",
+    "bytes.read",
+    "bytes.written",
+    "keys.read",
+    "keys.written",
+    "wal.syncs",
+    "stall.micros",
+    "flush.write.bytes",
+    "compact.read.bytes",
+    "compact.write.bytes",
+    "blob.bytes.read",
+    "blob.bytes.written",
+};
+
+const char* const kHistogramNames[kHistogramMax] = {
+    "db.get.micros",
+    "db.multiget.micros",
+    "db.write.micros",
+    "wal.fsync.micros",
+    "flush.micros",
+    "compaction.micros",
+};
+
+// Upper bound (inclusive) of each bucket: 1, 2, 3, 4, 6, 9, ... growing 1.5x.
+struct BucketBounds {
+    uint64_t limit[Statistics::kNumBuckets];
+    BucketBounds() {
+        double b = 1;
+        for (size_t i = 0; i < Statistics::kNumBuckets; ++i) {
+            uint64_t v = (uint64_t)b;
+            limit[i] = i > 0 && v <= limit[i - 1] ? limit[i - 1] + 1 : v;
+            b *= 1.5;
+        }
+        limit[Statistics::kNumBuckets - 1] = UINT64_MAX;
+    }
+};
+const BucketBounds kBounds;
+
+void AtomicMin(std::atomic<uint64_t>& a, uint64_t v) {
+    uint64_t cur = a.load(std::memory_order_relaxed);
+    while (v < cur && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+}
+
+void AtomicMax(std::atomic<uint64_t>& a, uint64_t v) {
+    uint64_t cur = a.load(std::memory_order_relaxed);
+    while (v > cur && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {}
+}
+
+} // namespace
+
+const char* TickerName(Ticker t) { return t < kTickerMax ? kTickerNames[t] : "unknown"; }
+const char* HistogramName(HistogramType h) { return h < kHistogramMax ? kHistogramNames[h] : "unknown"; }
+
+Statistics::Statistics()
+    : num_cores_(std::max(1u, std::thread::hardware_concurrency())), cores_(new CoreStats[num_cores_]) {
+    Reset();
+}
+
+Statistics::~Statistics() = default;
+
+Statistics::CoreStats& Statistics::Core() {
+#if defined(__linux__)
+    int cpu = sched_getcpu();
+    if (cpu >= 0) return cores_[(size_t)cpu % num_cores_];
+#endif
+    static thread_local size_t slot = std::hash<std::thread::id>()(std::this_thread::get_id());
+    return cores_[slot % num_cores_];
+}
+
+size_t Statistics::BucketFor(uint64_t micros) {
+    return std::lower_bound(kBounds.limit, kBounds.limit + kNumBuckets, micros) - kBounds.limit;
+}
+
+void Statistics::MeasureTime(HistogramType h, uint64_t micros) {
+    CoreStats::Hist& hist = Core().hists[h];
+    hist.buckets[BucketFor(micros)].fetch_add(1, std::memory_order_relaxed);
+    hist.count.fetch_add(1, std::memory_order_relaxed);
+    hist.sum.fetch_add(micros, std::memory_order_relaxed);
+    AtomicMin(hist.min, micros);
+    AtomicMax(hist.max, micros);
+}
+
+uint64_t Statistics::GetTickerCount(Ticker t) const {
+    uint64_t n = 0;
+    for (size_t c = 0; c < num_cores_; ++c) n += cores_[c].tickers[t].load(std::memory_order_relaxed);
+    return n;
+}
+
+void Statistics::GetHistogramData(HistogramType h, HistogramData* out) const {
+    uint64_t buckets[kNumBuckets] = {};
+    *out = HistogramData();
+    uint64_t min = UINT64_MAX;
+    for (size_t c = 0; c < num_cores_; ++c) {
+        const CoreStats::Hist& hist = cores_[c].hists[h];
+        for (size_t i = 0; i < kNumBuckets; ++i) buckets[i] += hist.buckets[i].load(std::memory_order_relaxed);
+        out->count += hist.count.load(std::memory_order_relaxed);
+        out->sum += hist.sum.load(std::memory_order_relaxed);
+        min = std::min(min, hist.min.load(std::memory_order_relaxed));
+        out->max = std::max(out->max, hist.max.load(std::memory_order_relaxed));
+    }
+    if (out->count == 0) return;
+    out->min = min;
+    out->average = (double)out->sum / out->count;
+    // Interpolates inside the bucket holding the percentile, clamped to [min, max].
+    auto percentile = [&](double p) {
+        double threshold = out->count * p / 100.0;
+        uint64_t cum = 0;
+        for (size_t i = 0; i < kNumBuckets; ++i) {
+            if (buckets[i] == 0 || cum + buckets[i] < threshold) { cum += buckets[i]; continue; }
+            double lo = i == 0 ? 0 : (double)kBounds.limit[i - 1];
+            double hi = i + 1 == kNumBuckets ? (double)out->max : (double)kBounds.limit[i];
+            double r = lo + (hi - lo) * (threshold - cum) / buckets[i];
+            return std::max((double)out->min, std::min((double)out->max, r));
+        }
+        return (double)out->max;
+    };
+    out->p50 = percentile(50);
+    out->p95 = percentile(95);
+    out->p99 = percentile(99);
+    out->p999 = percentile(99.9);
+}
+
+void Statistics::Reset() {
+    for (size_t c = 0; c < num_cores_; ++c) {
+        CoreStats& core = cores_[c];
+        for (auto& t : core.tickers) t.store(0, std::memory_order_relaxed);
+        for (auto& hist : core.hists) {
+            for (auto& b : hist.buckets) b.store(0, std::memory_order_relaxed);
+            hist.count.store(0, std::memory_order_relaxed);
+            hist.sum.store(0, std::memory_order_relaxed);
+            hist.min.store(UINT64_MAX, std::memory_order_relaxed);
+            hist.max.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::string Statistics::ToString() const {
+    std::string out;
+    char buf[256];
+    for (uint32_t t = 0; t < kTickerMax; ++t) {
+        std::snprintf(buf, sizeof(buf), "%s COUNT : %llu\n", kTickerNames[t], (unsigned long long)GetTickerCount((Ticker)t));
+        out += buf;
+    }
+    for (uint32_t h = 0; h < kHistogramMax; ++h) {
+        HistogramData d;
+        GetHistogramData((HistogramType)h, &d);
+        std::snprintf(buf, sizeof(buf), "%s P50 : %.2f P95 : %.2f P99 : %.2f P99.9 : %.2f MAX : %llu COUNT : %llu SUM : %llu\n",
+                      kHistogramNames[h], d.p50, d.p95, d.p99, d.p999, (unsigned long long)d.max,
+                      (unsigned long long)d.count, (unsigned long long)d.sum);
+        out += buf;
+    }
+    return out;
+}
+
+std::shared_ptr<Statistics> CreateDBStatistics() { return std::make_shared<Statistics>(); }
+
+} // namespace lsmkv
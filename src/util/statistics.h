@@ -0,0 +1,110 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "clock.h"
+
+namespace lsmkv {
+
+enum Ticker : uint32_t {
+    kBlockCacheHit = 0,
+    kBlockCacheMiss,
+    kBloomFilterUseful,        // the filter ruled a table out
+    kBloomFilterFullPositive,  // the filter passed a key
+    kBloomFilterTruePositive,  // ... and the table held it
+    kBytesRead,                // value bytes returned by Get/MultiGet/GetAsync
+    kBytesWritten,             // key + value bytes passed to Put/Delete
+    kKeysRead,
+    kKeysWritten,
+    kWalSyncs,
+    kStallMicros,              // time writers spent waiting on background work
+    kFlushWriteBytes,
+    kCompactReadBytes,
+    kCompactWriteBytes,
+    kBlobBytesRead,            // values read from blob files, garbage collection included
+    kBlobBytesWritten,         // blob file bytes written by flush and compaction
+    kTickerMax
+};
+
+enum HistogramType : uint32_t {
+    kDbGetMicros = 0,
+    kDbMultiGetMicros,
+    kDbWriteMicros,
+    kWalFsyncMicros,
+    kFlushMicros,
+    kCompactionMicros,
+    kHistogramMax
+};
+
+const char* TickerName(Ticker t);
+const char* HistogramName(HistogramType h);
+
+struct HistogramData {
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t min = 0;
+    uint64_t max = 0;
+    double average = 0;
+    double p50 = 0, p95 = 0, p99 = 0, p999 = 0;
+};
+
+// Counters and latency histograms shared by every thread of a DB (or several
+// DBs given the same object). Each CPU records into its own cache-line
+// aligned slot with relaxed atomics, so recording never contends; readers
+// sum the slots. Set Options::statistics to enable; a null pointer costs a
+// single branch per recording site.
+class Statistics {
+public:
+    Statistics();
+    ~Statistics();
+    Statistics(const Statistics&) = delete;
+    Statistics& operator=(const Statistics&) = delete;
+
+    void RecordTick(Ticker t, uint64_t n = 1) { Core().tickers[t].fetch_add(n, std::memory_order_relaxed); }
+    void MeasureTime(HistogramType h, uint64_t micros);
+
+    uint64_t GetTickerCount(Ticker t) const;
+    void GetHistogramData(HistogramType h, HistogramData* out) const;
+    // Not atomic with respect to concurrent recording.
+    void Reset();
+    // One line per ticker, then one per histogram with its percentiles.
+    std::string ToString() const;
+
+    static constexpr size_t kNumBuckets = 64; // bucket upper bounds grow 1.5x from 1us to ~33 hours
+
+private:
+    struct alignas(64) CoreStats {
+        std::atomic<uint64_t> tickers[kTickerMax];
+        struct Hist {
+            std::atomic<uint64_t> buckets[kNumBuckets];
+            std::atomic<uint64_t> count, sum, min, max;
+        } hists[kHistogramMax];
+    };
+
+    CoreStats& Core();
+    static size_t BucketFor(uint64_t micros);
+
+    size_t num_cores_;
+    std::unique_ptr<CoreStats[]> cores_;
+};
+
+std::shared_ptr<Statistics> CreateDBStatistics();
+
+inline void RecordTick(Statistics* stats, Ticker t, uint64_t n = 1) {
+    if (stats) stats->RecordTick(t, n);
+}
+
+// Adds the elapsed time to a histogram on destruction; reads no clock when stats is null.
+class StopWatch {
+public:
+    StopWatch(Statistics* stats, HistogramType h) : stats_(stats), h_(h), start_(stats ? MonotonicMicros() : 0) {}
+    ~StopWatch() { if (stats_) stats_->MeasureTime(h_, ElapsedMicros()); }
+    uint64_t ElapsedMicros() const { return stats_ ? MonotonicMicros() - start_ : 0; }
+private:
+    Statistics* stats_;
+    HistogramType h_;
+    uint64_t start_;
+};
+
+} // namespace lsmkv
@@ -14,6 +14,7 @@ public:
 
     bool ok() const { return code_ == kOk; }
     bool IsNotFound() const { return code_ == kNotFound; }
+    bool IsCorruption() const { return code_ == kCorruption; }
 
     std::string ToString() const {
         switch (code_) {
@@ -0,0 +1,653 @@
+#include "include/lsm_kv.h"
+#include "include/sst_file_writer.h"
+#include "include/checkpoint.h"
+#include "src/sstable/sstable_builder.h"
+#include "src/db/version_edit.h"
+#include "src/db/wal.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <future>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <cstdio>
+#include <algorithm>
+
+using namespace lsmkv;
+
+// Descending byte order: a custom (virtually called) comparator.
+struct ReverseComparator : public Comparator {
+    int Compare(const Slice& a, const Slice& b) const override { return b.compare(a); }
+    const char* Name() const override { return "test.ReverseComparator"; }
+};
+
+// Polls cond for up to the given number of seconds.
+static bool WaitFor(const std::function<bool()>& cond, int seconds) {
+    for (int i = 0; i < seconds * 20; ++i) {
+        if (cond()) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return cond();
+}
+
+static uint64_t IntProperty(DB* db, const std::string& name) {
+    uint64_t x = 0;
+    db->GetIntProperty(name, &x);
+    return x;
+}
+
+static bool Check(DB* db, int n) {
+    ReadOptions ro;
+    for (int i=0;i<n;++i) {
+        std::string k = "key" + std::to_string(i), v;
+        Status s = db->Get(ro, Slice(k), &v);
+        if (i % 7 == 0) {
+            if (!s.IsNotFound()) { std::cerr << k << " should be deleted" << std::endl; return false; }
+        } else if (!s.ok() || v != "value" + std::to_string(i)) {
+            std::cerr << k << ": " << s.ToString() << std::endl; return false;
+        }
+    }
+    // MultiGet must agree with Get, including for missing and deleted keys.
+    std::vector<std::string> names;
+    for (int i=0;i<n;i+=13) names.push_back("key" + std::to_string(i));
+    names.push_back("nokey");
+    std::vector<Slice> keys(names.begin(), names.end());
+    std::vector<std::string> values;
+    std::vector<Status> ss = db->MultiGet(ro, keys, &values);
+    for (size_t j=0;j<keys.size();++j) {
+        std::string v;
+        Status s = db->Get(ro, keys[j], &v);
+        if (s.ok() != ss[j].ok() || (s.ok() && v != values[j])) { std::cerr << "multiget " << names[j] << std::endl; return false; }
+    }
+    // GetAsync (future variant) must agree with Get as well.
+    std::vector<std::string> async_values(keys.size());
+    std::vector<std::future<Status>> futures;
+    for (size_t j=0;j<keys.size();++j) futures.push_back(db->GetAsync(ro, keys[j], &async_values[j]));
+    for (size_t j=0;j<keys.size();++j) {
+        Status s = futures[j].get();
+        if (s.ok() != ss[j].ok() || (s.ok() && async_values[j] != values[j])) { std::cerr << "getasync " << names[j] << std::endl; return false; }
+    }
+    // Keys sort as strings; the iterator must visit exactly the live ones, in order.
+    int live = 0;
+    std::string prev;
+    auto it = db->NewIterator(ro);
+    for (it->SeekToFirst(); it->Valid(); it->Next(), ++live) {
+        std::string k = it->key().ToString();
+        if (!prev.empty() && k <= prev) { std::cerr << "iterator out of order at " << k << std::endl; return false; }
+        int i = std::stoi(k.substr(3));
+        if (i % 7 == 0 || it->value().ToString() != "value" + std::to_string(i)) { std::cerr << "iterator: " << k << std::endl; return false; }
+        prev = k;
+    }
+    if (!it->status().ok() || live != n - (n + 6) / 7) { std::cerr << "iterator saw " << live << " keys" << std::endl; return false; }
+    it->Seek(Slice("key10"));
+    if (!it->Valid() || it->key().ToString() != "key10") { std::cerr << "iterator seek" << std::endl; return false; }
+    return true;
+}
+
+int main() {
+    namespace fs = std::filesystem;
+    const std::string path = "./test_db_dir";
+    const std::string ckpt = "./test_db_checkpoint";
+    fs::remove_all(path);
+    const int n = 5000;
+
+    Options opt;
+    opt.write_buffer_size = 32 * 1024;
+    opt.statistics = CreateDBStatistics();
+    {
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(opt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        for (int i=0;i<n;++i) db->Put(wo, Slice("key" + std::to_string(i)), Slice("value" + std::to_string(i)));
+        db->Flush();
+        for (int i=0;i<n;i+=7) db->Delete(wo, Slice("key" + std::to_string(i)));
+        if (!Check(db.get(), n)) return 1;
+        Statistics* st = opt.statistics.get();
+        if (st->GetTickerCount(kKeysWritten) != (uint64_t)(n + (n + 6) / 7) || st->GetTickerCount(kKeysRead) == 0 ||
+            st->GetTickerCount(kBlockCacheHit) + st->GetTickerCount(kBlockCacheMiss) == 0) {
+            std::cerr << "bad statistics:\n" << st->ToString(); return 1;
+        }
+        HistogramData h;
+        st->GetHistogramData(kDbWriteMicros, &h);
+        if (h.count != st->GetTickerCount(kKeysWritten) || h.p50 > h.max) { std::cerr << "bad write histogram" << std::endl; return 1; }
+
+        uint64_t live = 0, per_level = 0, x = 0;
+        std::string text;
+        for (int l=0; l<opt.num_levels; ++l) {
+            if (!db->GetIntProperty("lsmkv.num-files-at-level" + std::to_string(l), &x)) { std::cerr << "no level property" << std::endl; return 1; }
+            per_level += x;
+        }
+        if (!db->GetIntProperty("lsmkv.num-live-files", &live) || live == 0 || per_level == 0 ||
+            !db->GetProperty("lsmkv.stats", &text) || text.find("Sum") == std::string::npos ||
+            db->GetIntProperty("lsmkv.no-such-property", &x)) {
+            std::cerr << "bad properties: " << live << " " << per_level << "\n" << text; return 1;
+        }
+    }
+
+    // A deletion is an entry itself and hides one in an older table: 100
+    // puts (flushed by the reopen) and 10 deletions estimate 90 keys, from
+    // the memtable and again once the next reopen flushed the deletions.
+    const std::string kpath = path + "_keys";
+    fs::remove_all(kpath);
+    for (int round = 0; round < 3; ++round) {
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(Options(), kpath, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        if (round == 0) {
+            for (int i=0;i<100;++i) db->Put(wo, Slice("key" + std::to_string(i)), Slice("v"));
+            continue;
+        }
+        if (round == 1) for (int i=0;i<100;i+=10) db->Delete(wo, Slice("key" + std::to_string(i)));
+        if (round == 2) {
+            // No table is open yet: GetAsync must not open one on this thread,
+            // even for a key the filters then rule out without reading a block.
+            std::promise<std::thread::id> where;
+            db->GetAsync(ReadOptions(), Slice("key1x"), [&](const Status&, std::string&&) { where.set_value(std::this_thread::get_id()); });
+            if (where.get_future().get() == std::this_thread::get_id()) { std::cerr << "getasync opened a table on the caller's thread" << std::endl; return 1; }
+        }
+        uint64_t keys = 0;
+        if (!db->GetIntProperty("lsmkv.estimate-num-keys", &keys) || keys != 90) { std::cerr << "estimate-num-keys " << keys << std::endl; return 1; }
+    }
+    fs::remove_all(kpath);
+
+    // A flush slowed down by the rate limiter stalls writers instead of
+    // letting the active memtable grow past write_buffer_size.
+    {
+        Options wopt = opt;
+        wopt.rate_limiter = NewGenericRateLimiter(512 * 1024);
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(wopt, kpath, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        const uint64_t stalled = wopt.statistics->GetTickerCount(kStallMicros);
+        for (int i=0;i<2000;++i) {
+            db->Put(wo, Slice("key" + std::to_string(i)), Slice(std::string(100, 'x')));
+            if (IntProperty(db.get(), "lsmkv.cur-size-active-mem-table") >= wopt.write_buffer_size) { std::cerr << "memtable outgrew write_buffer_size" << std::endl; return 1; }
+        }
+        if (wopt.statistics->GetTickerCount(kStallMicros) == stalled) { std::cerr << "writers never stalled" << std::endl; return 1; }
+    }
+    fs::remove_all(kpath);
+
+    // A table the MANIFEST does not know about must be ignored and removed.
+    { std::ofstream junk(path + "/L1-999999.sst"); junk << "half-written"; }
+
+    {
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(opt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        if (!fs::exists(path + "/CURRENT")) { std::cerr << "no CURRENT" << std::endl; return 1; }
+        if (fs::exists(path + "/L1-999999.sst")) { std::cerr << "orphan kept" << std::endl; return 1; }
+        if (!Check(db.get(), n)) return 1;
+
+        // Reopening flushed the memtable, so this Get goes to a table.
+        SetPerfLevel(PerfLevel::kEnableTime);
+        GetPerfContext()->Reset();
+        std::string pv;
+        if (!db->Get(ReadOptions(), Slice("key1"), &pv).ok()) { std::cerr << "key1 missing" << std::endl; return 1; }
+        const PerfContext& pc = *GetPerfContext();
+        if (pc.get_from_memtable_count != 1 || pc.bloom_filter_full_positive == 0 ||
+            pc.block_read_count + pc.block_cache_hit_count == 0) {
+            std::cerr << "bad perf context: " << pc.ToString() << std::endl; return 1;
+        }
+        SetPerfLevel(PerfLevel::kDisable);
+
+        // Ingested data is newer than what the DB holds: "key3" (in a table
+        // and the memtable) must read back as the ingested value.
+        WriteOptions wo; wo.sync = false;
+        db->Put(wo, Slice("key3"), Slice("memtable"));
+        SstFileWriter w(opt);
+        const std::string ext = "./test_db_ext.sst";
+        if (!w.Open(ext).ok()) { std::cerr << "writer open" << std::endl; return 1; }
+        w.Put(Slice("ext1"), Slice("a"));
+        w.Put(Slice("ext2"), Slice("b"));
+        if (w.Put(Slice("ext0"), Slice("c")).ok()) { std::cerr << "out of order key accepted" << std::endl; return 1; }
+        w.Put(Slice("key3"), Slice("ingested"));
+        if (!(s = w.Finish()).ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        s = db->IngestExternalFile({ext}, IngestExternalFileOptions());
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        std::string v;
+        if (!db->Get(ReadOptions(), Slice("ext2"), &v).ok() || v != "b") { std::cerr << "ext2 missing" << std::endl; return 1; }
+        if (!db->Get(ReadOptions(), Slice("key3"), &v).ok() || v != "ingested") { std::cerr << "key3 = " << v << std::endl; return 1; }
+        fs::remove(ext);
+
+        // Keys out of order inside one block are caught by default.
+        SSTableBuilder bad(ext, 4 * 1024, 10);
+        if (!bad.Open().ok()) { std::cerr << "builder open" << std::endl; return 1; }
+        bad.Add(Slice("ext5"), MemValue{kTypeValue, "a"});
+        bad.Add(Slice("ext4"), MemValue{kTypeValue, "b"});
+        SSTableMeta meta;
+        if (!bad.Finish(&meta).ok()) { std::cerr << "builder finish" << std::endl; return 1; }
+        s = db->IngestExternalFile({ext}, IngestExternalFileOptions());
+        if (!s.IsCorruption() || db->Get(ReadOptions(), Slice("ext5"), &v).ok()) { std::cerr << "unsorted file ingested: " << s.ToString() << std::endl; return 1; }
+        fs::remove(ext);
+    }
+    fs::remove_all(path);
+
+    // Key-value separation: values of 7+ bytes ("value10" on) go to blob
+    // files, shorter ones stay inline. Overwrites leave garbage behind for
+    // compaction to account and collect.
+    Options bopt;
+    bopt.write_buffer_size = 32 * 1024;
+    bopt.enable_blob_files = true;
+    bopt.min_blob_size = 7;
+    bopt.blob_file_size = 16 * 1024;
+    bopt.blob_garbage_collection_age_cutoff = 0.5;
+    {
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(bopt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        for (int round=0; round<3; ++round) {
+            for (int i=0;i<n;++i) db->Put(wo, Slice("key" + std::to_string(i)), Slice("value" + std::to_string(i)));
+            db->Flush();
+        }
+        for (int i=0;i<n;i+=7) db->Delete(wo, Slice("key" + std::to_string(i)));
+        if (!Check(db.get(), n)) return 1;
+        uint64_t blob_files = 0;
+        if (!db->GetIntProperty("lsmkv.num-blob-files", &blob_files) || blob_files == 0) { std::cerr << "no blob files" << std::endl; return 1; }
+    }
+    { std::ofstream junk(path + "/999999.blob"); junk << "half-written"; }
+    {
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(bopt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        if (fs::exists(path + "/999999.blob")) { std::cerr << "orphan blob file kept" << std::endl; return 1; }
+        if (!Check(db.get(), n)) return 1;
+    }
+    fs::remove_all(path);
+
+    // Column families: "meta" flushes often and so rotates the shared WAL
+    // under "default", whose unflushed keys must survive the reopen.
+    Options copt;
+    copt.write_buffer_size = 16 * 1024;
+    std::vector<ColumnFamilyDescriptor> families = {{kDefaultColumnFamilyName, opt}, {"meta", copt}};
+    {
+        std::unique_ptr<DB> db;
+        std::vector<ColumnFamilyHandle*> cfs;
+        Status s = DB::Open(opt, path, families, &cfs, &db);
+        if (!s.ok() || cfs.size() != 2 || cfs[0] != db->DefaultColumnFamily()) { std::cerr << "open families: " << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        for (int i=0;i<n;++i) {
+            std::string k = "key" + std::to_string(i);
+            WriteBatch batch;
+            batch.Put(cfs[1], Slice(k), Slice("meta" + std::to_string(i)));
+            if (i % 10 == 0) batch.Put(Slice(k), Slice("value" + std::to_string(i)));
+            if (!(s = db->Write(wo, &batch)).ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        }
+        db->Delete(wo, cfs[1], Slice("key1"));
+        std::string v;
+        if (!db->Get(ReadOptions(), cfs[1], Slice("key20"), &v).ok() || v != "meta20" ||
+            !db->Get(ReadOptions(), Slice("key1"), &v).IsNotFound()) { std::cerr << "families mixed up" << std::endl; return 1; }
+        ColumnFamilyHandle* tmp = nullptr;
+        if (!db->CreateColumnFamily(copt, "tmp", &tmp).ok() || db->CreateColumnFamily(copt, "tmp", &tmp).ok()) { std::cerr << "create family" << std::endl; return 1; }
+        db->Put(wo, tmp, Slice("a"), Slice("b"));
+        if (!db->DropColumnFamily(tmp).ok() || db->Put(wo, tmp, Slice("a"), Slice("c")).ok()) { std::cerr << "drop family" << std::endl; return 1; }
+    }
+    {
+        std::unique_ptr<DB> db;
+        std::vector<ColumnFamilyHandle*> cfs;
+        Status s = DB::Open(opt, path, families, &cfs, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        ReadOptions ro;
+        for (int i=0;i<n;++i) {
+            std::string k = "key" + std::to_string(i), v;
+            s = db->Get(ro, cfs[1], Slice(k), &v);
+            if (i == 1 ? !s.IsNotFound() : (!s.ok() || v != "meta" + std::to_string(i))) { std::cerr << "meta " << k << std::endl; return 1; }
+            s = db->Get(ro, Slice(k), &v);
+            if (i % 10 == 0 ? (!s.ok() || v != "value" + std::to_string(i)) : !s.IsNotFound()) { std::cerr << "default " << k << std::endl; return 1; }
+        }
+        for (auto& p : fs::directory_iterator(path)) {
+            if (p.is_directory() && p.path().filename() != "cf-1") { std::cerr << "dropped family kept " << p.path() << std::endl; return 1; }
+        }
+
+        // A checkpoint holds the unflushed "fresh" but nothing written after it.
+        WriteOptions wo; wo.sync = false;
+        db->Put(wo, Slice("fresh"), Slice("1"));
+        fs::remove_all(ckpt);
+        if (!(s = Checkpoint(db.get()).Create(ckpt)).ok()) { std::cerr << "checkpoint: " << s.ToString() << std::endl; return 1; }
+        if (Checkpoint(db.get()).Create(ckpt).ok()) { std::cerr << "checkpoint over an existing dir" << std::endl; return 1; }
+        db->Put(wo, cfs[1], Slice("late"), Slice("1"));
+    }
+    {
+        std::unique_ptr<DB> db;
+        std::vector<ColumnFamilyHandle*> cfs;
+        Status s = DB::Open(opt, ckpt, families, &cfs, &db);
+        if (!s.ok()) { std::cerr << "open checkpoint: " << s.ToString() << std::endl; return 1; }
+        std::string v;
+        if (!db->Get(ReadOptions(), Slice("fresh"), &v).ok() || !db->Get(ReadOptions(), cfs[1], Slice("late"), &v).IsNotFound() ||
+            !db->Get(ReadOptions(), cfs[1], Slice("key20"), &v).ok() || v != "meta20") { std::cerr << "checkpoint contents" << std::endl; return 1; }
+    }
+    fs::remove_all(ckpt);
+    fs::remove_all(path);
+
+    // A table that cannot be opened fails the lookup instead of letting the
+    // older version of the key below it show through.
+    // Each reopen flushes what the WAL holds, so "old" and "new" land in two tables.
+    for (const char* v : {"old", "new", ""}) {
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(opt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        if (*v) db->Put(wo, Slice("k"), Slice(v));
+    }
+    {
+        std::string newest;
+        uint64_t newest_number = 0;
+        for (auto& p : fs::directory_iterator(path)) {
+            std::string name = p.path().filename().string();
+            if (p.path().extension() != ".sst") continue;
+            uint64_t number = std::stoull(name.substr(name.find('-') + 1));
+            if (number > newest_number) { newest_number = number; newest = p.path().string(); }
+        }
+        fs::resize_file(newest, 10);
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(opt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        std::string v;
+        s = db->Get(ReadOptions(), Slice("k"), &v);
+        if (s.ok() || s.IsNotFound()) { std::cerr << "unreadable table skipped: " << v << std::endl; return 1; }
+        std::vector<std::string> values;
+        s = db->MultiGet(ReadOptions(), {Slice("k")}, &values)[0];
+        if (s.ok() || s.IsNotFound()) { std::cerr << "multiget skipped an unreadable table" << std::endl; return 1; }
+        s = db->GetAsync(ReadOptions(), Slice("k"), &v).get();
+        if (s.ok() || s.IsNotFound()) { std::cerr << "getasync skipped an unreadable table" << std::endl; return 1; }
+    }
+    fs::remove_all(path);
+
+    // FIFO: without any further write, the periodic check drops files once
+    // they are past the TTL.
+    Options fopt;
+    fopt.write_buffer_size = 32 * 1024;
+    fopt.compaction_style = kCompactionStyleFIFO;
+    fopt.ttl = 1;
+    for (const char* k : {"a", "b", ""}) {
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(fopt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        if (*k) db->Put(wo, Slice(k), Slice("v"));
+        else if (IntProperty(db.get(), "lsmkv.num-files-at-level0") != 2) { std::cerr << "fifo files not flushed" << std::endl; return 1; }
+    }
+    {
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(fopt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        if (!WaitFor([&]{ return IntProperty(db.get(), "lsmkv.num-live-files") == 0; }, 10)) { std::cerr << "expired files kept" << std::endl; return 1; }
+        std::string v;
+        if (!db->Get(ReadOptions(), Slice("a"), &v).IsNotFound()) { std::cerr << "expired key readable" << std::endl; return 1; }
+    }
+    fs::remove_all(path);
+
+    // FIFO: beyond max_table_files_size the oldest files are dropped.
+    fopt.ttl = 0;
+    fopt.compaction_options_fifo.max_table_files_size = 64 * 1024;
+    const std::string pad(100, 'x');
+    for (int round = 0; round < 2; ++round) {
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(fopt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        if (round == 0) {
+            for (int i=0;i<n;++i) db->Put(wo, Slice("key" + std::to_string(i)), Slice(pad + std::to_string(i)));
+            continue;
+        }
+        if (!WaitFor([&]{ return IntProperty(db.get(), "lsmkv.total-sst-files-size") <= fopt.compaction_options_fifo.max_table_files_size; }, 10)) {
+            std::cerr << "fifo size cap exceeded" << std::endl; return 1;
+        }
+        std::string v;
+        if (!db->Get(ReadOptions(), Slice("key0"), &v).IsNotFound() ||
+            !db->Get(ReadOptions(), Slice("key" + std::to_string(n - 1)), &v).ok()) { std::cerr << "fifo dropped the wrong files" << std::endl; return 1; }
+    }
+    fs::remove_all(path);
+
+    // A failed compaction (here: a truncated input table) is recorded as the
+    // background error, and later writes and flushes fail with it. Each
+    // reopen flushes the previous round's WAL; the last one makes four L0
+    // files and starts the compaction.
+    for (int round = 0; round < 5; ++round) {
+        if (round == 4) {
+            for (auto& p : fs::directory_iterator(path)) {
+                if (p.path().extension() == ".sst") { fs::resize_file(p.path(), 10); break; }
+            }
+        }
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(opt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        if (round < 4) {
+            for (int i=0;i<100;++i) db->Put(wo, Slice("key" + std::to_string(i)), Slice("value" + std::to_string(round)));
+            continue;
+        }
+        if (!WaitFor([&]{ return !db->Put(wo, Slice("k"), Slice("v")).ok(); }, 10)) { std::cerr << "compaction error not surfaced" << std::endl; return 1; }
+        Status put = db->Put(wo, Slice("k"), Slice("v"));
+        s = db->Flush();
+        if (s.ok() || s.ToString() != put.ToString()) { std::cerr << "flush after background error: " << s.ToString() << std::endl; return 1; }
+    }
+    fs::remove_all(path);
+
+    // Flushes have their own threads: one completes while a compaction,
+    // slowed down by the rate limiter, is still running.
+    Options popt;
+    popt.write_buffer_size = 256 * 1024;
+    popt.rate_limiter = NewGenericRateLimiter(1024 * 1024);
+    for (int round = 0; round < 5; ++round) {
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(popt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        const std::string value(200, 'a' + round);
+        if (round < 4) {
+            for (int i=0;i<1000;++i) db->Put(wo, Slice("key" + std::to_string(i)), Slice(value));
+            continue;
+        }
+        if (!WaitFor([&]{ return IntProperty(db.get(), "lsmkv.num-running-compactions") == 1; }, 5)) { std::cerr << "no compaction started" << std::endl; return 1; }
+        uint64_t l0 = IntProperty(db.get(), "lsmkv.num-files-at-level0");
+        for (int i=0;i<200;++i) db->Put(wo, Slice("new" + std::to_string(i)), Slice(value));
+        db->Flush();
+        // Flushed first, then still compacting: the flush finished during the compaction.
+        bool flushed = false, compacting = true;
+        WaitFor([&]{
+            flushed = IntProperty(db.get(), "lsmkv.num-files-at-level0") > l0;
+            compacting = IntProperty(db.get(), "lsmkv.num-running-compactions") == 1;
+            return flushed || !compacting;
+        }, 10);
+        if (!flushed || !compacting) { std::cerr << "flush waited for the compaction" << std::endl; return 1; }
+    }
+    fs::remove_all(path);
+
+    // Sequential keys never overlap the level below, so leveled compaction
+    // only relinks each L0 file into L1: the files keep their numbers (and
+    // the L0- names they were created with) and nothing is rewritten.
+    {
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(opt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        char key[16];
+        for (int i=0;i<n;++i) {
+            std::snprintf(key, sizeof(key), "seq%06d", i);
+            db->Put(wo, Slice(key), Slice(std::string(40, 'v')));
+        }
+        db->Flush();
+        if (!WaitFor([&]{ return IntProperty(db.get(), "lsmkv.num-files-at-level1") > 0 &&
+                                IntProperty(db.get(), "lsmkv.num-files-at-level0") < (uint64_t)opt.level0_file_num_compaction_trigger &&
+                                IntProperty(db.get(), "lsmkv.num-immutable-mem-table") == 0 &&
+                                IntProperty(db.get(), "lsmkv.num-running-compactions") == 0; }, 10)) {
+            std::cerr << "nothing moved to L1" << std::endl; return 1;
+        }
+        uint64_t files = 0, on_disk = 0;
+        for (int l=0; l<opt.num_levels; ++l) files += IntProperty(db.get(), "lsmkv.num-files-at-level" + std::to_string(l));
+        for (auto& p : fs::directory_iterator(path)) {
+            std::string name = p.path().filename().string();
+            if (p.path().extension() != ".sst") continue;
+            ++on_disk;
+            if (name.compare(0, 3, "L0-") != 0) { std::cerr << "moved file rewritten: " << name << std::endl; return 1; }
+        }
+        if (IntProperty(db.get(), "lsmkv.bytes-written-at-level1") != 0 || files != on_disk) { std::cerr << "trivial move wrote data" << std::endl; return 1; }
+    }
+    fs::remove_all(path);
+
+    // Universal compaction: merges keep the sorted runs (each L0 file and
+    // each non-empty level) under the trigger, and full merges land in the
+    // last level.
+    Options uopt;
+    uopt.write_buffer_size = 32 * 1024;
+    uopt.compaction_style = kCompactionStyleUniversal;
+    for (int round = 0; round < 2; ++round) {
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(uopt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        if (round == 0) {
+            for (int pass=0; pass<3; ++pass) {
+                for (int i=0;i<n;++i) db->Put(wo, Slice("key" + std::to_string(i)), Slice((pass < 2 ? "stale" : "value") + std::to_string(i)));
+            }
+            for (int i=0;i<n;i+=7) db->Delete(wo, Slice("key" + std::to_string(i)));
+            if (!Check(db.get(), n)) return 1;
+            continue;
+        }
+        auto runs = [&]{
+            uint64_t r = IntProperty(db.get(), "lsmkv.num-files-at-level0");
+            for (int l=1; l<uopt.num_levels; ++l) r += IntProperty(db.get(), "lsmkv.num-files-at-level" + std::to_string(l)) > 0;
+            return r;
+        };
+        if (!WaitFor([&]{ return runs() < (uint64_t)uopt.level0_file_num_compaction_trigger && IntProperty(db.get(), "lsmkv.num-running-compactions") == 0; }, 10) ||
+            IntProperty(db.get(), "lsmkv.num-files-at-level" + std::to_string(uopt.num_levels - 1)) == 0) {
+            std::string text;
+            db->GetProperty("lsmkv.levelstats", &text);
+            std::cerr << "universal shape: " << runs() << " runs\n" << text; return 1;
+        }
+        if (!Check(db.get(), n)) return 1;
+    }
+    fs::remove_all(path);
+
+    // Subcompactions: with small output files each L0->L1 compaction splits
+    // into up to four key ranges merged in parallel. Overwrites, deletions
+    // and blob relocation must come out as without splits.
+    Options sopt = bopt;
+    sopt.target_file_size_base = 8 * 1024;
+    sopt.max_subcompactions = 4;
+    for (int round = 0; round < 2; ++round) {
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(sopt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        if (round == 0) {
+            for (int pass=0; pass<4; ++pass) {
+                for (int i=0;i<n;++i) db->Put(wo, Slice("key" + std::to_string(i)), Slice((pass < 3 ? "stale" : "value") + std::to_string(i)));
+                db->Flush();
+            }
+            for (int i=0;i<n;i+=7) db->Delete(wo, Slice("key" + std::to_string(i)));
+            db->Flush();
+        }
+        if (!Check(db.get(), n)) return 1;
+    }
+    fs::remove_all(path);
+
+    // The comparator orders memtables, tables, compactions and iterators alike,
+    // and a DB refuses to open under a different one.
+    ReverseComparator reverse;
+    Options ropt = opt;
+    ropt.comparator = &reverse;
+    {
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(ropt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        for (int i=0;i<n;++i) db->Put(wo, Slice("key" + std::to_string(i)), Slice("value" + std::to_string(i)));
+        db->Flush();
+        db->CompactRange(Slice(""), Slice(""));
+        std::string v, prev;
+        for (int i=0;i<n;++i) {
+            if (!db->Get(ReadOptions(), Slice("key" + std::to_string(i)), &v).ok() || v != "value" + std::to_string(i)) { std::cerr << "reverse get " << i << std::endl; return 1; }
+        }
+        int count = 0;
+        auto it = db->NewIterator(ReadOptions());
+        for (it->SeekToFirst(); it->Valid(); it->Next(), ++count) {
+            std::string k = it->key().ToString();
+            if (!prev.empty() && k >= prev) { std::cerr << "reverse order at " << k << std::endl; return 1; }
+            prev = k;
+        }
+        it->Seek(Slice("key5"));
+        if (count != n || !it->Valid() || it->key().ToString() != "key5" || (it->Next(), it->key().ToString() != "key4999")) {
+            std::cerr << "reverse iterator" << std::endl; return 1;
+        }
+    }
+    {
+        std::unique_ptr<DB> db;
+        if (DB::Open(opt, path, &db).ok()) { std::cerr << "opened with another comparator" << std::endl; return 1; }
+    }
+    fs::remove_all(path);
+
+    // The fixed-width comparators order 8- (16-) byte keys as big-endian
+    // integers and fall back to bytes for other lengths: bytewise order
+    // either way. Keys mix both widths, share prefixes and use high bytes.
+    std::vector<std::string> fixed_keys;
+    for (int i=0;i<n;++i) {
+        uint64_t x = (uint64_t)i * 0x9E3779B97F4A7C15ull;
+        std::string k(8, '\0');
+        for (int b=0; b<8; ++b) k[b] = (char)(x >> (56 - 8 * b));
+        if (i % 3 == 0) k += k;
+        else if (i % 3 == 1) k.append(8, (char)(i & 0xff));
+        fixed_keys.push_back(k);
+        if (i % 5 == 0) fixed_keys.push_back(k.substr(0, 8));
+    }
+    std::sort(fixed_keys.begin(), fixed_keys.end());
+    fixed_keys.erase(std::unique(fixed_keys.begin(), fixed_keys.end()), fixed_keys.end());
+    for (const Comparator* cmp : {FixedBigEndian64Comparator(), FixedBigEndian128Comparator()}) {
+        Options xopt = opt;
+        xopt.comparator = cmp;
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(xopt, path, &db);
+        if (!s.ok()) { std::cerr << s.ToString() << std::endl; return 1; }
+        WriteOptions wo; wo.sync = false;
+        for (size_t i=fixed_keys.size(); i-- > 0;) db->Put(wo, Slice(fixed_keys[i]), Slice(std::to_string(i)));
+        db->Flush();
+        db->CompactRange(Slice(""), Slice(""));
+        size_t i = 0;
+        auto it = db->NewIterator(ReadOptions());
+        for (it->SeekToFirst(); it->Valid(); it->Next(), ++i) {
+            if (i >= fixed_keys.size() || it->key().ToString() != fixed_keys[i] || it->value().ToString() != std::to_string(i)) {
+                std::cerr << cmp->Name() << " order at " << i << std::endl; return 1;
+            }
+        }
+        std::string v;
+        if (i != fixed_keys.size() || !db->Get(ReadOptions(), Slice(fixed_keys[i / 2]), &v).ok() || v != std::to_string(i / 2)) {
+            std::cerr << cmp->Name() << " scan saw " << i << " keys" << std::endl; return 1;
+        }
+        it.reset();
+        db.reset();
+        fs::remove_all(path);
+    }
+
+    // A MANIFEST edit naming a level past num_levels is rejected, not indexed.
+    for (int bad : {0, 1}) {
+        fs::remove_all(path);
+        fs::create_directories(path);
+        VersionEdit edit;
+        edit.SetComparatorName(opt.comparator->Name());
+        if (bad == 0) edit.RemoveFile(opt.num_levels + 3, 5);
+        else edit.AddFile(TableFile{opt.num_levels, 5, path + "/L0-5.sst", "a", "b", 100, 0});
+        std::string rec;
+        edit.EncodeTo(rec);
+        std::unique_ptr<WALWriter> w;
+        if (!WALWriter::Open(path + "/MANIFEST-1", w).ok() ||
+            !w->AddRecord(kTypeVersionEdit, Slice(""), Slice(rec), true).ok()) {
+            std::cerr << "write manifest failed" << std::endl; return 1;
+        }
+        w.reset();
+        std::ofstream(path + "/CURRENT") << "MANIFEST-1\n";
+        std::unique_ptr<DB> db;
+        Status s = DB::Open(opt, path, &db);
+        if (!s.IsCorruption()) { std::cerr << "bad level opened: " << s.ToString() << std::endl; return 1; }
+    }
+    fs::remove_all(path);
+
+    std::cout << "ok" << std::endl;
+    return 0;
+}
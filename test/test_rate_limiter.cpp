@@ -0,0 +1,18 @@
+#include "src/util/rate_limiter.h"
+#include <iostream>
+#include <chrono>
+
+int main() {
+    using namespace lsmkv;
+    // 1MB/s refilled every 100ms: 300KB needs three refills, i.e. at least ~200ms.
+    RateLimiter rl(1024 * 1024, 100 * 1000);
+    auto start = std::chrono::steady_clock::now();
+    for (int i=0; i<30; ++i) rl.Request(10 * 1024, i % 2 ? RateLimiter::kHigh : RateLimiter::kLow);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    if (ms < 150) { std::cerr << "too fast: " << ms << "ms" << std::endl; return 1; }
+    if (rl.GetTotalBytesThrough(RateLimiter::kLow) + rl.GetTotalBytesThrough(RateLimiter::kHigh) != 300 * 1024) {
+        std::cerr << "bad byte count" << std::endl; return 1;
+    }
+    std::cout << "ok " << ms << "ms" << std::endl;
+    return 0;
+}